@@ -0,0 +1,92 @@
+// Slow terminal harness for CosOptions::console.
+//
+// stdout and stderr go to a pipe whose reader takes 512 bytes every 5 ms
+// (about 100 KB/s, a bad SSH session) while the application writes lines at
+// about 5 MB/s. With SkipLines the application's write() latency must stay
+// flat and the log must hold every line; Block is there to compare against.
+//
+//   slow-console [skip|block] [LINES]
+//
+// With SkipLines it exits non-zero when the log misses a line or write
+// latency is not flat: p99.9 over 1 ms or any write over 50 ms.
+#include "cos.h"
+#include <sys/wait.h>
+#include <csignal>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+int main(int argc, char* argv[]) {
+    bool block = argc > 1 && std::string(argv[1]) == "block";
+    int lines = argc > 2 ? atoi(argv[2]) : 20000;
+    int report = dup(STDERR_FILENO);
+
+    int terminal[2];
+    if (pipe(terminal) != 0) return 2;
+    pid_t reader = fork();
+    if (reader == 0) {
+        close(terminal[1]);
+        char buf[512];
+        while (read(terminal[0], buf, sizeof(buf)) > 0) usleep(5000);
+        _exit(0);
+    }
+    close(terminal[0]);
+    dup2(terminal[1], STDOUT_FILENO);
+    dup2(terminal[1], STDERR_FILENO);
+    close(terminal[1]);
+
+    CosOptions options = COS::defaults();
+    options.console = block ? CosOptions::Console::Block : CosOptions::Console::SkipLines;
+    COS* cos = new COS(options);
+    std::string logPath = cos->getLogPath();
+
+    std::vector<double> latencyUs;
+    latencyUs.reserve(lines);
+    char line[128];
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < lines; i++) {
+        int n = snprintf(line, sizeof(line), "line %06d the quick brown fox jumps over the lazy dog ........\n", i);
+        auto before = std::chrono::steady_clock::now();
+        if (write(STDOUT_FILENO, line, n) != n) break;
+        latencyUs.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - before).count());
+        if (i % 100 == 0) usleep(1000);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    CosMetrics metrics = cos->getMetrics();
+    delete cos;
+
+    std::vector<double> sorted = latencyUs;
+    std::sort(sorted.begin(), sorted.end());
+    auto pct = [&](double q) { return sorted.empty() ? 0.0 : sorted[(size_t)(q * (sorted.size() - 1))]; };
+    double maxUs = sorted.empty() ? 0.0 : sorted.back();
+    dprintf(report, "%s: %zu writes in %.2f s, write latency p50 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.0f us, "
+                    "%llu console lines skipped\n",
+            block ? "Block" : "SkipLines", latencyUs.size(), seconds, pct(0.5), pct(0.99), pct(0.999), maxUs,
+            metrics.consoleSkippedLines);
+
+    FILE* log = fopen(logPath.c_str(), "r");
+    int seen = 0, gaps = 0, last = -1;
+    char buf[256];
+    while (log && fgets(buf, sizeof(buf), log)) {
+        int k;
+        if (sscanf(buf, "line %d", &k) != 1) continue;
+        if (k != last + 1) gaps++;
+        last = k;
+        seen++;
+    }
+    if (log) fclose(log);
+    dprintf(report, "log: %d of %d lines, %d gaps (%s)\n", seen, lines, gaps, logPath.c_str());
+
+    // A console queue still busy at exit is left to finish on its own; don't wait for the terminal.
+    signal(SIGPIPE, SIG_IGN);
+    kill(reader, SIGTERM);
+    waitpid(reader, nullptr, 0);
+
+    // Block is the comparison run: it is expected to stall, and to exit with the log behind.
+    if (block) return 0;
+    bool complete = seen == lines && !gaps;
+    bool flat = pct(0.999) <= 1000.0 && maxUs <= 50000.0;
+    if (!flat) dprintf(report, "FAIL: write latency is not flat\n");
+    if (!complete) dprintf(report, "FAIL: the log lost lines\n");
+    return complete && flat ? 0 : 1;
+}
@@ -9,6 +9,8 @@
 #include <functional>
 #include <atomic>
 #include <vector>
+#include <algorithm>
+#include <mutex>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -34,6 +36,11 @@
 #include <errno.h>
 #include <pthread.h>
 #include <sys/wait.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
 #endif
 
 #ifndef STDOUT_FILENO
@@ -43,6 +50,25 @@
 #define STDERR_FILENO 2
 #endif
 
+#include "cos_uring.h"
+#include "cos_collector.h"
+#include "cos_sink.h"
+#include "cos_stream.h"
+#include "cos_index.h"
+#include "cos_redact.h"
+#include "cos_dedup.h"
+#include "cos_live.h"
+#include "cos_memlog.h"
+#include "cos_durable.h"
+#include "cos_log.h"
+#include "cos_watchdog.h"
+#include "cos_sampler.h"
+#include "cos_memory.h"
+#include "cos_heap.h"
+#include "cos_flight.h"
+#include "cos_trace.h"
+#include "cos_except.h"
+
 inline const char* irs() {
     return "\n\n▒▒▒█   ▒▒▒█   ▒▒▒█   █▒▒█   █▒▒▒   █▒▒▒   █▒▒▒   █▒▒▒\n\n";
 }
@@ -53,9 +79,19 @@ struct CrashInfo {
     std::string stackTrace;
     std::string timestamp;
     std::string logPath;
+    int logMemfd = -1;                  // memfdLog: the log's pages, to map instead of reading logPath
     std::string executableName;
     std::string startTime;
     long long sessionDurationMs;
+    std::string hangReport;
+    std::string performanceReport;
+    std::string cpuProfile;
+    std::vector<CosMemorySample> memoryTimeline;
+    std::string heapProfile;
+    std::vector<CosFlightRecord> flightEvents;
+    std::string exceptionType;
+    std::string exceptionWhat;
+    std::string throwSite;
 
     std::string getFormattedDuration() const {
         long long hours = sessionDurationMs / (1000 * 60 * 60);
@@ -70,6 +106,212 @@ struct CrashInfo {
     }
 };
 
+struct CosOptions {
+    enum class Drain { Blocking, IoUring };
+
+    Drain drain = Drain::Blocking;
+    unsigned uringDepth = 8;
+    size_t uringChunk = 64 * 1024;
+
+    // Blocking drain: batches grow between these bounds while the pipe stays hot,
+    // and a batch is never held back longer than latencyTargetUs.
+    size_t batchMin = 16 * 1024;
+    size_t batchMax = 4 * 1024 * 1024;
+    unsigned latencyTargetUs = 2000;
+
+    // A terminal that cannot keep up (a slow SSH session) gets consoleQueueBytes
+    // of slack, then whole lines are dropped and "… N lines skipped" is printed
+    // once it catches up; the log stays complete. Block writes the console inline,
+    // so a slow terminal holds up the log and the application with it.
+    enum class Console { SkipLines, Block };
+    Console console = Console::SkipLines;
+    size_t consoleQueueBytes = 256 * 1024;
+
+    // std::cout, std::cerr and std::clog buffered per thread and handed to the
+    // drain a whole line at a time through a streamRingBytes ring: no shared
+    // stream lock and no lines split by other threads.
+    bool streamBuffers = false;
+    size_t streamRingBytes = 1024 * 1024;
+
+    // Sidecar "<log>.idx" mapping time and line numbers to log offsets, with an
+    // entry at the first batch past indexEveryBytes or indexEveryMs; both 0 turns it off.
+    size_t indexEveryBytes = 256 * 1024;
+    unsigned indexEveryMs = 1000;
+
+    // Mask passwords, API keys and bearer tokens with '*' before the console, the
+    // log or any sink sees them. redactKeys are extra "key=value" names to mask.
+    bool redactSecrets = false;
+    std::vector<std::string> redactKeys;
+
+    // Captured stdout/stderr (not COS_LOG) can have runs of one line collapsed
+    // into "last message repeated N times", summarised at least every
+    // repeatSummaryMs, and lines dropped past a rateLimits token bucket. An
+    // empty match limits each distinct line, tracked in up to rateLimitLines slots.
+    bool collapseRepeats = false;
+    bool repeatIgnoreNumbers = false;
+    unsigned repeatSummaryMs = 30000;
+    std::vector<CosRateLimit> rateLimits;
+    size_t rateLimitLines = 4096;
+
+    // Periodic metrics dump; a path, or "unix:/path" for a listening stream socket.
+    std::string metricsPath;
+    unsigned metricsIntervalMs = 0;
+
+    // Hand the log to a running cos-collector instead of a file of our own.
+    // The local log path is only written if the collector goes away or we crash.
+    std::string collectorSocket;
+    size_t collectorRingBytes = 4 * 1024 * 1024;
+    unsigned collectorWaitMs = 100;
+
+    // fsync policy for the log file, so a host crash or power cut keeps its tail.
+    // OnCrash syncs once from the crash handler, after the drain has written the
+    // report. Periodic syncs every syncIntervalMs; GroupCommit once syncBytes are
+    // unsynced or syncIntervalMs after the first unsynced write. Both also sync
+    // on a crash and at exit. fdatasync() runs on its own thread, never the drain.
+    enum class Durability { None, OnCrash, Periodic, GroupCommit };
+    Durability durability = Durability::None;
+    unsigned syncIntervalMs = 1000;
+    size_t syncBytes = 1024 * 1024;
+
+    // Keep the session log in a memfd rather than a file: no disk I/O on the
+    // drain path on hosts where /tmp is not tmpfs, and COSEC maps the very pages
+    // the log was written to. logPath gets a copy every memfdSpillMs (0: at exit
+    // only) and keeps being updated while a crash report is up. memfdSeal stops
+    // the memfd shrinking under another mapper and makes it read-only at exit.
+    bool memfdLog = false;
+    unsigned memfdSpillMs = 0;
+    bool memfdSeal = true;
+
+    // Live output for local subscribers on a Unix socket (cos-tail): the last
+    // liveRingBytes are kept in memory to catch up from, and a subscriber that
+    // falls that far behind is disconnected rather than slowing the drain.
+    std::string liveSocket;
+    size_t liveRingBytes = 4 * 1024 * 1024;
+    size_t liveMaxSubscribers = 64;
+
+    // Queue per sink added with addSink(); a batch that does not fit is dropped
+    // for that sink alone.
+    size_t sinkQueueBytes = 1024 * 1024;
+
+    // How long COS_LOG records may wait for the drain thread while stdout is idle.
+    // Until the first COS_LOG call the idle drain only wakes every 100 ms.
+    unsigned binaryFlushMs = 10;
+
+    // GUI thread watchdog, armed by armWatchdog(); 0 disables it.
+    unsigned hangThresholdMs = 2000;
+
+    // Qt event dispatch timing installed by REG_CRASH(); the slowest handlers are
+    // written to the log every eventSummaryMs (0: only in the crash report).
+    bool eventProfiling = true;
+    unsigned eventSummaryMs = 60000;
+
+    // COSEC routes qDebug()/qWarning()/... into the COS_LOG rings instead of
+    // stderr; messages below qtMessageLevel are dropped before Qt formats them.
+    bool qtMessageHandler = true;
+    CosLevel qtMessageLevel = CosLevel::Debug;
+
+    // SIGPROF sampler, off unless samplerHz is set. The last samplerWindowSec
+    // seconds are kept per thread and saved as collapsed stacks to samplerOutput
+    // (default: the log path with ".folded") at exit and on a crash.
+    unsigned samplerHz = 0;
+    unsigned samplerWindowSec = 30;
+    int samplerThreads = 16;
+    std::string samplerOutput;
+
+    // Memory timeline (RSS, PSS, heap, cgroup usage, PSI) sampled every
+    // memorySampleMs into memoryHistory slots; 0 (the default) disables it. The
+    // pressure callback fires when PSI "some avg10" reaches memoryPressurePercent.
+    // The exit summary gets one line; the series is in the crash report.
+    unsigned memorySampleMs = 0;
+    size_t memoryHistory = 600;
+    double memoryPressurePercent = 10.0;
+
+    // Sampling heap profiler: one allocation stack per heapSampleBytes allocated
+    // on average; 0 is off. Needs libcrash built with TRIG_HEAP_PROFILER. The
+    // live heap by site goes to heapOutput (default: the log path with ".heap").
+    size_t heapSampleBytes = 0;
+    std::string heapOutput;
+
+    // Newest COS_FLIGHT events, merged across threads, in the crash report.
+    size_t flightDumpEvents = 256;
+
+    // std::terminate handler recording the uncaught exception's type, what() and,
+    // with TRIG_THROW_CAPTURE, its throw site.
+    bool terminateHandler = true;
+
+    // Chrome trace JSON of COS_SPAN spans and startup phases, written at exit and
+    // on a crash when spans exist or this is set (default: log path + ".trace.json").
+    std::string traceOutput;
+};
+
+// log2 buckets in microseconds; bucket b counts values in [2^b, 2^(b+1)).
+struct CosHistogram {
+    static const int BUCKETS = 24;
+    std::atomic<unsigned long long> counts[BUCKETS];
+
+    CosHistogram() {
+        for (auto& c : counts) c.store(0, std::memory_order_relaxed);
+    }
+
+    inline void record(unsigned long long us) {
+        int b = us ? 63 - __builtin_clzll(us) : 0;
+        if (b >= BUCKETS) b = BUCKETS - 1;
+        counts[b].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    inline void snapshot(unsigned long long* out) const {
+        for (int i = 0; i < BUCKETS; i++) out[i] = counts[i].load(std::memory_order_relaxed);
+    }
+};
+
+struct DrainStats {
+    size_t batchSize;
+    unsigned long long flushes;
+    unsigned long long flushLatencyUs[CosHistogram::BUCKETS];
+};
+
+struct StreamMetrics {
+    unsigned long long bytes;
+    unsigned long long lines;
+    unsigned long long syscalls;
+    unsigned long long shortWrites;
+    unsigned long long errors;
+};
+
+// stdout and stderr share one pipe, so streams are counted where they can be
+// told apart: what was captured, and what reached each destination.
+struct CosStreamCounters {
+    std::atomic<unsigned long long> bytes{0};
+    std::atomic<unsigned long long> lines{0};
+    std::atomic<unsigned long long> syscalls{0};
+    std::atomic<unsigned long long> shortWrites{0};
+    std::atomic<unsigned long long> errors{0};
+
+    inline void add(std::atomic<unsigned long long>& counter, unsigned long long n = 1) {
+        counter.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    inline StreamMetrics snapshot() const {
+        return StreamMetrics{bytes.load(std::memory_order_relaxed),
+                             lines.load(std::memory_order_relaxed),
+                             syscalls.load(std::memory_order_relaxed),
+                             shortWrites.load(std::memory_order_relaxed),
+                             errors.load(std::memory_order_relaxed)};
+    }
+};
+
+struct CosMetrics {
+    StreamMetrics captured;
+    StreamMetrics console;
+    StreamMetrics log;
+    unsigned long long consoleSkippedLines;
+    unsigned long long redacted;
+    CosDedupStats suppressed;           // pipe and std::cout/cerr/clog together
+    size_t backlogBytes;
+    unsigned long long maxDrainLagUs;
+    DrainStats drain;
+};
+
 class COS {
 public:
     using CrashCallback = std::function<void(const CrashInfo&)>;
@@ -81,16 +323,357 @@ private:
     std::string startTime;
     std::string stackTrace;
     CrashCallback crashCallback;
-    time_t startTimeT;
+    CrashCallback hangCallback;
+    unsigned long long startMonoUs;
+    CosOptions options;
 
     inline static std::atomic<COS*> globalInstance{nullptr};
 
     int savedStdout;
     int logFd;
+#ifndef _WIN32
+    CosIndexWriter logIndex;
+    CosLogSync logSync;
+#endif
     int pipeFds[2];
     std::atomic<bool> teeRunning;
+    pthread_t teeThread;
+    bool teeStarted;
+
+    std::atomic<size_t> batchSize;
+    std::atomic<unsigned long long> flushes;
+    CosHistogram flushLatency;
+
+    CosStreamCounters capturedStats;
+    CosStreamCounters consoleStats;
+    CosStreamCounters logStats;
+    std::atomic<unsigned long long> maxDrainLagUs;
+
+    // Built before the drain starts; the pipe and in-process text each carry
+    // their own match state across chunks.
+    CosRedactor redactor;
+    CosRedactor::State pipeRedaction;
+    CosRedactor::State textRedaction;
+    std::atomic<unsigned long long> redacted;
+
+    // Repeat collapsing and rate limits, one per source so a partial pipe line
+    // never swallows a CosStreams line.
+    CosLineFilter pipeFilter;
+    CosLineFilter streamFilter;
+
+#ifndef _WIN32
+    CosSinks sinks;
+
+    // The terminal behind the console queue, counted as the console stream.
+    class ConsoleSink : public CosSink {
+    private:
+        int fd;
+        CosStreamCounters& stats;
+
+    public:
+        ConsoleSink(int target, CosStreamCounters& counters) : fd(target), stats(counters) {}
+        ~ConsoleSink() override {
+            if (fd != -1) close(fd);
+        }
+
+        bool write(const iovec* iov, int count) override {
+            for (int i = 0; i < count; i++) {
+                iovec one = iov[i];
+                if (!writevAll(fd, &one, 1, stats)) return false;
+            }
+            return true;
+        }
+
+        const char* name() const override { return "console"; }
+    };
+
+    CosSinkQueue* consoleQueue;
+#endif
+
+    pthread_t metricsThread;
+    std::atomic<bool> metricsRunning;
+
+#ifdef __linux__
+    CosRingWriter collector;
+    CosLiveServer live;
+    CosMemfdLog memLog;
+#endif
+    std::mutex collectorLock;
+    std::atomic<bool> viaCollector;
+
+#ifdef __linux__
+    CosWatchdog watchdog;
+    CosSampler sampler;
+    CosMemorySampler memory;
+#endif
+    mutable std::mutex hangLock;
+    std::string hangReport;
+
+    static constexpr size_t BUFFER_SIZE = 64 * 1024;
+    // A line the filter holds without its newline goes out as it is once the
+    // pipe has been empty this long; stdio flushes split lines all the time.
+    static constexpr unsigned PARTIAL_HOLD_MS = 2;
+
+    std::string logHeader() const {
+        return "- DATA -----------------------------------------------------------\n"
+               "App: " + executableName + "\n"
+               "Start: " + startTime + "\n"
+               "------------------------------------------------- CAPTURED LOGS -\n";
+    }
+
+#ifdef __linux__
+    // Caller holds collectorLock. After a crash the most recent ring contents go
+    // to the local file so COSEC can show them; otherwise only what the collector
+    // never persisted is carried over.
+    void leaveCollector(bool keepRecent) {
+        std::string header = logHeader();
+        iovec iov[3] = { { &header[0], header.size() } };
+        int count = keepRecent ? collector.recent(iov + 1) : collector.unconsumed(iov + 1);
+        openLocalLog(iov, count + 1);
+        collector.detach();
+        viaCollector.store(false, std::memory_order_release);
+    }
+#endif
+
+    // The log file of our own (a memfd with memfdLog), starting with head: the
+    // header, and what the collector held if we are falling back from it. Its
+    // index and fsync policy start here too, whichever way the log was reached.
+    void openLocalLog(iovec* head, int count) {
+#ifdef __linux__
+        if (options.memfdLog)
+            logFd = memLog.open("cos-" + executableName, logPath, options.memfdSpillMs, options.memfdSeal);
+#endif
+        if (logFd == -1) logFd = open(logPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (logFd == -1) return;
+#ifndef _WIN32
+        if (options.durability != CosOptions::Durability::None) startSync();
+#endif
+
+        size_t len = 0;
+        unsigned long long lines = 0;
+        for (int i = 0; i < count; i++) {
+            len += head[i].iov_len;
+            lines += countLines(static_cast<const char*>(head[i].iov_base), head[i].iov_len);
+        }
+        if (!writevAll(logFd, head, count, logStats)) return;
+#ifndef _WIN32
+        logSync.wrote();
+        logIndex.open(CosLogIndex::pathFor(logPath), options.indexEveryBytes, options.indexEveryMs, len, lines);
+#else
+        (void)lines;
+#endif
+    }
+
+    // Hands the batch to the console queue, unless the console is written inline.
+    inline bool queueConsole(const iovec* iov, int count) {
+#ifndef _WIN32
+        if (consoleQueue) {
+            consoleQueue->push(iov, count);
+            return true;
+        }
+#else
+        (void)iov;
+        (void)count;
+#endif
+        return false;
+    }
+
+    void writeLog(iovec* iov, int count, unsigned long long lines) {
+#ifdef __linux__
+        if (viaCollector.load(std::memory_order_acquire)) {
+            std::lock_guard<std::mutex> guard(collectorLock);
+            if (viaCollector.load(std::memory_order_relaxed)) {
+                size_t len = 0;
+                for (int i = 0; i < count; i++) len += iov[i].iov_len;
+                if (collector.write(iov, count, options.collectorWaitMs)) {
+                    logStats.add(logStats.bytes, len);
+                    return;
+                }
+                logStats.add(logStats.errors);
+                leaveCollector(false);
+            }
+        }
+#endif
+        if (logFd == -1) return;
+#ifndef _WIN32
+        size_t len = 0;
+        for (int i = 0; i < count; i++) len += iov[i].iov_len;
+        if (writevAll(logFd, iov, count, logStats)) {
+            logIndex.advance(len, lines);
+            logSync.wrote();
+        } else {
+            logIndex.close();
+        }
+#else
+        (void)lines;
+        writevAll(logFd, iov, count, logStats);
+#endif
+    }
+
+    inline void redact(CosRedactor::State& state, char* data, size_t len) {
+        if (!redactor.active()) return;
+        size_t found = redactor.apply(state, data, len);
+        if (found) redacted.fetch_add(found, std::memory_order_relaxed);
+    }
+
+    // Text made inside the process rather than read from the pipe.
+    void deliver(std::string& text, unsigned long long lines) {
+        redact(textRedaction, &text[0], text.size());
+        iovec iov = { &text[0], text.size() };
+        fanOut(&iov, 1);
+        if (!queueConsole(&iov, 1)) {
+            iovec console = iov;
+            writevAll(savedStdout, &console, 1, consoleStats);
+        }
+        writeLog(&iov, 1, lines);
+    }
+
+    // Nothing left to read: a line held back without its newline (a prompt)
+    // is not going to be finished soon.
+    inline bool pipeDrained() const {
+        int pending = 0;
+        return ioctl(pipeFds[0], FIONREAD, &pending) == 0 && pending == 0;
+    }
 
-    static const size_t BUFFER_SIZE = 1024;
+    // Replaces text with what the filter lets through; false if it is off.
+    bool filterLines(CosLineFilter& filter, std::string& text) {
+        if (!filter.active()) return false;
+        std::string kept;
+        kept.reserve(text.size());
+        filter.process(text.data(), text.size(), monotonicUs() * 1000, kept);
+        text.swap(kept);
+        return true;
+    }
+
+    // For an idle drain: a held partial line (a prompt) and repeat summaries
+    // that are due; at the end, everything still held.
+    void flushFilters(bool finish, std::string& text) {
+        for (CosLineFilter* filter : { &pipeFilter, &streamFilter }) {
+            if (!filter->active()) continue;
+            if (finish) {
+                filter->finish(text);
+                continue;
+            }
+            if (filter->holding() && pipeDrained()) filter->flushPartial(text);
+            filter->tick(monotonicUs() * 1000, text);
+        }
+    }
+
+    void flushFilters(bool finish) {
+        std::string text;
+        flushFilters(finish, text);
+        if (!text.empty()) deliver(text, countLines(text.data(), text.size()));
+    }
+
+    // Formats whatever COS_LOG calls queued since the last pass.
+    void flushBinaryLog() {
+        if (!CosLog::active()) return;
+        std::string text;
+        while (CosLog::drainTo(text, options.batchMax)) {
+            deliver(text, countLines(text.data(), text.size()));
+            text.clear();
+        }
+    }
+
+    // Whole lines std::cout/cerr/clog handed over through CosStreams.
+    void flushStreams() {
+#ifdef __linux__
+        if (!CosStreams::pending()) return;
+        std::string text;
+        while (CosStreams::drainTo(text, options.batchMax)) {
+            unsigned long long lines = countCaptured(text.data(), text.size());
+            if (filterLines(streamFilter, text)) lines = countLines(text.data(), text.size());
+            if (!text.empty()) deliver(text, lines);
+            text.clear();
+        }
+#endif
+    }
+
+    // Copies the batch into each added sink's queue; never waits on a sink.
+    inline void fanOut(const iovec* iov, int count) {
+#ifndef _WIN32
+        if (!sinks.empty()) sinks.publish(iov, count);
+#endif
+#ifdef __linux__
+        if (live.active()) live.publish(iov, count);
+#endif
+#ifdef _WIN32
+        (void)iov;
+        (void)count;
+#endif
+    }
+
+    static inline unsigned long long countLines(const char* data, size_t len) {
+        unsigned long long lines = 0;
+        const char* end = data + len;
+        while ((data = static_cast<const char*>(memchr(data, '\n', end - data)))) {
+            lines++;
+            data++;
+        }
+        return lines;
+    }
+
+    inline unsigned long long countCaptured(const char* data, size_t len) {
+        unsigned long long lines = countLines(data, len);
+        capturedStats.add(capturedStats.bytes, len);
+        capturedStats.add(capturedStats.lines, lines);
+        return lines;
+    }
+
+    inline void recordFlush(unsigned long long startUs) {
+        unsigned long long lag = monotonicUs() - startUs;
+        flushLatency.record(lag);
+        flushes.fetch_add(1, std::memory_order_relaxed);
+
+        unsigned long long seen = maxDrainLagUs.load(std::memory_order_relaxed);
+        while (lag > seen && !maxDrainLagUs.compare_exchange_weak(seen, lag, std::memory_order_relaxed)) {}
+    }
+
+    static inline unsigned long long monotonicUs() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (unsigned long long)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+    }
+
+    // ppoll() where there is one (not macOS); poll() rounds up to whole milliseconds.
+    static inline int pollUs(struct pollfd* fds, nfds_t count, unsigned long long us) {
+#ifdef __linux__
+        struct timespec ts = { (time_t)(us / 1000000), (long)(us % 1000000) * 1000 };
+        return ppoll(fds, count, &ts, nullptr);
+#else
+        return poll(fds, count, (int)((us + 999) / 1000));
+#endif
+    }
+
+    // Consumes iov while writing; false once the fd reports a hard error.
+    static bool writevAll(int fd, iovec* iov, int count, CosStreamCounters& stats) {
+        while (count > 0) {
+            int batch = count > IOV_MAX ? IOV_MAX : count;
+            size_t want = 0;
+            for (int i = 0; i < batch; i++) want += iov[i].iov_len;
+
+            ssize_t result = writev(fd, iov, batch);
+            stats.add(stats.syscalls);
+            if (result < 0) {
+                if (errno == EINTR) continue;
+                stats.add(stats.errors);
+                return false;
+            }
+            size_t done = (size_t)result;
+            stats.add(stats.bytes, done);
+            if (done < want) stats.add(stats.shortWrites);
+            while (count > 0 && done >= iov->iov_len) {
+                done -= iov->iov_len;
+                iov++;
+                count--;
+            }
+            if (count > 0) {
+                iov->iov_base = static_cast<char*>(iov->iov_base) + done;
+                iov->iov_len -= done;
+            }
+        }
+        return true;
+    }
 
     inline std::string getTimestampForFilename() const {
         time_t now = time(nullptr);
@@ -162,7 +745,12 @@ private:
         const int MAX_FRAMES = 32;
 
         void* buffer[MAX_FRAMES];
+#ifdef __linux__
+        // No dl lock and no malloc while walking, and it steps through the signal frame.
+        int numFrames = CosUnwind::stack(buffer, MAX_FRAMES);
+#else
         int numFrames = backtrace(buffer, MAX_FRAMES);
+#endif
 
         std::string result;
         result.reserve(numFrames * 128);
@@ -218,48 +806,563 @@ private:
         }
     }
 
-    static void* teeThreadFunc(void* arg) {
-        COS* instance = static_cast<COS*>(arg);
+#ifdef __linux__
+    // One pipe read stays in flight while earlier chunks are still being written.
+    // Console writes go out in chunk order; log writes carry their own file offset
+    // so they may overlap. The two are not IOSQE_IO_LINKed: a failed console write
+    // would cancel the linked log write, and the log has to stay lossless.
+    inline unsigned idleTickMs() const {
+        if (pipeFilter.holding()) return PARTIAL_HOLD_MS;
+        return CosLog::active() || CosStreams::installed() ? options.binaryFlushMs : 100;
+    }
+
+    bool uringDrain() {
+        enum : unsigned { OP_READ, OP_CONSOLE, OP_LOG, OP_TIMEOUT };
+        struct Chunk {
+            unsigned len;
+            unsigned conDone;
+            unsigned logDone;
+            off_t logOff;
+            unsigned long long readAtUs;
+            bool busy;
+            bool conPending;
+            bool logPending;
+        };
+
+        if (viaCollector.load(std::memory_order_acquire)) return false;
+
+        unsigned depth = options.uringDepth < 2 ? 2 : options.uringDepth;
+        size_t chunkSize = options.uringChunk < BUFFER_SIZE ? BUFFER_SIZE : options.uringChunk;
+
+        off_t logOff = 0;
+        if (logFd != -1) {
+            logOff = lseek(logFd, 0, SEEK_CUR);
+            if (logOff < 0) return false;
+        }
 
-        char buffer[BUFFER_SIZE];
+        // Wakes the ring while stdout is idle so COS_LOG records still get out.
+        __kernel_timespec binaryTick = { 0, 0 };
+
+        CosUring ring;
+        if (!ring.init(depth + 3)) return false;
+        // An inline console may be a file (app > out.txt): its writes must go at
+        // stdout's position, which older kernels cannot do; the blocking drain can.
+        if (!consoleQueue && !ring.followsFilePosition() && lseek(savedStdout, 0, SEEK_CUR) >= 0) return false;
+
+        std::vector<char> arena(depth * chunkSize);
+        std::vector<iovec> iov(depth);
+        std::vector<Chunk> chunks(depth, Chunk{0, 0, 0, 0, 0, false, false, false});
+        for (unsigned i = 0; i < depth; i++) {
+            iov[i].iov_base = arena.data() + i * chunkSize;
+            iov[i].iov_len = chunkSize;
+        }
+        if (!ring.registerBuffers(iov.data(), depth)) return false;
+
+        std::vector<unsigned> consoleFifo(depth);
+        unsigned fifoHead = 0, fifoLen = 0;
+        bool reading = false, eof = false, consoleBusy = false, timerPending = false;
+        std::string binaryText;
+        // Filtered text can outgrow its chunk. The rest waits here, and reads
+        // are held back until it is out, so output keeps its order.
+        std::string filtered, spill;
+        unsigned logsInFlight = 0;
+
+        auto base = [&](unsigned idx) { return static_cast<char*>(iov[idx].iov_base); };
+        auto tag = [](unsigned op, unsigned idx) { return ((unsigned long long)idx << 2) | op; };
+        auto sqe = [&]() {
+            io_uring_sqe* e;
+            while (!(e = ring.getSqe())) ring.submitAndWait(0);
+            return e;
+        };
+        auto release = [&](Chunk& c) {
+            if (c.conPending || c.logPending) return;
+            c.busy = false;
+            recordFlush(c.readAtUs);
+        };
+        auto submitLog = [&](unsigned idx) {
+            Chunk& c = chunks[idx];
+            ring.prepFixed(sqe(), IORING_OP_WRITE_FIXED, logFd, base(idx) + c.logDone,
+                           c.len - c.logDone, c.logOff + c.logDone, idx, tag(OP_LOG, idx));
+            logsInFlight++;
+        };
+        auto queueChunk = [&](unsigned idx, unsigned len, unsigned long long lines) {
+            Chunk& c = chunks[idx];
+            c.len = len;
+            c.conDone = c.logDone = 0;
+            c.readAtUs = monotonicUs();
+            iovec out = { base(idx), len };
+            fanOut(&out, 1);
+            c.conPending = !queueConsole(&out, 1);
+            if (c.conPending) consoleFifo[(fifoHead + fifoLen++) % depth] = idx;
+            if (logFd != -1) {
+                c.logOff = logOff;
+                logOff += len;
+                c.logPending = true;
+                submitLog(idx);
+                logIndex.advance(len, lines);
+            }
+            release(c);
+        };
+        // Moves text into chunk idx, which the caller has marked busy, or
+        // behind what is already waiting.
+        auto queueText = [&](unsigned idx, const std::string& text) {
+            size_t len = !spill.empty() ? 0 : text.size() < chunkSize ? text.size() : chunkSize;
+            memcpy(base(idx), text.data(), len);
+            spill.append(text, len, std::string::npos);
+            if (len) queueChunk(idx, (unsigned)len, countLines(base(idx), len));
+            else chunks[idx].busy = false;
+        };
+        auto submitConsole = [&](unsigned idx) {
+            Chunk& c = chunks[idx];
+            ring.prepFixed(sqe(), IORING_OP_WRITE_FIXED, savedStdout, base(idx) + c.conDone,
+                           c.len - c.conDone, (unsigned long long)-1, idx, tag(OP_CONSOLE, idx));
+            consoleBusy = true;
+        };
+
+        for (;;) {
+            if (!reading && !eof && spill.empty() && teeRunning.load(std::memory_order_acquire)) {
+                for (unsigned i = 0; i < depth; i++) {
+                    if (chunks[i].busy) continue;
+                    chunks[i].busy = true;
+                    ring.prepFixed(sqe(), IORING_OP_READ_FIXED, pipeFds[0], base(i),
+                                   (unsigned)chunkSize, 0, i, tag(OP_READ, i));
+                    reading = true;
+                    break;
+                }
+            }
 
-        while (instance->teeRunning.load(std::memory_order_acquire)) {
-            ssize_t bytes_read = read(instance->pipeFds[0], buffer, sizeof(buffer));
+            if (!reading && !consoleBusy && !logsInFlight && !fifoLen && spill.empty()) break;
+            if (!timerPending) {
+                binaryTick.tv_sec = idleTickMs() / 1000;
+                binaryTick.tv_nsec = (long long)(idleTickMs() % 1000) * 1000000;
+                ring.prepFixed(sqe(), IORING_OP_TIMEOUT, -1, &binaryTick, 1, 0, 0, tag(OP_TIMEOUT, 0));
+                timerPending = true;
+            }
+            if (ring.submitAndWait(1) < 0) break;
+
+            io_uring_cqe cqe;
+            while (ring.popCqe(cqe)) {
+                unsigned op = (unsigned)(cqe.user_data & 3);
+                unsigned idx = (unsigned)(cqe.user_data >> 2);
+                Chunk& c = chunks[idx];
+                int res = cqe.res;
+                if (op == OP_TIMEOUT) {
+                    timerPending = false;
+                    logIndex.advance(0, 0);
+                    flushFilters(false, spill);
+                    continue;
+                }
+                bool retry = (res == -EINTR || res == -EAGAIN);
+                CosStreamCounters& stats = op == OP_READ ? capturedStats
+                                         : op == OP_CONSOLE ? consoleStats : logStats;
+                stats.add(stats.syscalls);
+                if (res < 0 && !retry) stats.add(stats.errors);
+
+                switch (op) {
+                case OP_READ:
+                    reading = false;
+                    if (res > 0) {
+                        unsigned long long lines = countCaptured(base(idx), (unsigned)res);
+                        redact(pipeRedaction, base(idx), (unsigned)res);
+                        batchSize.store((unsigned)res, std::memory_order_relaxed);
+                        if (pipeFilter.active()) {
+                            filtered.clear();
+                            pipeFilter.process(base(idx), (unsigned)res, monotonicUs() * 1000, filtered);
+                            queueText(idx, filtered);
+                        } else {
+                            queueChunk(idx, (unsigned)res, lines);
+                        }
+                    } else {
+                        if (!retry) eof = true;
+                        c.busy = false;
+                    }
+                    break;
 
-            if (bytes_read < 0 && errno == EINTR)
-                continue;
-            if (bytes_read <= 0)
-                break;
+                case OP_CONSOLE:
+                    consoleBusy = false;
+                    if (res > 0) {
+                        stats.add(stats.bytes, (unsigned)res);
+                        if ((unsigned)res < c.len - c.conDone) stats.add(stats.shortWrites);
+                        c.conDone += (unsigned)res;
+                    }
+                    if ((res <= 0 && !retry) || c.conDone >= c.len) {
+                        fifoHead = (fifoHead + 1) % depth;
+                        fifoLen--;
+                        c.conPending = false;
+                        release(c);
+                    }
+                    break;
+
+                case OP_LOG:
+                    logsInFlight--;
+                    if (res > 0) {
+                        stats.add(stats.bytes, (unsigned)res);
+                        if ((unsigned)res < c.len - c.logDone) stats.add(stats.shortWrites);
+                        c.logDone += (unsigned)res;
+                        logSync.wrote();
+                    }
+                    if ((res <= 0 && !retry) || c.logDone >= c.len) {
+                        c.logPending = false;
+                        release(c);
+                    } else {
+                        submitLog(idx);
+                    }
+                    break;
+                }
+            }
 
-            ssize_t written = 0;
-            while (written < bytes_read) {
-                ssize_t result = write(instance->savedStdout, buffer + written, bytes_read - written);
-                if (result < 0) {
-                    if (errno == EINTR) continue;
+            if (CosLog::active()) {
+                for (unsigned i = 0; i < depth; i++) {
+                    if (chunks[i].busy) continue;
+                    binaryText.clear();
+                    if (!CosLog::drainTo(binaryText, chunkSize)) break;
+                    redact(textRedaction, &binaryText[0], binaryText.size());
+                    memcpy(base(i), binaryText.data(), binaryText.size());
+                    chunks[i].busy = true;
+                    queueChunk(i, (unsigned)binaryText.size(), countLines(binaryText.data(), binaryText.size()));
                     break;
                 }
-                written += result;
             }
 
-            if (instance->logFd != -1) {
-                ssize_t log_written = 0;
-                while (log_written < bytes_read) {
-                    ssize_t result = write(instance->logFd, buffer + log_written, bytes_read - log_written);
-                    if (result < 0) {
-                        if (errno == EINTR) continue;
+            if (CosStreams::pending()) {
+                for (unsigned i = 0; i < depth; i++) {
+                    if (chunks[i].busy) continue;
+                    binaryText.clear();
+                    if (!CosStreams::drainTo(binaryText, chunkSize)) break;
+                    unsigned long long lines = countCaptured(binaryText.data(), binaryText.size());
+                    redact(textRedaction, &binaryText[0], binaryText.size());
+                    chunks[i].busy = true;
+                    if (filterLines(streamFilter, binaryText)) {
+                        queueText(i, binaryText);
                         break;
                     }
-                    log_written += result;
+                    memcpy(base(i), binaryText.data(), binaryText.size());
+                    queueChunk(i, (unsigned)binaryText.size(), lines);
+                    break;
+                }
+            }
+
+            if (!spill.empty()) {
+                for (unsigned i = 0; i < depth; i++) {
+                    if (chunks[i].busy) continue;
+                    std::string text;
+                    text.swap(spill);
+                    chunks[i].busy = true;
+                    queueText(i, text);
+                    break;
                 }
             }
+
+            if (!consoleBusy && fifoLen) submitConsole(consoleFifo[fifoHead]);
         }
+
+        // Log writes carry offsets here, so the leftovers cannot go through writeLog().
+        auto writeLeftover = [&](std::string& text, unsigned long long lines) {
+            if (text.empty()) return;
+            redact(textRedaction, &text[0], text.size());
+            iovec iov = { &text[0], text.size() };
+            fanOut(&iov, 1);
+            if (!queueConsole(&iov, 1)) writevAll(savedStdout, &iov, 1, consoleStats);
+            if (logFd != -1 && pwrite(logFd, text.data(), text.size(), logOff) > 0) {
+                logOff += text.size();
+                logIndex.advance(text.size(), lines);
+            }
+        };
+        CosStreams::detachDrain();
+        for (int streams = 0; streams < 2; streams++) {
+            binaryText.clear();
+            while (streams ? CosStreams::drainTo(binaryText, chunkSize) : CosLog::drainTo(binaryText, chunkSize)) {
+                unsigned long long lines = streams ? countCaptured(binaryText.data(), binaryText.size())
+                                                   : countLines(binaryText.data(), binaryText.size());
+                if (streams && filterLines(streamFilter, binaryText))
+                    lines = countLines(binaryText.data(), binaryText.size());
+                writeLeftover(binaryText, lines);
+                binaryText.clear();
+            }
+        }
+        flushFilters(true, binaryText);
+        writeLeftover(binaryText, countLines(binaryText.data(), binaryText.size()));
+        return true;
+    }
+#endif
+
+    // Blocks for the first bytes of a batch, then keeps gathering while the pipe
+    // has data, up to the current target or until latencyTargetUs has passed.
+    // A cold drain (target at batchMin) flushes short reads immediately so
+    // interactive output is not delayed at all.
+    void blockingDrain() {
+        size_t minBatch = options.batchMin < BUFFER_SIZE / 16 ? BUFFER_SIZE / 16 : options.batchMin;
+        size_t maxBatch = options.batchMax < minBatch ? minBatch : options.batchMax;
+        size_t maxBlocks = (maxBatch + BUFFER_SIZE - 1) / BUFFER_SIZE;
+        size_t target = minBatch;
+
+        std::vector<std::vector<char>> blocks;
+        std::vector<iovec> iov(maxBlocks);
+        std::vector<iovec> scratch(maxBlocks);
+        std::string filtered;
+        bool eof = false;
+
+        while (!eof && teeRunning.load(std::memory_order_acquire)) {
+            size_t fill = 0;
+            unsigned long long batchStart = 0;
+            unsigned long long batchLines = 0;
+
+            while (fill < target) {
+                size_t blk = fill / BUFFER_SIZE;
+                if (blk == blocks.size()) blocks.emplace_back(BUFFER_SIZE);
+
+                if (fill) {
+                    long long waitUs = (long long)options.latencyTargetUs
+                                       - (long long)(monotonicUs() - batchStart);
+                    if (waitUs <= 0) break;
+
+                    struct pollfd pfd = { pipeFds[0], POLLIN, 0 };
+                    if (pollUs(&pfd, 1, (unsigned long long)waitUs) <= 0) break;
+                } else {
+                    struct pollfd pfd[2] = { { pipeFds[0], POLLIN, 0 }, { -1, POLLIN, 0 } };
+                    unsigned long long tickUs = idleTickMs() * 1000ULL;
+#ifdef __linux__
+                    pfd[1].fd = CosStreams::wakeFd();
+                    CosStreams::idle(true);
+                    int ready = CosStreams::pending() ? 0 : pollUs(pfd, 2, tickUs);
+                    CosStreams::idle(false);
+#else
+                    int ready = pollUs(pfd, 1, tickUs);
+#endif
+                    if (ready == 0 || (ready > 0 && !pfd[0].revents)) {
+                        flushStreams();
+                        flushBinaryLog();
+                        flushFilters(false);
+#ifndef _WIN32
+                        logIndex.advance(0, 0);
+#endif
+                        continue;
+                    }
+                }
+
+                size_t off = fill % BUFFER_SIZE;
+                size_t want = BUFFER_SIZE - off;
+                if (want > target - fill) want = target - fill;
+
+                ssize_t bytes_read = read(pipeFds[0], blocks[blk].data() + off, want);
+                capturedStats.add(capturedStats.syscalls);
+                if (bytes_read < 0 && errno == EINTR)
+                    continue;
+                if (bytes_read <= 0) {
+                    if (bytes_read < 0) capturedStats.add(capturedStats.errors);
+                    eof = true;
+                    break;
+                }
+
+                if (!fill) batchStart = monotonicUs();
+                batchLines += countCaptured(blocks[blk].data() + off, (size_t)bytes_read);
+                redact(pipeRedaction, blocks[blk].data() + off, (size_t)bytes_read);
+                fill += (size_t)bytes_read;
+                if (target == minBatch && (size_t)bytes_read < want) break;
+            }
+
+            if (!fill) continue;
+
+            int count = 0;
+            for (size_t done = 0; done < fill; done += BUFFER_SIZE, count++) {
+                iov[count].iov_base = blocks[count].data();
+                iov[count].iov_len = (fill - done < BUFFER_SIZE) ? fill - done : BUFFER_SIZE;
+            }
+
+            if (pipeFilter.active()) {
+                unsigned long long nowNs = monotonicUs() * 1000;
+                filtered.clear();
+                for (int i = 0; i < count; i++)
+                    pipeFilter.process(static_cast<char*>(iov[i].iov_base), iov[i].iov_len, nowNs, filtered);
+                iov[0].iov_base = &filtered[0];
+                iov[0].iov_len = filtered.size();
+                count = filtered.empty() ? 0 : 1;
+                batchLines = countLines(filtered.data(), filtered.size());
+            }
+
+            if (count) {
+                fanOut(iov.data(), count);
+
+                if (!queueConsole(iov.data(), count)) {
+                    std::copy(iov.begin(), iov.begin() + count, scratch.begin());
+                    writevAll(savedStdout, scratch.data(), count, consoleStats);
+                }
+
+                std::copy(iov.begin(), iov.begin() + count, scratch.begin());
+                writeLog(scratch.data(), count, batchLines);
+            }
+
+            recordFlush(batchStart);
+            batchSize.store(target, std::memory_order_relaxed);
+            flushStreams();
+            flushBinaryLog();
+
+            if (fill >= target && target < maxBatch) {
+                target = target * 2 > maxBatch ? maxBatch : target * 2;
+            } else if (fill < target / 4 && target > minBatch) {
+                target = target / 2 < minBatch ? minBatch : target / 2;
+            }
+        }
+#ifdef __linux__
+        CosStreams::detachDrain();
+#endif
+        flushStreams();
+        flushBinaryLog();
+        flushFilters(true);
+    }
+
+    static void* teeThreadFunc(void* arg) {
+        COS* instance = static_cast<COS*>(arg);
+
+#ifdef __linux__
+        CosStreams::attachDrain();
+        if (instance->options.drain == CosOptions::Drain::IoUring && instance->uringDrain())
+            return nullptr;
+#endif
+
+        instance->blockingDrain();
         return nullptr;
     }
 
+    // Runs on the watchdog thread while the watched thread is still stuck.
+    void reportHang(unsigned long long stalledMs, const std::string& trace) {
+        char head[96];
+        snprintf(head, sizeof(head), "\n!!! MAIN THREAD HANG: no heartbeat for %llu ms !!!\n", stalledMs);
+
+        std::string report = head;
+        report += "\n The Hang Trace; ";
+        report += irs();
+        report += trace.empty() ? std::string("(stack unavailable)\n") : trace;
+        report += irs();
+        write(STDOUT_FILENO, report.c_str(), report.length());
+
+        {
+            std::lock_guard<std::mutex> guard(hangLock);
+            hangReport = report;
+        }
+
+        if (hangCallback) {
+            CrashInfo info;
+            info.signalName = "HANG";
+            info.signalNumber = 0;
+            info.stackTrace = trace;
+            info.timestamp = getTimestampForLog();
+            info.logPath = logPath;
+#ifdef __linux__
+            info.logMemfd = memLog.fd();
+#endif
+            info.executableName = executableName;
+            info.startTime = startTime;
+            info.sessionDurationMs = sessionMs();
+            info.hangReport = report;
+            hangCallback(info);
+        }
+    }
+
+    inline long long sessionMs() const {
+        return (long long)((monotonicUs() - startMonoUs) / 1000);
+    }
+
+#ifdef __linux__
+    // Process start from /proc/self/stat (boot-time clock ticks) on the monotonic clock.
+    static unsigned long long processStartNs() {
+        char stat[1024];
+        int fd = open("/proc/self/stat", O_RDONLY | O_CLOEXEC);
+        if (fd == -1) return 0;
+        ssize_t n = read(fd, stat, sizeof(stat) - 1);
+        close(fd);
+        if (n <= 0) return 0;
+        stat[n] = '\0';
+
+        const char* p = strrchr(stat, ')');
+        for (int field = 2; p && field < 22; field++) p = strchr(p + 1, ' ');
+        if (!p) return 0;
+        unsigned long long startTicks = strtoull(p + 1, nullptr, 10);
+
+        struct timespec boot, mono;
+        clock_gettime(CLOCK_BOOTTIME, &boot);
+        clock_gettime(CLOCK_MONOTONIC, &mono);
+        unsigned long long bootNs = boot.tv_sec * 1000000000ULL + boot.tv_nsec;
+        unsigned long long monoNs = mono.tv_sec * 1000000000ULL + mono.tv_nsec;
+        unsigned long long startBootNs = startTicks * (1000000000ULL / sysconf(_SC_CLK_TCK));
+        return bootNs > startBootNs && monoNs > bootNs - startBootNs ? monoNs - (bootNs - startBootNs) : 0;
+    }
+#endif
+
+    // Only when spans were recorded or a trace file was asked for.
+    bool saveTrace() {
+        if (!CosTrace::active() && options.traceOutput.empty()) return false;
+        std::string json = CosTrace::chromeJson();
+        if (json.empty()) return false;
+        writeFile(sidecarPath(options.traceOutput, ".trace.json"), json);
+        return true;
+    }
+
+    std::string sidecarPath(const std::string& configured, const char* suffix) const {
+        if (!configured.empty()) return configured;
+        std::string path = logPath;
+        if (path.size() > 4 && path.compare(path.size() - 4, 4, ".log") == 0) path.resize(path.size() - 4);
+        return path + suffix;
+    }
+
+    static void writeFile(const std::string& path, const std::string& text) {
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd != -1) {
+            write(fd, text.data(), text.size());
+            close(fd);
+        }
+    }
+
+#ifdef __linux__
+    // Stops sampling and writes the whole window; returns the number of samples taken.
+    unsigned long long saveCpuProfile() {
+        sampler.stop();
+        writeFile(sidecarPath(options.samplerOutput, ".folded"), sampler.collapsed());
+        return sampler.stats().samples;
+    }
+
+    // Keeps sampling; the live table is read while other threads may still allocate.
+    unsigned long long saveHeapProfile() {
+        writeFile(sidecarPath(options.heapOutput, ".heap"), CosHeapProfiler::collapsed());
+        return CosHeapProfiler::stats().liveBytesEstimate;
+    }
+#endif
+
+#ifndef _WIN32
+    static constexpr unsigned CRASH_SYNC_WAIT_MS = 200;
+
+    // The report is still on its way through the pipe: wait (a little) until
+    // the drain has written it, then make the log durable.
+    void syncAfterCrash() {
+        unsigned long long last = logStats.bytes.load(std::memory_order_relaxed);
+        for (unsigned waited = 0, still = 0; waited < CRASH_SYNC_WAIT_MS && still < 2; waited++) {
+            usleep(1000);
+            unsigned long long now = logStats.bytes.load(std::memory_order_relaxed);
+            still = now == last && pipeDrained() ? still + 1 : 0;
+            last = now;
+        }
+        logSync.sync();
+    }
+#endif
+
     void handleSignal(int sigNum) {
         const char* signalName = getSignalName(sigNum);
         std::string currentTime = getTimestampForLog();
 
+#ifdef __linux__
+        watchdog.pause(true);
+
+        // Try, not block: the crash may have hit the drain thread mid-write.
+        for (int i = 0; i < 50 && viaCollector.load(std::memory_order_acquire); i++) {
+            if (collectorLock.try_lock()) {
+                if (viaCollector.load(std::memory_order_relaxed)) leaveCollector(true);
+                collectorLock.unlock();
+                break;
+            }
+            usleep(1000);
+        }
+#endif
+
         const char* crashMsg = "\n!!! A CRASH SIGNAL FAILURE CAUGHT !!!\n";
         write(STDOUT_FILENO, crashMsg, strlen(crashMsg));
 
@@ -274,11 +1377,63 @@ private:
         }
 #endif
 
+#ifdef __linux__
+        const CosUncaught* uncaught = sigNum == SIGABRT ? CosExceptions::uncaught() : nullptr;
+        if (uncaught) {
+            std::string exceptionMsg = "\n Uncaught Exception; ";
+            exceptionMsg += irs();
+            exceptionMsg += CosExceptions::format(*uncaught);
+            exceptionMsg += irs();
+            write(STDOUT_FILENO, exceptionMsg.c_str(), exceptionMsg.length());
+        }
+
+        std::string cpuProfile;
+        if (sampler.isRunning()) {
+            saveCpuProfile();
+            cpuProfile = sampler.collapsed(0, 20);
+            std::string profileMsg = "\n Hottest Stacks Before The Crash; ";
+            profileMsg += irs();
+            profileMsg += cpuProfile;
+            profileMsg += irs();
+            write(STDOUT_FILENO, profileMsg.c_str(), profileMsg.length());
+        }
+
+        std::string heapProfile;
+        if (CosHeapProfiler::running()) {
+            CosHeapProfiler::stop();
+            saveHeapProfile();
+            heapProfile = CosHeapProfiler::collapsed(20);
+            std::string heapMsg = "\n Largest Live Allocation Sites (estimated bytes); ";
+            heapMsg += irs();
+            heapMsg += heapProfile;
+            heapMsg += irs();
+            write(STDOUT_FILENO, heapMsg.c_str(), heapMsg.length());
+        }
+#endif
+
+        saveTrace();
+
+        std::vector<CosFlightRecord> flightEvents;
+        if (options.flightDumpEvents && CosFlight::active()) {
+            flightEvents = CosFlight::snapshot(options.flightDumpEvents);
+            std::string flightMsg = "\n Flight Recorder (seconds since first event, tid, event, args); ";
+            flightMsg += irs();
+            flightMsg += CosFlight::format(flightEvents);
+            flightMsg += irs();
+            write(STDOUT_FILENO, flightMsg.c_str(), flightMsg.length());
+        }
+
         saveLog(std::string("Crashed: ") + signalName);
+#ifndef _WIN32
+        logIndex.flush();
+        if (logSync.active()) syncAfterCrash();
+#endif
+#ifdef __linux__
+        memLog.spillOften();
+#endif
 
         if (crashCallback) {
-            time_t endTime = time(nullptr);
-            long long durationMs = (long long)(difftime(endTime, startTimeT) * 1000);
+            long long durationMs = sessionMs();
 
             CrashInfo info;
             info.signalName = signalName;
@@ -286,9 +1441,27 @@ private:
             info.stackTrace = stackTrace;
             info.timestamp = currentTime;
             info.logPath = logPath;
+#ifdef __linux__
+            info.logMemfd = memLog.fd();
+#endif
             info.executableName = executableName;
             info.startTime = startTime;
             info.sessionDurationMs = durationMs;
+            if (hangLock.try_lock()) {
+                info.hangReport = hangReport;
+                hangLock.unlock();
+            }
+#ifdef __linux__
+            info.cpuProfile = cpuProfile;
+            info.memoryTimeline = memory.series();
+            info.heapProfile = heapProfile;
+            if (uncaught) {
+                info.exceptionType = uncaught->type;
+                info.exceptionWhat = uncaught->what;
+                info.throwSite = uncaught->throwSite;
+            }
+#endif
+            info.flightEvents = flightEvents;
 
             crashCallback(info);
         }
@@ -296,35 +1469,156 @@ private:
         _exit(128 + sigNum);
     }
 
+    // Restoring fds 1/2 drops the last write ends of the pipe, so the drain thread
+    // reaches EOF after flushing. A child that inherited the pipe must not hang exit.
+    bool joinTeeThread() {
+#ifdef __GLIBC__
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += 500 * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        if (pthread_timedjoin_np(teeThread, nullptr, &deadline) == 0) return true;
+#endif
+        teeRunning.store(false, std::memory_order_release);
+        pthread_detach(teeThread);
+        return false;
+    }
+
+#ifndef _WIN32
+    // With memfdLog it is the copy on disk that has to be durable, so each sync
+    // copies out what is new first.
+    void startSync() {
+        bool group = options.durability == CosOptions::Durability::GroupCommit;
+        bool periodic = group || options.durability == CosOptions::Durability::Periodic;
+        int target = -1;
+        std::function<void()> before;
+#ifdef __linux__
+        if (memLog.active()) {
+            target = open(logPath.c_str(), O_WRONLY | O_CLOEXEC);
+            before = [this] { memLog.spill(); };
+        }
+#endif
+        if (!before) target = fcntl(logFd, F_DUPFD_CLOEXEC, 3);
+        logSync.start(target, logStats.bytes, before, periodic ? options.syncIntervalMs : 0, options.syncBytes, group);
+        if (!logSync.active() && target != -1) close(target);
+    }
+#endif
+
+    // A file target is replaced atomically; a socket target gets one snapshot per connect.
+    void dumpMetrics() {
+        const std::string& target = options.metricsPath;
+        if (target.empty()) return;
+        std::string text = formatMetrics();
+
+#ifndef _WIN32
+        if (target.compare(0, 5, "unix:") == 0) {
+            sockaddr_un addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            strncpy(addr.sun_path, target.c_str() + 5, sizeof(addr.sun_path) - 1);
+
+            int sock = cosLocalSocket(SOCK_STREAM);
+            if (sock == -1) return;
+            if (connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) {
+                send(sock, text.data(), text.size(), MSG_NOSIGNAL);
+            }
+            close(sock);
+            return;
+        }
+#endif
+
+        std::string tmp = target + ".tmp";
+        int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd == -1) return;
+        bool ok = write(fd, text.data(), text.size()) == (ssize_t)text.size();
+        close(fd);
+        if (ok) rename(tmp.c_str(), target.c_str());
+    }
+
+    static void* metricsThreadFunc(void* arg) {
+        COS* instance = static_cast<COS*>(arg);
+        unsigned long long next = monotonicUs() + instance->options.metricsIntervalMs * 1000ULL;
+
+        while (instance->metricsRunning.load(std::memory_order_acquire)) {
+            usleep(20 * 1000);
+            if (monotonicUs() < next) continue;
+            instance->dumpMetrics();
+            next += instance->options.metricsIntervalMs * 1000ULL;
+        }
+        return nullptr;
+    }
+
 public:
-    COS() : logSaved(false), crashCallback(nullptr),
-        savedStdout(-1), logFd(-1), teeRunning(true) {
+    // Read by the default constructor, so tune it before REG_CRASH() or the first COS.
+    inline static CosOptions& defaults() {
+        static CosOptions opts;
+        return opts;
+    }
+
+    COS() : COS(defaults()) {}
+
+    explicit COS(const CosOptions& opts) : logSaved(false), crashCallback(nullptr), hangCallback(nullptr),
+        options(opts), savedStdout(-1), logFd(-1), teeRunning(true), teeStarted(false),
+        batchSize(0), flushes(0), maxDrainLagUs(0), redacted(0),
+#ifndef _WIN32
+        consoleQueue(nullptr),
+#endif
+        metricsRunning(false), viaCollector(false) {
         pipeFds[0] = pipeFds[1] = -1;
+        startMonoUs = monotonicUs();
 
         executableName = getExecutableNameInternal();
         logPath = getTempDir();
 
-        startTimeT = time(nullptr);
         startTime = getTimestampForLog();
 
-        savedStdout = dup(STDOUT_FILENO);
+        if (options.redactSecrets) {
+            redactor.addDefaults();
+            for (const std::string& key : options.redactKeys) redactor.addKey(key);
+            redactor.build();
+        }
+        for (CosLineFilter* filter : { &pipeFilter, &streamFilter }) {
+            filter->configure(options.collapseRepeats, options.repeatIgnoreNumbers, options.rateLimits,
+                              options.rateLimitLines, options.repeatSummaryMs);
+        }
 
-        logFd = open(logPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        savedStdout = dup(STDOUT_FILENO);
 
-        if (logFd != -1) {
-            const char* header1 = "- DATA -----------------------------------------------------------\n";
-            write(logFd, header1, strlen(header1));
+#ifndef _WIN32
+        if (options.console == CosOptions::Console::SkipLines && savedStdout != -1) {
+            auto terminal = std::make_shared<ConsoleSink>(fcntl(savedStdout, F_DUPFD_CLOEXEC, 3), consoleStats);
+            consoleQueue = new CosSinkQueue(terminal, options.consoleQueueBytes, CosSinkQueue::Overflow::SkipLines);
+            if (!consoleQueue->start()) {
+                delete consoleQueue;
+                consoleQueue = nullptr;
+            }
+        }
+#endif
 
-            std::string appLine = "App: " + executableName + "\n";
-            write(logFd, appLine.c_str(), appLine.length());
+        std::string header = logHeader();
 
-            std::string timeLine = "Start: " + startTime + "\n";
-            write(logFd, timeLine.c_str(), timeLine.length());
+#ifdef __linux__
+        if (!options.collectorSocket.empty() &&
+            collector.attach(options.collectorSocket, options.collectorRingBytes, executableName)) {
+            iovec iov = { &header[0], header.size() };
+            viaCollector.store(collector.write(&iov, 1, 0), std::memory_order_release);
+            if (!viaCollector.load(std::memory_order_relaxed)) collector.detach();
+        }
+#endif
 
-            const char* header2 = "------------------------------------------------- CAPTURED LOGS -\n";
-            write(logFd, header2, strlen(header2));
+        if (!viaCollector.load(std::memory_order_relaxed)) {
+            iovec iov = { &header[0], header.size() };
+            openLocalLog(&iov, 1);
         }
 
+#ifdef __linux__
+        if (!options.liveSocket.empty())
+            live.start(options.liveSocket, options.liveRingBytes, options.liveMaxSubscribers);
+#endif
+
         if (pipe(pipeFds) == 0) {
             dup2(pipeFds[1], STDOUT_FILENO);
             dup2(pipeFds[1], STDERR_FILENO);
@@ -332,7 +1626,6 @@ public:
 
             pipeFds[1] = -1;
 
-            pthread_t thread;
             pthread_attr_t attr;
             pthread_attr_init(&attr);
 
@@ -340,33 +1633,115 @@ public:
             pthread_attr_setstacksize(&attr, 64 * 1024);
 #endif
 
-            pthread_create(&thread, &attr, teeThreadFunc, this);
-            pthread_detach(thread);
+            teeStarted = pthread_create(&teeThread, &attr, teeThreadFunc, this) == 0;
             pthread_attr_destroy(&attr);
         }
 
+#ifdef __linux__
+        if (options.streamBuffers && teeStarted) CosStreams::install(options.streamRingBytes);
+#endif
+
+#ifdef __linux__
+        memory.start(options.memorySampleMs, options.memoryHistory, options.memoryPressurePercent);
+        CosHeapProfiler::start(options.heapSampleBytes);
+
+        if (options.samplerHz)
+            sampler.start(options.samplerHz, options.samplerWindowSec, options.samplerThreads);
+#endif
+
+        if (options.metricsIntervalMs && !options.metricsPath.empty()) {
+            metricsRunning.store(true, std::memory_order_release);
+            if (pthread_create(&metricsThread, nullptr, metricsThreadFunc, this) != 0)
+                metricsRunning.store(false, std::memory_order_release);
+        }
+
         globalInstance.store(this, std::memory_order_release);
         setupSignalHandlers();
+#ifdef __linux__
+        CosUnwind::init();
+        if (options.terminateHandler) CosExceptions::install();
+#endif
+
+#ifdef __linux__
+        unsigned long long execNs = processStartNs();
+        if (execNs && execNs < startMonoUs * 1000) CosTrace::phase("startup: exec to COS", execNs, startMonoUs * 1000);
+#endif
+        CosTrace::phase("cos.init", startMonoUs * 1000, monotonicUs() * 1000);
 
         std::string initMsg = " Outputs of " + executableName + " in this Session \n Are saved in this following file path : " + logPath + "\n";
         write(STDOUT_FILENO, initMsg.c_str(), initMsg.length());
     }
 
     ~COS() {
+#ifdef __linux__
+        // Partial lines go out ahead of the exit report.
+        CosStreams::uninstall();
+        watchdog.disarm();
+
+        if (!logSaved && sampler.isRunning()) {
+            unsigned long long taken = saveCpuProfile();
+            std::string msg = "\nCPU profile: " + std::to_string(taken) + " samples saved to " + sidecarPath(options.samplerOutput, ".folded") + "\n";
+            write(STDOUT_FILENO, msg.c_str(), msg.length());
+        }
+
+        if (!logSaved && CosHeapProfiler::running()) {
+            CosHeapProfiler::stop();
+            unsigned long long live = saveHeapProfile();
+            std::string msg = "\nHeap profile: ~" + std::to_string(live / 1024) + " KiB live saved to " +
+                              sidecarPath(options.heapOutput, ".heap") + "\n";
+            write(STDOUT_FILENO, msg.c_str(), msg.length());
+        }
+#endif
+
+        if (!logSaved && saveTrace()) {
+            std::string msg = "\nTrace: saved to " + sidecarPath(options.traceOutput, ".trace.json") + "\n";
+            write(STDOUT_FILENO, msg.c_str(), msg.length());
+        }
+
         if (!logSaved) {
             saveLog("Normal exit");
         }
 
-        teeRunning.store(false, std::memory_order_release);
-
         if (savedStdout != -1) {
             dup2(savedStdout, STDOUT_FILENO);
             dup2(savedStdout, STDERR_FILENO);
-            close(savedStdout);
         }
 
-        if (pipeFds[0] != -1) close(pipeFds[0]);
-        if (logFd != -1) close(logFd);
+#ifdef __linux__
+        memory.stop();
+#endif
+
+        bool drained = teeStarted ? joinTeeThread() : true;
+        teeRunning.store(false, std::memory_order_release);
+
+        if (metricsRunning.exchange(false, std::memory_order_acq_rel)) {
+            pthread_join(metricsThread, nullptr);
+            dumpMetrics();
+        }
+
+        if (drained) {
+#ifdef __linux__
+            live.stop();
+#endif
+#ifndef _WIN32
+            sinks.stopAll();
+            if (consoleQueue && consoleQueue->stop()) delete consoleQueue;
+#endif
+            if (savedStdout != -1) close(savedStdout);
+            if (pipeFds[0] != -1) close(pipeFds[0]);
+#ifndef _WIN32
+            logIndex.close();
+#endif
+            if (logFd != -1) close(logFd);
+        }
+#ifdef __linux__
+        // The drain is done with it; a stuck drain still writes to its copy.
+        memLog.finish(drained && options.memfdSeal);
+#endif
+#ifndef _WIN32
+        logSync.stop(options.durability == CosOptions::Durability::Periodic ||
+                     options.durability == CosOptions::Durability::GroupCommit);
+#endif
 
         COS* expected = this;
         globalInstance.compare_exchange_strong(expected, nullptr,
@@ -377,12 +1752,86 @@ public:
         crashCallback = callback;
     }
 
+    // Called on the watchdog thread with signalName "HANG"; the app keeps running.
+    inline void setHangCallback(CrashCallback callback) {
+        hangCallback = callback;
+    }
+
+    // Watches the calling thread, which must then call heartbeat() at least
+    // every hangThresholdMs. Returns false if disabled, unsupported or already armed.
+    bool armWatchdog() {
+#ifdef __linux__
+        return watchdog.arm(options.hangThresholdMs,
+            [this](unsigned long long stalledMs, const std::string& trace) { reportHang(stalledMs, trace); },
+            [](unsigned long long stalledMs) {
+                char msg[96];
+                snprintf(msg, sizeof(msg), "\n!!! MAIN THREAD RECOVERED after %llu ms !!!\n", stalledMs);
+                write(STDOUT_FILENO, msg, strlen(msg));
+            });
+#else
+        return false;
+#endif
+    }
+
+    inline void heartbeat() {
+#ifdef __linux__
+        watchdog.heartbeat();
+#endif
+    }
+
+    inline unsigned heartbeatIntervalMs() const {
+        unsigned interval = options.hangThresholdMs / 4;
+        return interval < 10 ? 10 : interval;
+    }
+
+    // Collapsed stacks ("root;...;leaf count") from the sampler's window, heaviest first.
+    std::string cpuProfile(unsigned lastSeconds = 0, size_t maxStacks = 0) const {
+#ifdef __linux__
+        return sampler.collapsed(lastSeconds, maxStacks);
+#else
+        (void)lastSeconds;
+        (void)maxStacks;
+        return std::string();
+#endif
+    }
+
+#ifdef __linux__
+    inline CosSamplerStats getSamplerStats() const { return sampler.stats(); }
+
+    // Runs on the memory sampler thread; a chance to drop caches before the OOM killer.
+    inline void setMemoryPressureCallback(CosMemorySampler::PressureCallback callback) {
+        memory.setPressureCallback(callback);
+    }
+#endif
+
+    // Live heap by allocation site as collapsed stacks weighted in estimated bytes.
+    std::string heapProfile(size_t maxSites = 0) const {
+#ifdef __linux__
+        return CosHeapProfiler::collapsed(maxSites);
+#else
+        (void)maxSites;
+        return std::string();
+#endif
+    }
+
+    std::vector<CosMemorySample> getMemoryTimeline() const {
+#ifdef __linux__
+        return memory.series();
+#else
+        return std::vector<CosMemorySample>();
+#endif
+    }
+
+    std::string getHangReport() const {
+        std::lock_guard<std::mutex> guard(hangLock);
+        return hangReport;
+    }
+
     void saveLog(const std::string& exitReason) {
         if (logSaved) return;
         logSaved = true;
 
-        time_t endTime = time(nullptr);
-        long long durationMs = (long long)(difftime(endTime, startTimeT) * 1000);
+        long long durationMs = sessionMs();
 
         char durationBuffer[32];
         snprintf(durationBuffer, sizeof(durationBuffer), "%02lld:%02lld:%02lld:%02lld",
@@ -399,17 +1848,199 @@ public:
 
         std::string durationLine = "Duration: " + std::string(durationBuffer) + " (HH:MM:SS:CS)\n";
         write(STDOUT_FILENO, durationLine.c_str(), durationLine.length());
+
+        CosMetrics m = getMetrics();
+        char summary[256];
+        snprintf(summary, sizeof(summary),
+                 "Captured: %llu bytes, %llu lines, %llu write errors, max drain lag %.3f ms\n",
+                 m.captured.bytes, m.captured.lines, m.console.errors + m.log.errors,
+                 m.maxDrainLagUs / 1000.0);
+        write(STDOUT_FILENO, summary, strlen(summary));
+        if (m.consoleSkippedLines) {
+            snprintf(summary, sizeof(summary), "Console: %llu lines skipped on a slow terminal, all kept in the log\n",
+                     m.consoleSkippedLines);
+            write(STDOUT_FILENO, summary, strlen(summary));
+        }
+        if (m.redacted) {
+            snprintf(summary, sizeof(summary), "Redacted: %llu secrets masked\n", m.redacted);
+            write(STDOUT_FILENO, summary, strlen(summary));
+        }
+        if (m.suppressed.collapsed || m.suppressed.rateLimited) {
+            snprintf(summary, sizeof(summary),
+                     "Suppressed: %llu repeated lines collapsed, %llu lines over rate limits\n",
+                     m.suppressed.collapsed, m.suppressed.rateLimited);
+            write(STDOUT_FILENO, summary, strlen(summary));
+        }
+#ifndef _WIN32
+        CosSyncStats sync = logSync.stats();
+        if (sync.failedErrno) {
+            snprintf(summary, sizeof(summary), "Sync: log fdatasync failed (%s), %llu bytes since may not be on disk\n",
+                     strerror(sync.failedErrno), sync.unsyncedBytes);
+            write(STDOUT_FILENO, summary, strlen(summary));
+        }
+#endif
+
+#ifdef __linux__
+        std::string memoryReport = memory.summary();
+        write(STDOUT_FILENO, memoryReport.c_str(), memoryReport.length());
+#endif
     }
 
     inline const std::string& getExecutableName() const { return executableName; }
     inline const std::string& getLogPath() const { return logPath; }
     inline const std::string& getStartTime() const { return startTime; }
     inline const std::string& getStackTrace() const { return stackTrace; }
+    inline const CosOptions& getOptions() const { return options; }
+
+    // The terminal stdout pointed at before COS took it over.
+    inline int consoleFd() const { return savedStdout; }
+
+#ifndef _WIN32
+    // fdatasync() count and cost, and how much of the log a power cut could take.
+    inline CosSyncStats getSyncStats() const { return logSync.stats(); }
+#endif
+
+#ifdef __linux__
+    // The memfd holding the log with memfdLog, else -1. Another process can
+    // map it through /proc/<pid>/fd/<fd>; logPath is its copy on disk.
+    inline int logMemfd() const { return memLog.fd(); }
+    inline CosMemfdStats getMemfdStats() const { return memLog.stats(); }
+#endif
+
+#ifndef _WIN32
+    // Adds a destination for everything captured from now on. Each sink gets
+    // its own queue (queueBytes, default sinkQueueBytes) and thread, so a slow
+    // or broken sink drops its own batches without holding up the others.
+    bool addSink(std::shared_ptr<CosSink> sink, size_t queueBytes = 0) {
+        return sinks.add(std::move(sink), queueBytes ? queueBytes : options.sinkQueueBytes);
+    }
+
+    inline std::vector<CosSinkStats> getSinkStats() const { return sinks.stats(); }
+#endif
+
+#ifdef __linux__
+    // Subscribers on liveSocket; all zero when it is off.
+    inline CosLiveStats getLiveStats() const { return live.stats(); }
+#endif
+
+    // CLOCK_MONOTONIC microseconds at construction.
+    inline unsigned long long startedAtUs() const { return startMonoUs; }
+
+    DrainStats getDrainStats() const {
+        DrainStats stats;
+        stats.batchSize = batchSize.load(std::memory_order_relaxed);
+        stats.flushes = flushes.load(std::memory_order_relaxed);
+        flushLatency.snapshot(stats.flushLatencyUs);
+        return stats;
+    }
+
+    CosMetrics getMetrics() const {
+        CosMetrics m;
+        m.captured = capturedStats.snapshot();
+        m.console = consoleStats.snapshot();
+        m.log = logStats.snapshot();
+#ifndef _WIN32
+        m.consoleSkippedLines = consoleQueue ? consoleQueue->stats().skippedLines : 0;
+#else
+        m.consoleSkippedLines = 0;
+#endif
+        m.maxDrainLagUs = maxDrainLagUs.load(std::memory_order_relaxed);
+        m.redacted = redacted.load(std::memory_order_relaxed);
+        CosDedupStats pipe = pipeFilter.stats(), streams = streamFilter.stats();
+        m.suppressed = CosDedupStats{pipe.collapsed + streams.collapsed, pipe.rateLimited + streams.rateLimited,
+                                    pipe.patterns + streams.patterns};
+        m.drain = getDrainStats();
+
+        int pending = 0;
+        m.backlogBytes = (pipeFds[0] != -1 && ioctl(pipeFds[0], FIONREAD, &pending) == 0) ? (size_t)pending : 0;
+        return m;
+    }
+
+    // One "name value" pair per line, Prometheus text style.
+    std::string formatMetrics() const {
+        CosMetrics m = getMetrics();
+        std::string out;
+        char line[160];
+
+        auto emit = [&](const char* name, unsigned long long value) {
+            snprintf(line, sizeof(line), "cos_%s %llu\n", name, value);
+            out += line;
+        };
+        auto emitStream = [&](const char* stream, const StreamMetrics& s) {
+            const char* names[] = { "bytes_total", "syscalls_total", "short_writes_total", "errors_total" };
+            unsigned long long values[] = { s.bytes, s.syscalls, s.shortWrites, s.errors };
+            for (int i = 0; i < 4; i++) {
+                snprintf(line, sizeof(line), "cos_%s{stream=\"%s\"} %llu\n", names[i], stream, values[i]);
+                out += line;
+            }
+        };
+
+        emitStream("captured", m.captured);
+        emitStream("console", m.console);
+        emitStream("log", m.log);
+        emit("lines_total", m.captured.lines);
+        emit("console_skipped_lines_total", m.consoleSkippedLines);
+        emit("redacted_total", m.redacted);
+        emit("collapsed_lines_total", m.suppressed.collapsed);
+        emit("rate_limited_lines_total", m.suppressed.rateLimited);
+        emit("rate_limit_tracked_lines", m.suppressed.patterns);
+#ifdef __linux__
+        emit("stream_ring_stalls_total", CosStreams::stalls());
+        if (logSync.active()) {
+            CosSyncStats sync = logSync.stats();
+            emit("log_syncs_total", sync.syncs);
+            emit("log_sync_errors_total", sync.errors);
+            emit("log_sync_failed", sync.failedErrno ? 1 : 0);
+            emit("log_sync_max_us", sync.maxSyncUs);
+            emit("log_unsynced_bytes", sync.unsyncedBytes);
+            emit("log_unsynced_max_bytes", sync.maxUnsyncedBytes);
+        }
+        if (memLog.active()) {
+            CosMemfdStats mem = memLog.stats();
+            emit("memfd_bytes", mem.bytes);
+            emit("memfd_spilled_bytes", mem.spilledBytes);
+            emit("memfd_spill_errors_total", mem.errors);
+        }
+        if (live.active()) {
+            CosLiveStats subs = live.stats();
+            emit("live_subscribers", subs.subscribers);
+            emit("live_subscribers_dropped_total", subs.dropped);
+            emit("live_bytes_total", subs.bytesSent);
+        }
+#endif
+        emit("backlog_bytes", m.backlogBytes);
+        emit("drain_lag_max_us", m.maxDrainLagUs);
+        emit("batch_size_bytes", m.drain.batchSize);
+
+        unsigned long long cumulative = 0;
+        for (int b = 0; b < CosHistogram::BUCKETS; b++) {
+            cumulative += m.drain.flushLatencyUs[b];
+            snprintf(line, sizeof(line), "cos_flush_latency_us_bucket{le=\"%llu\"} %llu\n",
+                     1ULL << (b + 1), cumulative);
+            out += line;
+        }
+        emit("flush_latency_us_count", m.drain.flushes);
+
+#ifndef _WIN32
+        for (const CosSinkStats& sink : sinks.stats()) {
+            const char* names[] = { "sink_bytes_total", "sink_errors_total", "sink_dropped_bytes_total", "sink_queued_bytes" };
+            unsigned long long values[] = { sink.bytes, sink.errors, sink.droppedBytes, sink.queuedBytes };
+            for (int i = 0; i < 4; i++) {
+                snprintf(line, sizeof(line), "cos_%s{sink=\"%.64s\"} %llu\n", names[i], sink.name.c_str(), values[i]);
+                out += line;
+            }
+        }
+#endif
+        return out;
+    }
 
     static void Tri_reset() {
         COS* instance = globalInstance.load(std::memory_order_acquire);
         if (instance) {
             instance->saveLog("Application restart initiated");
+#ifdef __linux__
+            instance->memLog.spill();
+#endif
         }
 
 #ifdef _WIN32
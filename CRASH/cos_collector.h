@@ -0,0 +1,527 @@
+#ifndef COS_COLLECTOR_H
+#define COS_COLLECTOR_H
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <ctime>
+#include <atomic>
+#include <new>
+#include <string>
+#include <vector>
+
+// Layout of the per-process ring shared with the collector. head and tail are
+// byte positions that only grow; the data area is a power of two in size.
+struct CosRingHeader {
+    static const uint32_t MAGIC = 0x52534f43; // "COSR"
+    static const uint32_t VERSION = 1;
+    static const size_t DATA_OFFSET = 4096;
+
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;
+    int32_t pid;
+    char app[64];
+    alignas(64) std::atomic<uint64_t> head;
+    alignas(64) std::atomic<uint64_t> tail;
+    std::atomic<uint32_t> closed;
+};
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "ring positions are shared across processes");
+static_assert(sizeof(CosRingHeader) <= CosRingHeader::DATA_OFFSET, "ring header spills into data");
+
+// Producer side, driven by the COS drain thread. Registration hands the ring's
+// memfd to the collector over SCM_RIGHTS; the connection doubles as a liveness
+// signal, since it hangs up when the collector goes away.
+class CosRingWriter {
+private:
+    int memFd;
+    int sock;
+    CosRingHeader* hdr;
+    char* data;
+    size_t mapLen;
+    unsigned long long lastCheckUs;
+
+    static inline unsigned long long nowUs() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (unsigned long long)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+    }
+
+    inline void copyIn(uint64_t pos, const char* src, size_t len) {
+        size_t off = pos & (hdr->capacity - 1);
+        size_t first = hdr->capacity - off < len ? hdr->capacity - off : len;
+        memcpy(data + off, src, first);
+        memcpy(data, src + first, len - first);
+    }
+
+    // Describes ring bytes [from, to) as at most two slices.
+    inline int slices(uint64_t from, uint64_t to, iovec* out) const {
+        size_t off = from & (hdr->capacity - 1);
+        size_t len = to - from;
+        size_t first = hdr->capacity - off < len ? hdr->capacity - off : len;
+        out[0].iov_base = data + off;
+        out[0].iov_len = first;
+        out[1].iov_base = data;
+        out[1].iov_len = len - first;
+        return len - first ? 2 : 1;
+    }
+
+public:
+    CosRingWriter() : memFd(-1), sock(-1), hdr(nullptr), data(nullptr), mapLen(0), lastCheckUs(0) {}
+
+    ~CosRingWriter() { detach(); }
+
+    bool attach(const std::string& socketPath, size_t capacity, const std::string& app) {
+        if (capacity & (capacity - 1)) return false;
+
+        memFd = memfd_create("cos-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        if (memFd == -1) return false;
+
+        // The collector refuses rings that could still shrink under its mapping.
+        mapLen = CosRingHeader::DATA_OFFSET + capacity;
+        if (ftruncate(memFd, (off_t)mapLen) != 0 ||
+            fcntl(memFd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0) {
+            detach();
+            return false;
+        }
+
+        void* map = mmap(nullptr, mapLen, PROT_READ | PROT_WRITE, MAP_SHARED, memFd, 0);
+        if (map == MAP_FAILED) { detach(); return false; }
+
+        hdr = new (map) CosRingHeader;
+        hdr->magic = CosRingHeader::MAGIC;
+        hdr->version = CosRingHeader::VERSION;
+        hdr->capacity = capacity;
+        hdr->pid = getpid();
+        strncpy(hdr->app, app.c_str(), sizeof(hdr->app) - 1);
+        hdr->head.store(0, std::memory_order_relaxed);
+        hdr->tail.store(0, std::memory_order_relaxed);
+        hdr->closed.store(0, std::memory_order_relaxed);
+        data = static_cast<char*>(map) + CosRingHeader::DATA_OFFSET;
+
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+
+        sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (sock == -1 || connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            detach();
+            return false;
+        }
+
+        char tag = 'R';
+        iovec iov = { &tag, 1 };
+        char control[CMSG_SPACE(sizeof(int))];
+        memset(control, 0, sizeof(control));
+        msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &memFd, sizeof(int));
+
+        if (sendmsg(sock, &msg, MSG_NOSIGNAL) != 1) {
+            detach();
+            return false;
+        }
+        lastCheckUs = nowUs();
+        return true;
+    }
+
+    inline bool attached() const { return hdr != nullptr; }
+
+    bool collectorAlive() {
+        if (sock == -1) return false;
+        pollfd pfd = { sock, POLLIN, 0 };
+        if (poll(&pfd, 1, 0) <= 0) return true;
+        return !(pfd.revents & (POLLHUP | POLLERR | POLLIN));
+    }
+
+    // False when the collector is gone or stuck; the caller then falls back.
+    bool write(const iovec* iov, int count, unsigned waitMs) {
+        size_t len = 0;
+        for (int i = 0; i < count; i++) len += iov[i].iov_len;
+        if (len > hdr->capacity) return false;
+
+        uint64_t head = hdr->head.load(std::memory_order_relaxed);
+        unsigned long long now = nowUs();
+        unsigned long long deadline = now + waitMs * 1000ULL;
+
+        if (now - lastCheckUs > 250000) {
+            lastCheckUs = now;
+            if (!collectorAlive()) return false;
+        }
+
+        while (head + len - hdr->tail.load(std::memory_order_acquire) > hdr->capacity) {
+            if (nowUs() > deadline || !collectorAlive()) return false;
+            usleep(200);
+        }
+
+        uint64_t pos = head;
+        for (int i = 0; i < count; i++) {
+            copyIn(pos, static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+            pos += iov[i].iov_len;
+        }
+        hdr->head.store(pos, std::memory_order_release);
+        return true;
+    }
+
+    // Bytes the collector has not persisted yet, for the local fallback file.
+    inline int unconsumed(iovec* out) const {
+        uint64_t head = hdr->head.load(std::memory_order_relaxed);
+        uint64_t tail = hdr->tail.load(std::memory_order_acquire);
+        if (tail >= head) return 0;
+        return slices(tail, head, out);
+    }
+
+    // The most recent bytes still in memory, consumed or not.
+    inline int recent(iovec* out) const {
+        uint64_t head = hdr->head.load(std::memory_order_relaxed);
+        uint64_t from = head > hdr->capacity ? head - hdr->capacity : 0;
+        if (from >= head) return 0;
+        return slices(from, head, out);
+    }
+
+    void detach() {
+        if (hdr) {
+            hdr->closed.store(1, std::memory_order_release);
+            munmap(hdr, mapLen);
+        }
+        if (sock != -1) close(sock);
+        if (memFd != -1) close(memFd);
+        hdr = nullptr;
+        data = nullptr;
+        sock = memFd = -1;
+    }
+
+    CosRingWriter(const CosRingWriter&) = delete;
+    CosRingWriter& operator=(const CosRingWriter&) = delete;
+};
+
+// The per-host daemon: maps every registered ring and appends what it finds to
+// rotating segment files. Each chunk is framed as "#COS <pid> <app> <len>\n"
+// followed by the raw bytes, so segments can be split back per process.
+class CosCollector {
+private:
+    // The header is writable by the client, so what framing and bounds depend
+    // on is copied out at accept() and the daemon keeps its own tail.
+    struct Client {
+        int sock;
+        CosRingHeader* hdr;
+        char* data;
+        size_t mapLen;
+        uint64_t capacity;
+        uint64_t tail;
+        bool broken;
+        char frame[128];
+        int framePrefix;
+    };
+
+    // A connection whose registration message has not arrived yet. run() only
+    // reads it once poll() says it is readable, and gives up after a deadline.
+    struct Pending {
+        int sock;
+        unsigned long long deadlineMs;
+    };
+    static const unsigned REGISTER_TIMEOUT_MS = 1000;
+
+    std::string socketPath;
+    std::string directory;
+    size_t segmentBytes;
+    unsigned idleSleepUs;
+
+    int listenFd;
+    int segmentFd;
+    unsigned segmentIndex;
+    size_t segmentFill;
+    std::vector<Client> clients;
+    std::vector<Pending> pending;
+    std::atomic<bool> running;
+
+    static inline unsigned long long nowMs() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (unsigned long long)ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+    }
+
+    bool openSegment() {
+        if (segmentFd != -1) close(segmentFd);
+        char name[32];
+        snprintf(name, sizeof(name), "/segment-%06u.log", ++segmentIndex);
+        std::string path = directory + name;
+        segmentFd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        segmentFill = 0;
+        return segmentFd != -1;
+    }
+
+    // Picks up numbering after the newest existing segment so a restart never
+    // overwrites what an earlier run wrote.
+    void scanSegments() {
+        DIR* dir = opendir(directory.c_str());
+        if (!dir) return;
+        while (dirent* e = readdir(dir)) {
+            unsigned idx = 0;
+            if (sscanf(e->d_name, "segment-%u.log", &idx) == 1 && idx > segmentIndex)
+                segmentIndex = idx;
+        }
+        closedir(dir);
+    }
+
+    void accept() {
+        int fd = ::accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+        if (fd == -1) return;
+        pending.push_back(Pending{ fd, nowMs() + REGISTER_TIMEOUT_MS });
+    }
+
+    // Reads the registration from a readable pending socket. False while the
+    // message has not arrived; otherwise fd is consumed, whether or not it
+    // became a client.
+    bool admit(int fd) {
+        char tag = 0;
+        iovec iov = { &tag, 1 };
+        char control[CMSG_SPACE(sizeof(int))];
+        msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        int ringFd = -1;
+        ssize_t got = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC | MSG_DONTWAIT);
+        if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return false;
+        if (got == 1 && tag == 'R') {
+            cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+            if (cmsg && cmsg->cmsg_type == SCM_RIGHTS)
+                memcpy(&ringFd, CMSG_DATA(cmsg), sizeof(int));
+        }
+
+        // Without F_SEAL_SHRINK the client could ftruncate() the ring and fault us with SIGBUS.
+        struct stat st;
+        void* map = MAP_FAILED;
+        int seals = ringFd != -1 ? fcntl(ringFd, F_GET_SEALS) : -1;
+        if (seals != -1 && (seals & F_SEAL_SHRINK) && fstat(ringFd, &st) == 0 &&
+            (size_t)st.st_size > CosRingHeader::DATA_OFFSET)
+            map = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, ringFd, 0);
+        if (ringFd != -1) close(ringFd);
+
+        CosRingHeader* hdr = static_cast<CosRingHeader*>(map);
+        if (map == MAP_FAILED || hdr->magic != CosRingHeader::MAGIC ||
+            hdr->version != CosRingHeader::VERSION || !hdr->capacity || (hdr->capacity & (hdr->capacity - 1)) ||
+            hdr->capacity + CosRingHeader::DATA_OFFSET != (uint64_t)st.st_size) {
+            if (map != MAP_FAILED) munmap(map, st.st_size);
+            close(fd);
+            return true;
+        }
+
+        Client c;
+        c.sock = fd;
+        c.hdr = hdr;
+        c.data = static_cast<char*>(map) + CosRingHeader::DATA_OFFSET;
+        c.mapLen = st.st_size;
+        c.capacity = hdr->capacity;
+        c.tail = hdr->tail.load(std::memory_order_acquire);
+        c.broken = false;
+
+        // Spaces, newlines and other bytes that would break "#COS <pid> <app> <len>" become '_'.
+        char app[sizeof(hdr->app) + 1];
+        memcpy(app, hdr->app, sizeof(hdr->app));
+        app[sizeof(hdr->app)] = '\0';
+        for (char* p = app; *p; p++)
+            if ((unsigned char)*p <= ' ' || (unsigned char)*p >= 0x7f) *p = '_';
+        c.framePrefix = snprintf(c.frame, sizeof(c.frame), "#COS %d %s ", (int)hdr->pid, app[0] ? app : "-");
+        clients.push_back(c);
+        return true;
+    }
+
+    // One writev per pass covering every ring with pending data. A ring's tail
+    // only moves once its whole frame is in the segment.
+    size_t collect() {
+        std::vector<iovec> iov;
+        std::vector<uint64_t> heads(clients.size());
+        std::vector<size_t> ends(clients.size(), 0);
+        size_t total = 0;
+
+        for (size_t i = 0; i < clients.size(); i++) {
+            Client& c = clients[i];
+            heads[i] = c.tail;
+            if (c.broken) continue;
+            uint64_t head = c.hdr->head.load(std::memory_order_acquire);
+            if (head - c.tail > c.capacity) {
+                // More than the ring holds (or behind us): not a ring we can read. run() drops it.
+                c.broken = true;
+                continue;
+            }
+            heads[i] = head;
+            if (head == c.tail) continue;
+
+            size_t len = head - c.tail;
+            int n = c.framePrefix + snprintf(c.frame + c.framePrefix, sizeof(c.frame) - c.framePrefix, "%zu\n", len);
+            iov.push_back({ c.frame, (size_t)n });
+
+            size_t off = c.tail & (c.capacity - 1);
+            size_t first = c.capacity - off < len ? c.capacity - off : len;
+            iov.push_back({ c.data + off, first });
+            if (len > first) iov.push_back({ c.data, len - first });
+            total += n + len;
+            ends[i] = total;
+        }
+        if (!total) return 0;
+
+        if (segmentFd == -1 || segmentFill + total > segmentBytes) openSegment();
+
+        size_t at = 0, written = 0;
+        bool failed = false;
+        while (at < iov.size()) {
+            int count = iov.size() - at > IOV_MAX ? IOV_MAX : (int)(iov.size() - at);
+            ssize_t r = writev(segmentFd, iov.data() + at, count);
+            if (r < 0) {
+                if (errno == EINTR) continue;
+                failed = true;
+                break;
+            }
+            written += (size_t)r;
+            size_t done = (size_t)r;
+            while (at < iov.size() && done >= iov[at].iov_len) done -= iov[at++].iov_len;
+            if (at < iov.size()) {
+                iov[at].iov_base = static_cast<char*>(iov[at].iov_base) + done;
+                iov[at].iov_len -= done;
+            }
+        }
+
+        // Frames that made it in whole are kept and their rings advance; a torn
+        // one is cut off and retried, in a fresh segment, on the next pass.
+        size_t kept = failed ? 0 : total;
+        for (size_t i = 0; i < clients.size(); i++) {
+            if (ends[i] > written) continue;
+            if (ends[i] > kept) kept = ends[i];
+            clients[i].tail = heads[i];
+            clients[i].hdr->tail.store(heads[i], std::memory_order_release);
+        }
+        if (failed) {
+            // If the cut fails too, readers see the torn frame's length run past the segment's end.
+            if (ftruncate(segmentFd, (off_t)(segmentFill + kept)) != 0) {}
+            openSegment();
+            return kept;
+        }
+        segmentFill += total;
+        return total;
+    }
+
+    void drop(size_t i) {
+        munmap(clients[i].hdr, clients[i].mapLen);
+        close(clients[i].sock);
+        clients.erase(clients.begin() + i);
+    }
+
+public:
+    CosCollector(const std::string& socket, const std::string& dir,
+                 size_t segment = 64 * 1024 * 1024, unsigned idleUs = 2000)
+        : socketPath(socket), directory(dir), segmentBytes(segment), idleSleepUs(idleUs),
+        listenFd(-1), segmentFd(-1), segmentIndex(0), segmentFill(0), running(true) {}
+
+    ~CosCollector() {
+        for (size_t i = clients.size(); i-- > 0;) drop(i);
+        for (const Pending& p : pending) close(p.sock);
+        if (segmentFd != -1) close(segmentFd);
+        if (listenFd != -1) {
+            close(listenFd);
+            unlink(socketPath.c_str());
+        }
+    }
+
+    // Refuses to steal the socket from a live collector; a stale one is replaced.
+    bool listen() {
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool live = probe != -1 && connect(probe, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+        if (probe != -1) close(probe);
+        if (live) return false;
+        unlink(socketPath.c_str());
+
+        mkdir(directory.c_str(), 0755);
+        scanSegments();
+
+        listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+        if (listenFd == -1) return false;
+        if (bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+            ::listen(listenFd, 128) != 0) {
+            close(listenFd);
+            listenFd = -1;
+            return false;
+        }
+        return true;
+    }
+
+    inline void stop() { running.store(false, std::memory_order_release); }
+
+    int run() {
+        if (listenFd == -1 && !listen()) return 1;
+
+        std::vector<pollfd> fds;
+        while (running.load(std::memory_order_acquire)) {
+            size_t moved = collect();
+            for (size_t i = clients.size(); i-- > 0;)
+                if (clients[i].broken) drop(i);
+
+            fds.assign(1, pollfd{ listenFd, POLLIN, 0 });
+            for (const Client& c : clients) fds.push_back(pollfd{ c.sock, POLLIN, 0 });
+            for (const Pending& p : pending) fds.push_back(pollfd{ p.sock, POLLIN, 0 });
+            size_t firstPending = 1 + clients.size();
+            if (poll(fds.data(), fds.size(), 0) > 0) {
+                for (size_t i = clients.size(); i-- > 0;) {
+                    if (!fds[i + 1].revents) continue;
+                    collect();
+                    drop(i);
+                }
+                if (fds[0].revents & POLLIN) accept();
+            }
+
+            // Entries accept() just added sit past the end of fds and wait for the next poll.
+            unsigned long long now = nowMs();
+            for (size_t i = pending.size(); i-- > 0;) {
+                bool ready = firstPending + i < fds.size() && fds[firstPending + i].revents;
+                if (ready && admit(pending[i].sock)) {
+                    pending.erase(pending.begin() + i);
+                } else if (now > pending[i].deadlineMs) {
+                    close(pending[i].sock);
+                    pending.erase(pending.begin() + i);
+                }
+            }
+
+            if (!moved) usleep(idleSleepUs);
+        }
+
+        collect();
+        return 0;
+    }
+
+    CosCollector(const CosCollector&) = delete;
+    CosCollector& operator=(const CosCollector&) = delete;
+};
+
+#endif // __linux__
+
+#endif // COS_COLLECTOR_H
@@ -0,0 +1,328 @@
+#ifndef COS_DEDUP_H
+#define COS_DEDUP_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <atomic>
+#include <string>
+#include <vector>
+
+// Lines containing match share one token bucket of burst lines, refilled at
+// linesPerSec. An empty match gives every distinct line a bucket of its own.
+struct CosRateLimit {
+    std::string match;
+    double linesPerSec;
+    unsigned burst;
+};
+
+struct CosDedupStats {
+    unsigned long long collapsed;       // repeats folded into "last message repeated"
+    unsigned long long rateLimited;     // lines dropped by a token bucket
+    size_t patterns;                    // distinct lines with a bucket of their own
+};
+
+// Collapses consecutive repeats of a line into "last message repeated N times"
+// and drops lines over their rate limit, a batch of captured text at a time.
+// Lines are compared by a 64-bit hash, optionally with digit runs ignored so
+// "attempt 41" repeats "attempt 40". Memory is fixed: one held partial line of
+// at most MAX_LINE bytes and a set-associative table of per-line buckets that
+// evicts the least recently used. Used from the drain thread only; stats()
+// may be read from anywhere.
+class CosLineFilter {
+public:
+    static const size_t MAX_LINE = 4096;
+
+private:
+    struct Bucket {
+        uint64_t hash;      // 0: free
+        uint64_t lastNs;
+        double tokens;
+        unsigned long long suppressed;
+    };
+
+    static const int WAYS = 4;
+    static const uint64_t QUIET_NS = 1000000000ULL;
+
+    bool collapse;
+    bool ignoreNumbers;
+    uint64_t flushNs;
+    std::vector<CosRateLimit> limits;
+    std::vector<Bucket> shared;         // one per limit with a match
+    int perLine;                        // the limit without a match, or -1
+    std::vector<Bucket> table;
+    size_t sets;
+
+    std::string partial;
+    bool midLine;
+    bool haveLast;
+    bool lastDropped;
+    uint64_t lastHash;
+    uint64_t runStartNs;
+    uint64_t lastRepeatNs;
+    unsigned long long repeats;
+
+    unsigned long long collapsed;
+    unsigned long long rateLimited;
+    size_t patterns;
+    std::atomic<unsigned long long> collapsedOut;
+    std::atomic<unsigned long long> rateLimitedOut;
+    std::atomic<size_t> patternsOut;
+
+    static inline uint64_t mix(uint64_t h, uint64_t v) {
+        h = (h ^ v) * 0x9E3779B97F4A7C15ULL;
+        return h ^ (h >> 29);
+    }
+
+    static inline uint64_t hashSpan(uint64_t h, const char* p, size_t n) {
+        h = mix(h, n);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            uint64_t word;
+            memcpy(&word, p + i, 8);
+            h = mix(h, word);
+        }
+        if (i < n) {
+            uint64_t tail = 0;
+            memcpy(&tail, p + i, n - i);
+            h = mix(h, tail);
+        }
+        return h;
+    }
+
+    static inline bool isDigit(char c) { return (unsigned)(c - '0') < 10u; }
+
+    // Eight bytes at a time: xor with '0' leaves digits as the only bytes under 10.
+    static inline size_t nextDigit(const char* p, size_t i, size_t n) {
+        for (; i + 8 <= n; i += 8) {
+            uint64_t x;
+            memcpy(&x, p + i, 8);
+            x ^= 0x3030303030303030ULL;
+            uint64_t hit = (x - 0x0A0A0A0A0A0A0A0AULL) & ~x & 0x8080808080808080ULL;
+#if defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            // The lowest flag is exact; borrows only spoil the ones above it.
+            if (hit) return i + (__builtin_ctzll(hit) >> 3);
+#else
+            if (hit) break;
+#endif
+        }
+        while (i < n && !isDigit(p[i])) i++;
+        return i;
+    }
+
+    // With numbers ignored the text between digit runs is hashed, so
+    // "attempt 9" and "attempt 10" come out the same.
+    inline uint64_t hashLine(const char* p, size_t n) const {
+        uint64_t h = 0;
+        if (!ignoreNumbers) {
+            h = hashSpan(h, p, n);
+        } else {
+            size_t i = 0;
+            for (;;) {
+                size_t digit = nextDigit(p, i, n);
+                h = hashSpan(h, p + i, digit - i);
+                if (digit == n) break;
+                for (i = digit + 1; i < n && isDigit(p[i]); i++) {}
+            }
+        }
+        return h ? h : 1;
+    }
+
+    Bucket& lookup(uint64_t hash, uint64_t nowNs) {
+        Bucket* set = &table[(hash >> 32) % sets * WAYS];
+        Bucket* victim = set;
+        for (int i = 0; i < WAYS; i++) {
+            if (set[i].hash == hash) return set[i];
+            if (set[i].lastNs < victim->lastNs) victim = &set[i];
+        }
+        if (!victim->hash) patterns++;
+        *victim = Bucket{hash, nowNs, (double)limits[perLine].burst, 0};
+        return *victim;
+    }
+
+    // Takes a token for the line, or counts it against its bucket. A line let
+    // through after others were dropped says how many first.
+    bool allow(const char* p, size_t n, uint64_t hash, uint64_t nowNs, std::string& out) {
+        Bucket* bucket = nullptr;
+        int rule = perLine;
+        for (size_t i = 0; i < limits.size() && !bucket; i++) {
+            const std::string& match = limits[i].match;
+            if (!match.empty() && memmem(p, n, match.data(), match.size())) {
+                bucket = &shared[i];
+                rule = (int)i;
+            }
+        }
+        if (!bucket) {
+            if (perLine < 0) return true;
+            bucket = &lookup(hash, nowNs);
+        }
+
+        const CosRateLimit& limit = limits[rule];
+        double refill = (double)(nowNs - bucket->lastNs) * limit.linesPerSec / 1e9;
+        bucket->tokens = bucket->tokens + refill > limit.burst ? (double)limit.burst : bucket->tokens + refill;
+        bucket->lastNs = nowNs;
+        if (bucket->tokens < 1.0) {
+            bucket->suppressed++;
+            rateLimited++;
+            return false;
+        }
+        bucket->tokens -= 1.0;
+        if (bucket->suppressed) {
+            char note[96];
+            int len = snprintf(note, sizeof(note), "rate limit: %llu lines like the next one suppressed\n",
+                               bucket->suppressed);
+            out.append(note, len);
+            bucket->suppressed = 0;
+        }
+        return true;
+    }
+
+    void endRun(std::string& out) {
+        if (!repeats) return;
+        char note[64];
+        int len = snprintf(note, sizeof(note), "last message repeated %llu time%s\n", repeats,
+                           repeats == 1 ? "" : "s");
+        out.append(note, len);
+        repeats = 0;
+    }
+
+    void line(const char* p, size_t n, uint64_t nowNs, std::string& out) {
+        // Blank lines are layout, not messages.
+        if (n <= 2 && (n == 1 || p[0] == '\r')) {
+            passThrough(p, n, out);
+            return;
+        }
+        uint64_t hash = hashLine(p, n);
+        if (haveLast && hash == lastHash) {
+            if (lastDropped) {
+                // Repeats of a rate-limited line stay dropped and count against it.
+                if (!allow(p, n, hash, nowNs, out)) return;
+            } else if (collapse) {
+                repeats++;
+                collapsed++;
+                lastRepeatNs = nowNs;
+                if (nowNs - runStartNs >= flushNs) {
+                    endRun(out);
+                    runStartNs = nowNs;
+                }
+                return;
+            }
+        } else {
+            endRun(out);
+        }
+        haveLast = true;
+        lastHash = hash;
+        runStartNs = nowNs;
+        lastDropped = !limits.empty() && !allow(p, n, hash, nowNs, out);
+        if (!lastDropped) out.append(p, n);
+    }
+
+    // Text that bypasses the filter ends the current run.
+    void passThrough(const char* p, size_t n, std::string& out) {
+        endRun(out);
+        haveLast = false;
+        out.append(p, n);
+    }
+
+    inline void publish() {
+        collapsedOut.store(collapsed, std::memory_order_relaxed);
+        rateLimitedOut.store(rateLimited, std::memory_order_relaxed);
+        patternsOut.store(patterns, std::memory_order_relaxed);
+    }
+
+public:
+    CosLineFilter() : collapse(false), ignoreNumbers(false), flushNs(0), perLine(-1), sets(0), midLine(false),
+        haveLast(false), lastDropped(false), lastHash(0), runStartNs(0), lastRepeatNs(0), repeats(0), collapsed(0),
+        rateLimited(0), patterns(0), collapsedOut(0), rateLimitedOut(0), patternsOut(0) {}
+
+    // patternSlots bounds the per-line buckets; a run of repeats is summarised
+    // at least every summaryMs while it lasts.
+    void configure(bool collapseRepeats, bool numbersIgnored, const std::vector<CosRateLimit>& rateLimits,
+                   size_t patternSlots, unsigned summaryMs) {
+        collapse = collapseRepeats;
+        ignoreNumbers = numbersIgnored;
+        flushNs = summaryMs ? summaryMs * 1000000ULL : UINT64_MAX;
+        limits.clear();
+        perLine = -1;
+        for (const CosRateLimit& limit : rateLimits) {
+            if (limit.linesPerSec <= 0 && !limit.burst) continue;
+            if (limit.match.empty()) {
+                if (perLine >= 0) continue;
+                perLine = (int)limits.size();
+            }
+            limits.push_back(limit);
+        }
+        shared.assign(limits.size(), Bucket{0, 0, 0, 0});
+        for (size_t i = 0; i < limits.size(); i++) shared[i].tokens = limits[i].burst;
+        sets = perLine >= 0 ? (patternSlots + WAYS - 1) / WAYS : 0;
+        if (perLine >= 0 && !sets) sets = 1;
+        table.assign(sets * WAYS, Bucket{0, 0, 0, 0});
+    }
+
+    inline bool active() const { return collapse || !limits.empty(); }
+    inline bool holding() const { return !partial.empty(); }
+
+    // Appends what is left of data to out. The last line is held back until
+    // its newline arrives or flushPartial() is called.
+    void process(const char* data, size_t len, uint64_t nowNs, std::string& out) {
+        const char* p = data;
+        const char* end = data + len;
+        while (p < end) {
+            const char* newline = static_cast<const char*>(memchr(p, '\n', end - p));
+            const char* stop = newline ? newline + 1 : end;
+            if (midLine) {
+                out.append(p, stop - p);
+                midLine = !newline;
+            } else if (!newline) {
+                if (partial.size() + (stop - p) <= MAX_LINE) {
+                    partial.append(p, stop - p);
+                } else {
+                    passThrough(partial.data(), partial.size(), out);
+                    out.append(p, stop - p);
+                    partial.clear();
+                    midLine = true;
+                }
+            } else if (!partial.empty()) {
+                partial.append(p, stop - p);
+                line(partial.data(), partial.size(), nowNs, out);
+                partial.clear();
+            } else {
+                line(p, stop - p, nowNs, out);
+            }
+            p = stop;
+        }
+        publish();
+    }
+
+    // Lets a held partial line go as it is, for when the writer has gone quiet
+    // (a prompt). The rest of that line is passed on unfiltered.
+    void flushPartial(std::string& out) {
+        if (partial.empty()) return;
+        passThrough(partial.data(), partial.size(), out);
+        partial.clear();
+        midLine = true;
+    }
+
+    // For an idle drain: a run of repeats is summarised once it has been quiet
+    // for QUIET_NS or is summaryMs old, and the next copy is shown again.
+    void tick(uint64_t nowNs, std::string& out) {
+        if (repeats && (nowNs - lastRepeatNs >= QUIET_NS || nowNs - runStartNs >= flushNs)) {
+            endRun(out);
+            haveLast = false;
+        }
+    }
+
+    // Everything still held back, at the end of the capture.
+    void finish(std::string& out) {
+        flushPartial(out);
+        endRun(out);
+    }
+
+    CosDedupStats stats() const {
+        return CosDedupStats{collapsedOut.load(std::memory_order_relaxed),
+                             rateLimitedOut.load(std::memory_order_relaxed),
+                             patternsOut.load(std::memory_order_relaxed)};
+    }
+};
+
+#endif // COS_DEDUP_H
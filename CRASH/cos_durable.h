@@ -0,0 +1,209 @@
+#ifndef COS_DURABLE_H
+#define COS_DURABLE_H
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstdint>
+#include <ctime>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+
+struct CosSyncStats {
+    unsigned long long syncs;
+    unsigned long long errors;
+    unsigned long long maxSyncUs;
+    unsigned long long unsyncedBytes;       // written but not yet on stable storage
+    unsigned long long maxUnsyncedBytes;    // the most a power cut could have taken so far
+    int failedErrno;                        // errno of the sync that failed; no later one is trusted
+};
+
+// fdatasync()s the log on a thread of its own, so the drain never waits on
+// the disk. Periodic syncs every intervalMs while anything is unsynced. Group
+// commit opens a window at the first unsynced write and syncs once groupBytes
+// are pending or intervalMs have passed, one fdatasync() for every write in
+// between. The drain only reports progress through the log byte counter and
+// calls wrote(), which is a load and a compare unless a window opens or fills.
+class CosLogSync {
+private:
+    int fd;
+    const std::atomic<unsigned long long>* written;
+    std::function<void()> beforeSync;
+    unsigned intervalMs;
+    unsigned long long groupBytes;
+    bool group;
+
+    std::mutex lock;
+    std::mutex syncLock;
+    std::condition_variable wake;
+    std::atomic<bool> sleeping;
+    std::atomic<bool> idle;                 // nothing unsynced when the thread went to sleep
+    std::atomic<bool> running;
+    pthread_t thread;
+    bool started;
+
+    std::atomic<unsigned long long> synced;
+    std::atomic<unsigned long long> syncs;
+    std::atomic<unsigned long long> errors;
+    std::atomic<unsigned long long> maxSyncUs;
+    std::atomic<unsigned long long> maxUnsynced;
+    std::atomic<int> failedErrno;
+
+    static inline unsigned long long nowUs() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (unsigned long long)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+    }
+
+    // macOS has no fdatasync(); F_FULLFSYNC also flushes the drive's cache, which fsync() there does not.
+    static inline int dataSync(int fd) {
+#ifdef __APPLE__
+        return fcntl(fd, F_FULLFSYNC) == 0 ? 0 : fsync(fd);
+#else
+        return fdatasync(fd);
+#endif
+    }
+
+    inline unsigned long long pending() const {
+        return written->load(std::memory_order_relaxed) - synced.load(std::memory_order_relaxed);
+    }
+
+    void run() {
+        unsigned long long windowUs = 0;    // when unsynced bytes were first seen
+        unsigned long long lastUs = nowUs();
+        while (running.load(std::memory_order_acquire) && !failedErrno.load(std::memory_order_relaxed)) {
+            unsigned long long now = nowUs();
+            unsigned long long due = 0;
+            if (pending()) {
+                if (!windowUs) windowUs = now;
+                due = (group ? windowUs : lastUs) + intervalMs * 1000ULL;
+                if (now >= due || (group && pending() >= groupBytes)) {
+                    sync();
+                    lastUs = nowUs();
+                    windowUs = 0;
+                    continue;
+                }
+            }
+
+            std::unique_lock<std::mutex> guard(lock);
+            idle.store(!due, std::memory_order_relaxed);
+            sleeping.store(true);
+            if (running.load() && (due || !pending())) {
+                unsigned long long waitUs = due ? due - now : intervalMs * 1000ULL;
+                wake.wait_for(guard, std::chrono::microseconds(waitUs));
+            }
+            sleeping.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    static void* threadFunc(void* arg) {
+        static_cast<CosLogSync*>(arg)->run();
+        return nullptr;
+    }
+
+public:
+    CosLogSync() : fd(-1), written(nullptr), intervalMs(0), groupBytes(0), group(false), sleeping(false),
+        idle(false), running(false), started(false), synced(0), syncs(0), errors(0), maxSyncUs(0), maxUnsynced(0),
+        failedErrno(0) {}
+
+    ~CosLogSync() { stop(false); }
+
+    // Takes ownership of target. counter is the log's byte count; before runs
+    // ahead of each sync (copying a memfd log out to the file, say). Without
+    // intervalMs no thread is started and only sync() calls go to the disk.
+    bool start(int target, const std::atomic<unsigned long long>& counter, std::function<void()> before,
+               unsigned syncMs, unsigned long long syncBytes, bool groupCommit) {
+        if (fd != -1 || target == -1) return false;
+        fd = target;
+        written = &counter;
+        beforeSync = std::move(before);
+        synced.store(counter.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        intervalMs = syncMs ? syncMs : 1;
+        groupBytes = syncBytes ? syncBytes : ~0ULL;
+        group = groupCommit;
+        if (!syncMs && !groupCommit) return true;
+
+        running.store(true, std::memory_order_release);
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setstacksize(&attr, 64 * 1024);
+        started = pthread_create(&thread, &attr, threadFunc, this) == 0;
+        pthread_attr_destroy(&attr);
+        return started;
+    }
+
+    inline bool active() const { return fd != -1; }
+
+    // Drain thread, after log bytes went out.
+    inline void wrote() {
+        if (!group || !sleeping.load(std::memory_order_relaxed)) return;
+        if (!idle.load(std::memory_order_relaxed) && pending() < groupBytes) return;
+        if (sleeping.exchange(false)) {
+            std::lock_guard<std::mutex> guard(lock);
+            wake.notify_one();
+        }
+    }
+
+    // Everything the counter showed on entry is on stable storage when this
+    // returns true. Called by the thread, on a crash and at exit. A failed
+    // fdatasync() is final: the kernel may already have dropped the dirty
+    // pages, so a later success proves nothing about them and the thread stops.
+    bool sync() {
+        std::lock_guard<std::mutex> guard(syncLock);
+        if (fd == -1 || failedErrno.load(std::memory_order_relaxed)) return false;
+        unsigned long long target = written->load(std::memory_order_acquire);
+        unsigned long long behind = target - synced.load(std::memory_order_relaxed);
+        if (behind > maxUnsynced.load(std::memory_order_relaxed))
+            maxUnsynced.store(behind, std::memory_order_relaxed);
+        if (beforeSync) beforeSync();
+
+        unsigned long long t0 = nowUs();
+        int rc;
+        while ((rc = dataSync(fd)) != 0 && errno == EINTR) {}
+        unsigned long long took = nowUs() - t0;
+        syncs.fetch_add(1, std::memory_order_relaxed);
+        if (took > maxSyncUs.load(std::memory_order_relaxed)) maxSyncUs.store(took, std::memory_order_relaxed);
+        if (rc != 0) {
+            failedErrno.store(errno ? errno : EIO, std::memory_order_relaxed);
+            errors.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        synced.store(target, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Stops the thread; a last sync if asked, once the drain is done.
+    void stop(bool finalSync) {
+        if (started) {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                running.store(false, std::memory_order_release);
+                wake.notify_one();
+            }
+            pthread_join(thread, nullptr);
+            started = false;
+        }
+        if (finalSync) sync();
+        std::lock_guard<std::mutex> guard(syncLock);
+        if (fd != -1) close(fd);
+        fd = -1;
+    }
+
+    CosSyncStats stats() const {
+        return CosSyncStats{syncs.load(std::memory_order_relaxed), errors.load(std::memory_order_relaxed),
+                            maxSyncUs.load(std::memory_order_relaxed), written ? pending() : 0,
+                            maxUnsynced.load(std::memory_order_relaxed), failedErrno.load(std::memory_order_relaxed)};
+    }
+
+    CosLogSync(const CosLogSync&) = delete;
+    CosLogSync& operator=(const CosLogSync&) = delete;
+};
+
+#endif // _WIN32
+
+#endif // COS_DURABLE_H
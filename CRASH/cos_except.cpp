@@ -0,0 +1,19 @@
+#include "cos_except.h"
+
+#ifdef __linux__
+#include <dlfcn.h>
+
+// Exporting __cxa_throw from libcrash puts this hook in front of libstdc++'s
+// for every throw in the process; the real one is found behind it.
+extern "C" void __cxa_throw(void* object, std::type_info* type, void (*destructor)(void*)) {
+    using Throw = void (*)(void*, std::type_info*, void (*)(void*));
+    static Throw real = reinterpret_cast<Throw>(dlsym(RTLD_NEXT, "__cxa_throw"));
+    CosExceptions::onThrow(type);
+    real(object, type, destructor);
+    __builtin_unreachable();
+}
+
+static struct CosExceptInstaller {
+    CosExceptInstaller() { CosExceptions::markHooked(); }
+} cosExceptInstaller;
+#endif
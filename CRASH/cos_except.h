@@ -0,0 +1,139 @@
+#ifndef COS_EXCEPT_H
+#define COS_EXCEPT_H
+
+#ifdef __linux__
+#include "cos_unwind.h"
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <string>
+#include <typeinfo>
+#include <cxxabi.h>
+#include <execinfo.h>
+
+// The exception std::terminate was called for.
+struct CosUncaught {
+    std::string type;
+    std::string what;
+    std::string throwSite;
+};
+
+// Uncaught exception capture. The terminate handler records the type and
+// what() of the active exception before the abort turns it into a bare
+// SIGABRT. With cos_except.cpp built into libcrash (TRIG_THROW_CAPTURE) every
+// throw also leaves its type and a CosUnwind stack in a thread-local
+// slot, so the report shows where the exception was thrown rather than the
+// stack of std::terminate.
+class CosExceptions {
+public:
+    static const int MAX_DEPTH = 32;
+
+private:
+    struct Slot {
+        const std::type_info* type;
+        int depth;
+        void* frames[MAX_DEPTH];
+    };
+
+    struct State {
+        std::atomic<bool> installed{false};
+        std::atomic<bool> hooked{false};
+        std::atomic<bool> captured{false};
+        std::terminate_handler previous = nullptr;
+        CosUncaught uncaught;
+    };
+
+    static inline State& state() {
+        static State s;
+        return s;
+    }
+
+    // Static TLS: a throw never allocates to find its slot.
+    static inline Slot& slot() {
+        static __thread Slot s __attribute__((tls_model("initial-exec")));
+        return s;
+    }
+
+    static std::string demangle(const char* name) {
+        int status = 0;
+        char* demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+        std::string result = status == 0 && demangled ? demangled : name;
+        free(demangled);
+        return result;
+    }
+
+    static std::string symbolize(void** frames, int depth) {
+        std::string result;
+        char** symbols = backtrace_symbols(frames, depth);
+        if (symbols) {
+            for (int i = 0; i < depth; i++) {
+                result += symbols[i];
+                result += "\n";
+            }
+            free(symbols);
+        }
+        return result;
+    }
+
+    static void onTerminate() {
+        State& s = state();
+        std::exception_ptr current = std::current_exception();
+        if (current && !s.captured.load(std::memory_order_acquire)) {
+            const std::type_info* type = abi::__cxa_current_exception_type();
+            s.uncaught.type = type ? demangle(type->name()) : "unknown";
+            try {
+                std::rethrow_exception(current);
+            } catch (const std::exception& e) {
+                s.uncaught.what = e.what();
+            } catch (...) {
+            }
+
+            // "throw;" and rethrow_exception bypass __cxa_throw, so the slot still holds the original site.
+            Slot& site = slot();
+            if (type && site.type && *site.type == *type)
+                s.uncaught.throwSite = symbolize(site.frames, site.depth);
+            s.captured.store(true, std::memory_order_release);
+        }
+
+        if (s.previous) s.previous();
+        std::abort();
+    }
+
+public:
+    // Called by the interposed __cxa_throw before the exception is raised.
+    static inline void onThrow(const std::type_info* type) {
+        Slot& s = slot();
+        s.type = type;
+        s.depth = CosUnwind::stack(s.frames, MAX_DEPTH, 1);
+    }
+
+    // Set by cos_except.cpp once its __cxa_throw is linked in.
+    static inline void markHooked() { state().hooked.store(true, std::memory_order_release); }
+    static inline bool hooked() { return state().hooked.load(std::memory_order_acquire); }
+
+    static void install() {
+        State& s = state();
+        if (s.installed.exchange(true, std::memory_order_acq_rel)) return;
+        CosUnwind::init();
+        s.previous = std::set_terminate(onTerminate);
+    }
+
+    // Filled in only on the thread that called std::terminate, before it aborts.
+    static inline const CosUncaught* uncaught() {
+        State& s = state();
+        return s.captured.load(std::memory_order_acquire) ? &s.uncaught : nullptr;
+    }
+
+    static std::string format(const CosUncaught& u) {
+        std::string result = "type:   " + u.type + "\n";
+        if (!u.what.empty()) result += "what(): " + u.what + "\n";
+        if (!u.throwSite.empty()) result += "thrown at:\n" + u.throwSite;
+        else if (!hooked()) result += "(throw site needs libcrash built with TRIG_THROW_CAPTURE)\n";
+        return result;
+    }
+};
+
+#endif // __linux__
+
+#endif // COS_EXCEPT_H
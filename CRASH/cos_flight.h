@@ -0,0 +1,98 @@
+#ifndef COS_FLIGHT_H
+#define COS_FLIGHT_H
+
+#include "cos_rings.h"
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// One flight recorder event after the merge; name is the literal from the call site.
+struct CosFlightRecord {
+    double seconds;
+    int tid;
+    const char* name;
+    uint64_t a;
+    uint64_t b;
+};
+
+// Always-on flight recorder. Each thread appends fixed 32-byte events to its
+// own ring and overwrites the oldest; nothing is ever flushed. After a crash
+// the rings are merged by timestamp to show what every thread did last.
+class CosFlight {
+public:
+    static constexpr size_t RING_EVENTS = 2048;
+
+    template <typename A = uint64_t, typename B = uint64_t>
+    static inline void record(const char* name, A a = 0, B b = 0) {
+        Rings::Ring* ring = Rings::local();
+        uint64_t h = ring->head.load(std::memory_order_relaxed);
+        Event& e = ring->entries[h & (RING_EVENTS - 1)];
+        e.ticks = CosLog::ticks();
+        e.name = name;
+        e.a = word(a);
+        e.b = word(b);
+        ring->head.store(h + 1, std::memory_order_release);
+    }
+
+    static inline bool active() { return Rings::instance().active.load(std::memory_order_acquire); }
+
+    // The newest maxEvents across all threads, oldest first. Safe from a crash
+    // handler as long as the crashing thread is not inside record() itself.
+    static std::vector<CosFlightRecord> snapshot(size_t maxEvents) {
+        std::vector<CosFlightRecord> out;
+        if (!active()) return out;
+
+        Rings& reg = Rings::instance();
+        std::unique_lock<std::mutex> guard(reg.lock, std::try_to_lock);
+        if (!guard.owns_lock()) return out;
+
+        double rate = reg.nsPerTick();
+        for (Rings::Ring* r : reg.rings) {
+            Rings::copy(r, out, [&](const Event& e) {
+                double seconds = e.ticks > reg.epochTicks ? (e.ticks - reg.epochTicks) * rate / 1e9 : 0.0;
+                return CosFlightRecord{seconds, r->tid, e.name, e.a, e.b};
+            });
+        }
+
+        std::sort(out.begin(), out.end(),
+                  [](const CosFlightRecord& x, const CosFlightRecord& y) { return x.seconds < y.seconds; });
+        if (maxEvents && out.size() > maxEvents) out.erase(out.begin(), out.end() - maxEvents);
+        return out;
+    }
+
+    static std::string format(const std::vector<CosFlightRecord>& events) {
+        std::string out;
+        char line[192];
+        for (const CosFlightRecord& e : events) {
+            snprintf(line, sizeof(line), "[+%.6f] %-7d %-32s %llu %llu\n", e.seconds, e.tid,
+                     e.name ? e.name : "?", (unsigned long long)e.a, (unsigned long long)e.b);
+            out += line;
+        }
+        return out;
+    }
+
+private:
+    struct Event {
+        uint64_t ticks;
+        const char* name;
+        uint64_t a;
+        uint64_t b;
+    };
+
+    typedef CosThreadRings<Event, RING_EVENTS> Rings;
+
+    template <typename T>
+    static inline uint64_t word(T v) {
+        if constexpr (std::is_pointer_v<T>) return (uint64_t)reinterpret_cast<uintptr_t>(v);
+        else if constexpr (std::is_enum_v<T>) return (uint64_t)static_cast<std::underlying_type_t<T>>(v);
+        else return (uint64_t)v;
+    }
+};
+
+// name must be a string literal; a and b are integers, enums or pointers.
+#define COS_FLIGHT(name, ...) CosFlight::record("" name, ##__VA_ARGS__)
+
+#endif // COS_FLIGHT_H
@@ -0,0 +1,84 @@
+#include "cos_heap.h"
+
+#ifdef __linux__
+#include <cerrno>
+#include <malloc.h>
+
+// glibc's own entry points; exporting malloc and friends from libcrash puts
+// these hooks in front of libc for the whole process.
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* ptr);
+
+void* malloc(size_t size) {
+    void* p = __libc_malloc(size);
+    CosHeapProfiler::onAlloc(p, size);
+    return p;
+}
+
+void* calloc(size_t count, size_t size) {
+    void* p = __libc_calloc(count, size);
+    CosHeapProfiler::onAlloc(p, count * size);
+    return p;
+}
+
+// The old sample comes off first: once ptr is released another thread may be
+// handed the address and sample it. A failed realloc leaves ptr allocated, so
+// it gets its sample back; realloc(ptr, 0) frees it.
+void* realloc(void* ptr, size_t size) {
+    CosHeapProfiler::Sample sample;
+    bool sampled = CosHeapProfiler::take(ptr, &sample);
+    void* p = __libc_realloc(ptr, size);
+    if (!p && size) {
+        if (sampled) CosHeapProfiler::restore(ptr, sample);
+        return p;
+    }
+    CosHeapProfiler::onAlloc(p, size);
+    return p;
+}
+
+// Ours as well, so it reaches the hook above however libc implements it.
+void* reallocarray(void* ptr, size_t count, size_t size) {
+    size_t bytes;
+    if (__builtin_mul_overflow(count, size, &bytes)) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    return realloc(ptr, bytes);
+}
+
+void free(void* ptr) {
+    CosHeapProfiler::onFree(ptr);
+    __libc_free(ptr);
+}
+
+void* memalign(size_t alignment, size_t size) {
+    void* p = __libc_memalign(alignment, size);
+    CosHeapProfiler::onAlloc(p, size);
+    return p;
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+    return memalign(alignment, size);
+}
+
+int posix_memalign(void** out, size_t alignment, size_t size) {
+    if (alignment < sizeof(void*) || (alignment & (alignment - 1))) return EINVAL;
+    void* p = memalign(alignment, size);
+    if (!p && size) return ENOMEM;
+    *out = p;
+    return 0;
+}
+
+void* valloc(size_t size) {
+    return memalign(sysconf(_SC_PAGESIZE), size);
+}
+}
+
+static struct CosHeapInstaller {
+    CosHeapInstaller() { CosHeapProfiler::markInstalled(); }
+} cosHeapInstaller;
+#endif
@@ -0,0 +1,305 @@
+#ifndef COS_HEAP_H
+#define COS_HEAP_H
+
+#ifdef __linux__
+#include "cos_sampler.h"
+#include <atomic>
+#include <cmath>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <execinfo.h>
+
+struct CosHeapStats {
+    unsigned long long sampled;
+    unsigned long long liveSamples;
+    unsigned long long liveBytesEstimate;
+    unsigned long long tableFull;
+};
+
+// Poisson-sampling heap profiler. The malloc family is interposed by
+// cos_heap.cpp (built into libcrash with TRIG_HEAP_PROFILER); every allocation
+// only decrements a thread-local byte countdown, and when it runs out the
+// allocation's stack is recorded in a live table until it is freed. Each
+// sample stands for sampleBytes of allocation on average, so live bytes per
+// site are an unbiased estimate of the real live heap.
+class CosHeapProfiler {
+public:
+    static const int MAX_DEPTH = 32;
+    static const int LIVE_SLOTS = 1 << 16;
+    static const int STACK_SLOTS = 1 << 12;
+
+private:
+    struct Live {
+        std::atomic<uintptr_t> ptr{0};
+        size_t size = 0;
+        unsigned long long weight = 0;
+        int stack = -1;
+    };
+
+    struct Stack {
+        std::atomic<bool> used{false};
+        unsigned long long hash = 0;
+        int depth = 0;
+        void* frames[MAX_DEPTH] = {};
+    };
+
+    struct State {
+        std::atomic<bool> installed{false};
+        std::atomic<bool> enabled{false};
+        std::atomic<size_t> meanBytes{0};
+        std::atomic<unsigned long long> sampled{0};
+        std::atomic<long long> liveSamples{0};
+        std::atomic<unsigned long long> tableFull{0};
+        std::atomic_flag stackLock = ATOMIC_FLAG_INIT;
+        // Live samples per home slot: most frees stop at this 64 KiB array
+        // instead of missing the cache on the 2 MiB table.
+        std::atomic<unsigned char> homeCount[LIVE_SLOTS] = {};
+        Live live[LIVE_SLOTS];
+        Stack stacks[STACK_SLOTS];
+    };
+
+    // Slot keys below LIVE_MIN are markers: empty, freed, or being filled in.
+    static const uintptr_t TOMBSTONE = 1;
+    static const uintptr_t CLAIMED = 2;
+    static const uintptr_t LIVE_MIN = 3;
+
+    // Constant-initialized into .bss: untouched pages cost nothing while disabled.
+    static inline State& state() {
+        static State s;
+        return s;
+    }
+
+    // Static TLS so the hooks never allocate to find their own counters.
+    static inline long long& countdown() {
+        static __thread long long value __attribute__((tls_model("initial-exec"))) = 0;
+        return value;
+    }
+
+    static inline bool& inHook() {
+        static __thread bool value __attribute__((tls_model("initial-exec"))) = false;
+        return value;
+    }
+
+    static inline unsigned long long& rng() {
+        static __thread unsigned long long value __attribute__((tls_model("initial-exec"))) = 0;
+        return value;
+    }
+
+    static inline size_t slotFor(uintptr_t p) {
+        return (size_t)((p >> 4) * 0x9E3779B97F4A7C15ULL >> 48) & (LIVE_SLOTS - 1);
+    }
+
+    // Exponential with the configured mean, from a per-thread xorshift.
+    static long long nextInterval(size_t mean) {
+        unsigned long long& x = rng();
+        if (!x) x = reinterpret_cast<uintptr_t>(&x) ^ 0x2545F4914F6CDD1DULL;
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        double u = ((x >> 11) + 0.5) / 9007199254740992.0;
+        return (long long)(-std::log(u) * mean) + 1;
+    }
+
+    static int internStack(void** frames, int depth) {
+        unsigned long long hash = 1469598103934665603ULL;
+        for (int i = 0; i < depth; i++) hash = (hash ^ reinterpret_cast<uintptr_t>(frames[i])) * 1099511628211ULL;
+
+        State& s = state();
+        while (s.stackLock.test_and_set(std::memory_order_acquire)) {}
+        int found = -1;
+        for (int probe = 0; probe < STACK_SLOTS; probe++) {
+            Stack& st = s.stacks[(hash + probe) & (STACK_SLOTS - 1)];
+            if (!st.used.load(std::memory_order_relaxed)) {
+                st.hash = hash;
+                st.depth = depth;
+                memcpy(st.frames, frames, depth * sizeof(void*));
+                st.used.store(true, std::memory_order_release);
+                found = (int)((hash + probe) & (STACK_SLOTS - 1));
+                break;
+            }
+            if (st.hash == hash && st.depth == depth && memcmp(st.frames, frames, depth * sizeof(void*)) == 0) {
+                found = (int)((hash + probe) & (STACK_SLOTS - 1));
+                break;
+            }
+        }
+        s.stackLock.clear(std::memory_order_release);
+        return found;
+    }
+
+    static void recordSample(void* p, size_t size, size_t mean) {
+        State& s = state();
+        void* frames[MAX_DEPTH];
+        int depth = CosUnwind::stack(frames, MAX_DEPTH, 2);
+        int stack = internStack(frames, depth);
+
+        // Small allocations stand for a whole interval; large ones mostly for themselves.
+        double ratio = (double)size / mean;
+        unsigned long long weight = ratio > 1e-6 ? (unsigned long long)(size / (1.0 - std::exp(-ratio))) : mean;
+
+        if (insert(reinterpret_cast<uintptr_t>(p), size, weight, stack))
+            s.sampled.fetch_add(1, std::memory_order_relaxed);
+        else
+            s.tableFull.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static bool insert(uintptr_t key, size_t size, unsigned long long weight, int stack) {
+        State& s = state();
+        size_t slot = slotFor(key);
+        for (int probe = 0; probe < 64; probe++) {
+            Live& l = s.live[(slot + probe) & (LIVE_SLOTS - 1)];
+            uintptr_t seen = l.ptr.load(std::memory_order_relaxed);
+            if (seen > TOMBSTONE || !l.ptr.compare_exchange_strong(seen, CLAIMED, std::memory_order_acquire)) continue;
+            l.size = size;
+            l.weight = weight;
+            l.stack = stack;
+            l.ptr.store(key, std::memory_order_release);
+            s.homeCount[slot].fetch_add(1, std::memory_order_relaxed);
+            s.liveSamples.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+public:
+    // A sample lifted off a block, for realloc() to put back if it fails.
+    struct Sample {
+        size_t size = 0;
+        unsigned long long weight = 0;
+        int stack = -1;
+    };
+
+    // Called by the interposed malloc family after the real allocation.
+    static inline void onAlloc(void* p, size_t size) {
+        State& s = state();
+        if (!p || !s.enabled.load(std::memory_order_relaxed)) return;
+        long long& left = countdown();
+        left -= (long long)size;
+        if (left > 0) return;
+
+        bool& busy = inHook();
+        if (busy) return;
+        busy = true;
+        size_t mean = s.meanBytes.load(std::memory_order_relaxed);
+        left = nextInterval(mean);
+        recordSample(p, size, mean);
+        busy = false;
+    }
+
+    // Called before the real free; unsampled pointers almost always stop at homeCount.
+    static inline void onFree(void* p) { take(p, nullptr); }
+
+    // Drops p's sample, if it has one, copying it to *out first.
+    static inline bool take(void* p, Sample* out) {
+        State& s = state();
+        if (!p || s.liveSamples.load(std::memory_order_relaxed) <= 0) return false;
+        uintptr_t key = reinterpret_cast<uintptr_t>(p);
+        size_t slot = slotFor(key);
+        if (!s.homeCount[slot].load(std::memory_order_relaxed)) return false;
+        for (int probe = 0; probe < 64; probe++) {
+            Live& l = s.live[(slot + probe) & (LIVE_SLOTS - 1)];
+            uintptr_t seen = l.ptr.load(std::memory_order_acquire);
+            if (!seen) return false;
+            if (seen != key) continue;
+            // Read before the CAS: once the slot is a tombstone another sample may claim it.
+            if (out) {
+                out->size = l.size;
+                out->weight = l.weight;
+                out->stack = l.stack;
+            }
+            if (l.ptr.compare_exchange_strong(seen, TOMBSTONE, std::memory_order_acq_rel)) {
+                s.homeCount[slot].fetch_sub(1, std::memory_order_relaxed);
+                s.liveSamples.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Gives p back a sample take() lifted off it; p must still be allocated.
+    static inline void restore(void* p, const Sample& sample) {
+        if (!insert(reinterpret_cast<uintptr_t>(p), sample.size, sample.weight, sample.stack))
+            state().tableFull.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Set by cos_heap.cpp once its hooks are linked in.
+    static inline void markInstalled() { state().installed.store(true, std::memory_order_release); }
+    static inline bool installed() { return state().installed.load(std::memory_order_acquire); }
+
+    static bool start(size_t sampleBytes) {
+        State& s = state();
+        if (!sampleBytes || !installed()) return false;
+        CosUnwind::init();
+        s.meanBytes.store(sampleBytes, std::memory_order_relaxed);
+        s.enabled.store(true, std::memory_order_release);
+        return true;
+    }
+
+    static inline void stop() { state().enabled.store(false, std::memory_order_release); }
+    static inline bool running() { return state().enabled.load(std::memory_order_acquire); }
+
+    static CosHeapStats stats() {
+        State& s = state();
+        CosHeapStats st;
+        st.sampled = s.sampled.load(std::memory_order_relaxed);
+        long long live = s.liveSamples.load(std::memory_order_relaxed);
+        st.liveSamples = live > 0 ? (unsigned long long)live : 0;
+        st.tableFull = s.tableFull.load(std::memory_order_relaxed);
+        st.liveBytesEstimate = 0;
+        for (const Live& l : s.live) {
+            if (l.ptr.load(std::memory_order_acquire) >= LIVE_MIN) st.liveBytesEstimate += l.weight;
+        }
+        return st;
+    }
+
+    // Live heap by allocation site, as collapsed stacks weighted in estimated
+    // bytes ("root;...;allocator bytes"), largest first; maxSites 0 means all.
+    static std::string collapsed(size_t maxSites = 0) {
+        State& s = state();
+        std::unordered_map<int, unsigned long long> bytesByStack;
+        for (const Live& l : s.live) {
+            if (l.ptr.load(std::memory_order_acquire) >= LIVE_MIN && l.stack >= 0) bytesByStack[l.stack] += l.weight;
+        }
+
+        std::vector<void*> addrs;
+        for (const auto& entry : bytesByStack) {
+            const Stack& st = s.stacks[entry.first];
+            for (int i = 0; i < st.depth; i++) addrs.push_back(static_cast<char*>(st.frames[i]) - 1);
+        }
+        std::unordered_map<void*, std::string> names;
+        if (!addrs.empty()) {
+            char** symbols = backtrace_symbols(addrs.data(), (int)addrs.size());
+            if (symbols) {
+                for (size_t i = 0; i < addrs.size(); i++) names.emplace(addrs[i], CosSampler::symbolName(symbols[i]));
+                free(symbols);
+            }
+        }
+
+        std::unordered_map<std::string, unsigned long long> folded;
+        for (const auto& entry : bytesByStack) {
+            const Stack& st = s.stacks[entry.first];
+            std::string line;
+            for (int i = st.depth; i-- > 0;) {
+                auto it = names.find(static_cast<char*>(st.frames[i]) - 1);
+                if (!line.empty()) line += ";";
+                line += it != names.end() ? it->second : std::string("?");
+            }
+            folded[line] += entry.second;
+        }
+
+        std::vector<std::pair<unsigned long long, std::string>> lines;
+        for (const auto& entry : folded) lines.emplace_back(entry.second, entry.first);
+        std::sort(lines.begin(), lines.end(),
+                  [](const auto& a, const auto& b) { return a.first > b.first; });
+        if (maxSites && lines.size() > maxSites) lines.resize(maxSites);
+
+        std::string out;
+        for (const auto& l : lines) out += l.second + " " + std::to_string(l.first) + "\n";
+        return out;
+    }
+};
+
+#endif // __linux__
+
+#endif // COS_HEAP_H
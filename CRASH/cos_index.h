@@ -0,0 +1,299 @@
+#ifndef COS_INDEX_H
+#define COS_INDEX_H
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// Sidecar index of a COS log ("<log>.idx"): a 32-byte header, then fixed-size
+// entries in log order. An entry marks a point between two drain batches; the
+// offset may fall inside a line, and line counts the newlines before it.
+struct CosIndexHeader {
+    static const uint32_t VERSION = 1;
+
+    char magic[8];          // "COSIDX\0\0"
+    uint32_t version;
+    uint32_t entrySize;
+    uint64_t startMonoNs;
+    uint64_t startWallNs;
+};
+
+struct CosIndexEntry {
+    uint64_t monoNs;
+    uint64_t wallNs;
+    uint64_t offset;
+    uint64_t line;
+};
+
+static_assert(sizeof(CosIndexHeader) == 32 && sizeof(CosIndexEntry) == 32, "index layout is on disk");
+
+// Driven by the drain thread after each log write. Entries are kept in memory
+// and appended 64 at a time, or once the last write is everyMs old.
+class CosIndexWriter {
+private:
+    static const int PENDING = 64;
+
+    int fd;
+    uint64_t everyBytes;
+    uint64_t everyNs;
+    uint64_t offset;
+    uint64_t line;
+    uint64_t lastOffset;
+    uint64_t lastNs;
+    uint64_t flushedNs;
+    CosIndexEntry pending[PENDING];
+    int count;
+
+    static inline uint64_t clockNs(clockid_t clock) {
+        struct timespec ts;
+        clock_gettime(clock, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    }
+
+    // Pacing only needs milliseconds; the coarse clock skips the TSC read.
+    static inline uint64_t tickNs() {
+#ifdef CLOCK_MONOTONIC_COARSE
+        return clockNs(CLOCK_MONOTONIC_COARSE);
+#else
+        return clockNs(CLOCK_MONOTONIC);
+#endif
+    }
+
+public:
+    CosIndexWriter() : fd(-1), everyBytes(0), everyNs(0), offset(0), line(0), lastOffset(0),
+        lastNs(0), flushedNs(0), count(0) {}
+    ~CosIndexWriter() { close(); }
+
+    // offset and line describe what the log already holds (its header).
+    bool open(const std::string& path, size_t bytes, unsigned ms, uint64_t startOffset, uint64_t startLine) {
+        close();
+        if (!bytes && !ms) return false;
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd == -1) return false;
+
+        everyBytes = bytes ? bytes : UINT64_MAX;
+        everyNs = ms ? ms * 1000000ULL : UINT64_MAX;
+        offset = lastOffset = startOffset;
+        line = startLine;
+
+        CosIndexHeader header = {};
+        memcpy(header.magic, "COSIDX\0\0", 8);
+        header.version = CosIndexHeader::VERSION;
+        header.entrySize = sizeof(CosIndexEntry);
+        header.startMonoNs = clockNs(CLOCK_MONOTONIC);
+        header.startWallNs = clockNs(CLOCK_REALTIME);
+        lastNs = flushedNs = tickNs();
+        if (::write(fd, &header, sizeof(header)) != (ssize_t)sizeof(header)) {
+            close();
+            return false;
+        }
+        pending[0] = CosIndexEntry{header.startMonoNs, header.startWallNs, offset, line};
+        count = 1;
+        return true;
+    }
+
+    inline bool active() const { return fd != -1; }
+
+    // bytes and lines just written to the log; (0, 0) from an idle drain still
+    // gets buffered entries out after everyMs.
+    inline void advance(size_t bytes, unsigned long long lines) {
+        if (fd == -1) return;
+        offset += bytes;
+        line += lines;
+        if (offset - lastOffset < everyBytes) {
+            if (everyNs == UINT64_MAX) return;
+            uint64_t now = tickNs();
+            if (now - lastNs < everyNs) return;
+            mark(now);
+        } else {
+            mark(tickNs());
+        }
+    }
+
+    void mark(uint64_t now) {
+        lastNs = now;
+        if (offset == lastOffset) {
+            if (count && now - flushedNs >= everyNs) flush();
+            return;
+        }
+        pending[count++] = CosIndexEntry{clockNs(CLOCK_MONOTONIC), clockNs(CLOCK_REALTIME), offset, line};
+        lastOffset = offset;
+        if (count == PENDING || now - flushedNs >= everyNs) flush();
+    }
+
+    // Plain write(), so the crash handler may call it too.
+    void flush() {
+        if (fd == -1 || !count) return;
+        ssize_t n = ::write(fd, pending, count * sizeof(CosIndexEntry));
+        (void)n;
+        count = 0;
+        flushedNs = lastNs;
+    }
+
+    void close() {
+        if (fd == -1) return;
+        mark(tickNs());
+        flush();
+        ::close(fd);
+        fd = -1;
+    }
+};
+
+struct CosLogPosition {
+    uint64_t offset;
+    uint64_t line;      // 0-based
+};
+
+// Reads an index back for O(log n) seeks into its log. A log without an index
+// (or with a truncated one) still works; the seek just starts from the top.
+class CosLogIndex {
+private:
+    std::string logPath;
+    CosIndexHeader header;
+    std::vector<CosIndexEntry> entries;
+
+    // Moves pos from an entry to the start of the next whole line.
+    bool alignToLine(int fd, CosLogPosition& pos) const {
+        if (pos.offset == 0) return true;
+        char c;
+        if (pread(fd, &c, 1, pos.offset - 1) == 1 && c == '\n') return true;
+        return skipLines(fd, pos, 1);
+    }
+
+    // Advances pos past n newlines; false at end of file.
+    static bool skipLines(int fd, CosLogPosition& pos, uint64_t n) {
+        char buffer[64 * 1024];
+        while (n) {
+            ssize_t got = pread(fd, buffer, sizeof(buffer), pos.offset);
+            if (got <= 0) return false;
+            const char* p = buffer;
+            const char* end = buffer + got;
+            while (n && (p = static_cast<const char*>(memchr(p, '\n', end - p)))) {
+                p++;
+                n--;
+                pos.line++;
+            }
+            pos.offset += n ? (uint64_t)got : (uint64_t)(p - buffer);
+        }
+        return true;
+    }
+
+    // Advances pos to offset, counting the newlines passed.
+    static bool skipTo(int fd, CosLogPosition& pos, uint64_t offset) {
+        char buffer[64 * 1024];
+        while (pos.offset < offset) {
+            size_t want = offset - pos.offset < sizeof(buffer) ? (size_t)(offset - pos.offset) : sizeof(buffer);
+            ssize_t got = pread(fd, buffer, want, pos.offset);
+            if (got <= 0) return false;
+            const char* p = buffer;
+            const char* end = buffer + got;
+            while ((p = static_cast<const char*>(memchr(p, '\n', end - p)))) {
+                p++;
+                pos.line++;
+            }
+            pos.offset += (uint64_t)got;
+        }
+        return true;
+    }
+
+public:
+    CosLogIndex() : header() {}
+
+    static std::string pathFor(const std::string& log) {
+        std::string path = log;
+        if (path.size() > 4 && path.compare(path.size() - 4, 4, ".log") == 0) path.resize(path.size() - 4);
+        return path + ".idx";
+    }
+
+    bool open(const std::string& log) {
+        logPath = log;
+        entries.clear();
+        int fd = ::open(pathFor(log).c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) return false;
+
+        struct stat st;
+        bool ok = fstat(fd, &st) == 0 && read(fd, &header, sizeof(header)) == (ssize_t)sizeof(header) &&
+                  memcmp(header.magic, "COSIDX\0\0", 8) == 0 && header.version == CosIndexHeader::VERSION &&
+                  header.entrySize == sizeof(CosIndexEntry);
+        if (ok) {
+            // A crash can leave a partial entry at the end.
+            entries.resize((st.st_size - sizeof(header)) / sizeof(CosIndexEntry));
+            ssize_t want = entries.size() * sizeof(CosIndexEntry);
+            ok = read(fd, entries.data(), want) == want;
+        }
+        ::close(fd);
+        if (!ok) entries.clear();
+        return ok;
+    }
+
+    inline const std::vector<CosIndexEntry>& all() const { return entries; }
+    inline uint64_t startWallNs() const { return header.startWallNs; }
+
+    // Last entry at or before the wall time, or null if the log starts after it.
+    const CosIndexEntry* beforeTime(uint64_t wallNs) const {
+        auto it = std::upper_bound(entries.begin(), entries.end(), wallNs,
+                                   [](uint64_t t, const CosIndexEntry& e) { return t < e.wallNs; });
+        return it == entries.begin() ? nullptr : &*(it - 1);
+    }
+
+    // Last entry with fewer newlines before it than line (0-based), so its
+    // offset is at or before the start of that line.
+    const CosIndexEntry* beforeLine(uint64_t line) const {
+        auto it = std::lower_bound(entries.begin(), entries.end(), line,
+                                   [](const CosIndexEntry& e, uint64_t l) { return e.line < l; });
+        return it == entries.begin() ? nullptr : &*(it - 1);
+    }
+
+    // Last entry at or before the byte offset.
+    const CosIndexEntry* beforeOffset(uint64_t offset) const {
+        auto it = std::upper_bound(entries.begin(), entries.end(), offset,
+                                   [](uint64_t o, const CosIndexEntry& e) { return o < e.offset; });
+        return it == entries.begin() ? nullptr : &*(it - 1);
+    }
+
+    // First whole line written after the last index point at or before wallNs.
+    // The log is only read from that point to the next line break.
+    bool seekTime(uint64_t wallNs, CosLogPosition& out) const {
+        const CosIndexEntry* e = beforeTime(wallNs);
+        out = e ? CosLogPosition{e->offset, e->line} : CosLogPosition{0, 0};
+        int fd = ::open(logPath.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) return false;
+        bool ok = alignToLine(fd, out);
+        ::close(fd);
+        return ok;
+    }
+
+    // Start of line (0-based), reading forward from the nearest index point.
+    bool seekLine(uint64_t line, CosLogPosition& out) const {
+        const CosIndexEntry* e = beforeLine(line);
+        out = e ? CosLogPosition{e->offset, e->line} : CosLogPosition{0, 0};
+        int fd = ::open(logPath.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) return false;
+        bool ok = alignToLine(fd, out) && (out.line >= line || skipLines(fd, out, line - out.line));
+        ::close(fd);
+        return ok;
+    }
+
+    // First whole line at or after the byte offset.
+    bool seekOffset(uint64_t offset, CosLogPosition& out) const {
+        const CosIndexEntry* e = beforeOffset(offset);
+        out = e ? CosLogPosition{e->offset, e->line} : CosLogPosition{0, 0};
+        int fd = ::open(logPath.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) return false;
+        bool ok = skipTo(fd, out, offset) && alignToLine(fd, out);
+        ::close(fd);
+        return ok;
+    }
+};
+
+#endif // _WIN32
+
+#endif // COS_INDEX_H
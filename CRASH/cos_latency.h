@@ -0,0 +1,124 @@
+#ifndef COS_LATENCY_H
+#define COS_LATENCY_H
+
+#include "cos.h"
+#include <string>
+#include <vector>
+
+struct CosLatencyEntry {
+    int eventType;
+    const char* receiverClass;
+    unsigned long long count;
+    unsigned long long totalNs;
+    unsigned long long maxNs;
+    unsigned long long histogramUs[CosHistogram::BUCKETS];
+
+    // Upper bound of the log2 bucket holding the given fraction of samples.
+    unsigned long long percentileUs(double fraction) const {
+        unsigned long long target = (unsigned long long)(count * fraction);
+        unsigned long long seen = 0;
+        for (int b = 0; b < CosHistogram::BUCKETS; b++) {
+            seen += histogramUs[b];
+            if (seen > target) return 1ULL << (b + 1);
+        }
+        return 1ULL << CosHistogram::BUCKETS;
+    }
+};
+
+// Dispatch time per (event type, receiver class). One thread records, any
+// thread may read; slots are claimed once and never move, so readers only
+// need the per-field atomics. receiverClass must point at static storage
+// (QMetaObject::className() does).
+class CosLatencyTable {
+public:
+    static const int SLOTS = 512;
+
+private:
+    struct Slot {
+        std::atomic<bool> used{false};
+        int eventType = 0;
+        const char* receiverClass = nullptr;
+        std::atomic<unsigned long long> count{0};
+        std::atomic<unsigned long long> totalNs{0};
+        std::atomic<unsigned long long> maxNs{0};
+        CosHistogram histogram;
+    };
+
+    Slot slots[SLOTS];
+    std::atomic<unsigned long long> overflow{0};
+
+    static inline void bump(std::atomic<unsigned long long>& counter, unsigned long long n) {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+public:
+    static inline unsigned long long nowNs() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    }
+
+    // Single writer; a full table counts the sample in overflow() instead.
+    inline void record(int eventType, const char* receiverClass, unsigned long long ns) {
+        size_t h = ((reinterpret_cast<uintptr_t>(receiverClass) >> 3) * 31 + (unsigned)eventType) % SLOTS;
+        for (int probe = 0; probe < SLOTS; probe++) {
+            Slot& s = slots[(h + probe) % SLOTS];
+            if (!s.used.load(std::memory_order_relaxed)) {
+                s.eventType = eventType;
+                s.receiverClass = receiverClass;
+                s.used.store(true, std::memory_order_release);
+            } else if (s.eventType != eventType || s.receiverClass != receiverClass) {
+                continue;
+            }
+            bump(s.count, 1);
+            bump(s.totalNs, ns);
+            if (ns > s.maxNs.load(std::memory_order_relaxed)) s.maxNs.store(ns, std::memory_order_relaxed);
+            s.histogram.record(ns / 1000);
+            return;
+        }
+        bump(overflow, 1);
+    }
+
+    std::vector<CosLatencyEntry> snapshot() const {
+        std::vector<CosLatencyEntry> out;
+        for (const Slot& s : slots) {
+            if (!s.used.load(std::memory_order_acquire)) continue;
+            CosLatencyEntry e;
+            e.eventType = s.eventType;
+            e.receiverClass = s.receiverClass;
+            e.count = s.count.load(std::memory_order_relaxed);
+            e.totalNs = s.totalNs.load(std::memory_order_relaxed);
+            e.maxNs = s.maxNs.load(std::memory_order_relaxed);
+            s.histogram.snapshot(e.histogramUs);
+            out.push_back(e);
+        }
+        return out;
+    }
+
+    inline unsigned long long overflowCount() const { return overflow.load(std::memory_order_relaxed); }
+
+    // The top handlers by worst single dispatch, as a fixed-width text table.
+    template <typename TypeName>
+    std::string format(size_t top, TypeName typeName) const {
+        std::vector<CosLatencyEntry> entries = snapshot();
+        std::sort(entries.begin(), entries.end(),
+                  [](const CosLatencyEntry& a, const CosLatencyEntry& b) { return a.maxNs > b.maxNs; });
+        if (entries.size() > top) entries.resize(top);
+
+        std::string out;
+        char line[256];
+        snprintf(line, sizeof(line), "%-24s %-32s %10s %10s %10s %10s\n",
+                 "EVENT", "RECEIVER", "COUNT", "MEAN us", "P99 us", "MAX ms");
+        out += line;
+        for (const CosLatencyEntry& e : entries) {
+            std::string type = typeName(e.eventType);
+            snprintf(line, sizeof(line), "%-24.24s %-32.32s %10llu %10.1f %10llu %10.3f\n",
+                     type.c_str(), e.receiverClass ? e.receiverClass : "?", e.count,
+                     e.count ? e.totalNs / 1000.0 / e.count : 0.0, e.percentileUs(0.99), e.maxNs / 1e6);
+            out += line;
+        }
+        return out;
+    }
+};
+
+#endif // COS_LATENCY_H
@@ -0,0 +1,504 @@
+#ifndef COS_LIVE_H
+#define COS_LIVE_H
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cinttypes>
+#include <ctime>
+#include <atomic>
+#include <string>
+#include <vector>
+
+struct CosLiveStats {
+    size_t subscribers;
+    unsigned long long accepted;
+    unsigned long long dropped;         // fell a whole ring behind
+    unsigned long long bytesSent;
+};
+
+// Streams captured output to local subscribers on a Unix stream socket.
+//
+// The drain thread copies each batch into an in-memory ring and never waits:
+// positions only grow and old bytes are simply overwritten. One server thread
+// sends every subscriber its bytes straight out of the ring from its own
+// cursor. A subscriber whose bytes get overwritten before it takes them is
+// disconnected; it can reconnect and resume from the offset it had reached.
+//
+// A subscriber starts with one request line: "live" (or an empty line, or
+// nothing for HANDSHAKE_MS) for output from now on, "from OFFSET" to resume,
+// or "last BYTES" for recent output starting at a line. Each position is a
+// byte offset into everything captured since start. The reply is a
+// "#COS-LIVE OFFSET" line giving the position of the byte after it; a later
+// start than asked for means the bytes in between are gone. Catch-up reaches
+// at most three quarters of the ring back, so a subscriber is not dropped the
+// moment it starts.
+class CosLiveServer {
+public:
+    static const size_t MAX_REQUEST = 64;
+    static const unsigned HANDSHAKE_MS = 500;
+
+private:
+    struct Subscriber {
+        int sock;
+        bool ready;             // request read, cursor set
+        bool blocked;           // socket full, waiting for POLLOUT
+        bool quiet;             // it has shut down its side; only a hang-up is left to read
+        uint64_t cursor;
+        unsigned long long connectedUs;
+        std::string text;       // request line so far, then the reply header
+    };
+
+    std::string socketPath;
+    std::vector<char> ring;
+    size_t mask;
+    // Bytes below reserved - capacity may be overwritten already; below head they are complete.
+    alignas(64) std::atomic<uint64_t> reserved;
+    alignas(64) std::atomic<uint64_t> head;
+    std::atomic<bool> sleeping;
+    std::atomic<bool> running;
+    int listenFd;
+    int wakeFd;
+    pthread_t thread;
+    bool started;
+    size_t maxSubscribers;
+
+    // Server thread only.
+    std::vector<Subscriber> subscribers;
+
+    std::atomic<size_t> subscriberCount;
+    std::atomic<unsigned long long> accepted;
+    std::atomic<unsigned long long> dropped;
+    std::atomic<unsigned long long> bytesSent;
+
+    static inline unsigned long long nowUs() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (unsigned long long)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+    }
+
+    inline size_t capacity() const { return ring.size(); }
+
+    inline uint64_t oldest(uint64_t end) const {
+        uint64_t reach = capacity() / 4 * 3;
+        return end > reach ? end - reach : 0;
+    }
+
+    // True once the producer may have started overwriting the byte at pos.
+    inline bool overwritten(uint64_t pos) const {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return reserved.load(std::memory_order_relaxed) - pos > capacity();
+    }
+
+    void acceptAll() {
+        for (;;) {
+            int fd = ::accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+            if (fd == -1) return;
+            if (subscribers.size() >= maxSubscribers) {
+                close(fd);
+                continue;
+            }
+            subscribers.push_back(Subscriber{fd, false, false, false, 0, nowUs(), std::string()});
+            accepted.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // Where "last BYTES" starts: the first line that begins inside the window.
+    uint64_t lineStart(uint64_t from, uint64_t end) const {
+        if (from == 0) return 0;
+        for (uint64_t pos = from - 1; pos < end; pos++) {
+            if (ring[pos & mask] == '\n') return overwritten(from) ? from : pos + 1;
+        }
+        return from;
+    }
+
+    // Parses the request line and queues the reply header; false drops the subscriber.
+    bool start(Subscriber& s) {
+        uint64_t end = head.load(std::memory_order_acquire);
+        uint64_t first = oldest(end);
+        uint64_t value = 0;
+        std::string line = s.text;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+
+        uint64_t cursor = end;
+        if (sscanf(line.c_str(), "from %" SCNu64, &value) == 1) {
+            cursor = value < first ? first : value > end ? end : value;
+        } else if (sscanf(line.c_str(), "last %" SCNu64, &value) == 1) {
+            cursor = lineStart(end - first < value ? first : end - value, end);
+        } else if (!line.empty() && line != "live") {
+            return false;
+        }
+
+        char header[48];
+        snprintf(header, sizeof(header), "#COS-LIVE %" PRIu64 "\n", cursor);
+        s.text = header;
+        s.cursor = cursor;
+        s.ready = true;
+        return true;
+    }
+
+    // Reads what the subscriber has said. Once it is under way anything more
+    // is ignored; shutting down its side (echo "last 4096" | nc -U) ends the request.
+    bool readRequest(Subscriber& s) {
+        char buf[MAX_REQUEST];
+        for (;;) {
+            ssize_t n = recv(s.sock, buf, sizeof(buf), 0);
+            if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+            if (n == 0) {
+                s.quiet = true;
+                return s.ready || start(s);
+            }
+            if (s.ready) continue;
+            const char* nl = static_cast<const char*>(memchr(buf, '\n', n));
+            s.text.append(buf, nl ? nl - buf : n);
+            if (nl) return start(s);
+            if (s.text.size() >= MAX_REQUEST) return false;
+        }
+    }
+
+    // Sends the header, then ring bytes up to end. False drops the subscriber.
+    bool send(Subscriber& s, uint64_t end) {
+        while (!s.text.empty()) {
+            ssize_t n = ::send(s.sock, s.text.data(), s.text.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                s.blocked = errno == EAGAIN || errno == EWOULDBLOCK;
+                return s.blocked;
+            }
+            s.text.erase(0, n);
+        }
+        while (s.cursor < end) {
+            if (end - s.cursor > capacity()) return !dropSlow();
+            size_t off = s.cursor & mask;
+            size_t len = end - s.cursor;
+            size_t first = capacity() - off < len ? capacity() - off : len;
+            iovec iov[2] = { { &ring[off], first }, { &ring[0], len - first } };
+            msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = iov;
+            msg.msg_iovlen = len > first ? 2 : 1;
+            ssize_t n = sendmsg(s.sock, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                s.blocked = errno == EAGAIN || errno == EWOULDBLOCK;
+                return s.blocked;
+            }
+            // The kernel copied the bytes while the producer kept writing; if
+            // it reached them meanwhile, what went out may be torn.
+            if (overwritten(s.cursor)) return !dropSlow();
+            s.cursor += (uint64_t)n;
+            bytesSent.fetch_add((unsigned long long)n, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    inline bool dropSlow() {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    void drop(size_t i) {
+        close(subscribers[i].sock);
+        subscribers.erase(subscribers.begin() + i);
+    }
+
+    void run() {
+        std::vector<pollfd> fds;
+        unsigned long long stopUs = 0;
+        for (;;) {
+            bool stopping = !running.load(std::memory_order_acquire);
+            unsigned long long now = nowUs();
+            if (stopping && !stopUs) stopUs = now;
+
+            uint64_t end = head.load(std::memory_order_acquire);
+            bool behind = false;
+            for (size_t i = subscribers.size(); i-- > 0;) {
+                Subscriber& s = subscribers[i];
+                if (!s.ready && (stopping || now - s.connectedUs >= HANDSHAKE_MS * 1000ULL) && !start(s)) {
+                    drop(i);
+                    continue;
+                }
+                // One stuck on a full socket is cut off once its bytes are gone.
+                if (s.ready && (s.blocked ? end - s.cursor > capacity() && dropSlow() : !send(s, end))) {
+                    drop(i);
+                    continue;
+                }
+                if (s.ready && s.cursor < end) behind = true;
+            }
+            subscriberCount.store(subscribers.size(), std::memory_order_relaxed);
+
+            // Subscribers get until the deadline to take the tail of the output.
+            if (stopping && (!behind || now - stopUs >= 200000)) break;
+
+            fds.assign(1, pollfd{ wakeFd, POLLIN, 0 });
+            if (!stopping) fds.push_back(pollfd{ listenFd, POLLIN, 0 });
+            size_t base = fds.size();
+            bool waiting = false, stuck = false;
+            for (const Subscriber& s : subscribers) {
+                fds.push_back(pollfd{ s.sock, (short)(s.blocked ? POLLOUT : s.quiet ? 0 : POLLIN), 0 });
+                waiting |= !s.ready;
+                stuck |= s.blocked;
+            }
+
+            // Only a subscriber that is up to date asks the producer for a wake-up;
+            // stuck ones are looked at every 100 ms in case they fell too far behind.
+            int timeout = waiting ? 50 : stopping ? 10 : stuck ? 100 : -1;
+            bool idle = false;
+            for (const Subscriber& s : subscribers) idle |= s.ready && !s.blocked;
+            if (idle) {
+                sleeping.store(true);
+                if (head.load() != end) {
+                    sleeping.store(false, std::memory_order_relaxed);
+                    timeout = 0;
+                }
+            }
+            int ready = poll(fds.data(), fds.size(), timeout);
+            sleeping.store(false, std::memory_order_relaxed);
+            if (ready <= 0) continue;
+
+            if (fds[0].revents & POLLIN) {
+                uint64_t count;
+                while (read(wakeFd, &count, sizeof(count)) > 0) {}
+            }
+            for (size_t i = subscribers.size(); i-- > 0;) {
+                short events = fds[base + i].revents;
+                if (!events) continue;
+                Subscriber& s = subscribers[i];
+                if (events & POLLOUT) s.blocked = false;
+                if (((events & POLLIN) && !readRequest(s)) || (events & (POLLHUP | POLLERR))) drop(i);
+            }
+            if (!stopping && (fds[1].revents & POLLIN)) acceptAll();
+        }
+
+        for (size_t i = subscribers.size(); i-- > 0;) drop(i);
+        subscriberCount.store(0, std::memory_order_relaxed);
+    }
+
+    static void* threadFunc(void* arg) {
+        static_cast<CosLiveServer*>(arg)->run();
+        return nullptr;
+    }
+
+public:
+    CosLiveServer() : mask(0), reserved(0), head(0), sleeping(false), running(false), listenFd(-1), wakeFd(-1),
+        started(false), maxSubscribers(0), subscriberCount(0), accepted(0), dropped(0), bytesSent(0) {}
+
+    ~CosLiveServer() { stop(); }
+
+    // Like the collector, refuses to steal the socket from a live process and
+    // replaces a stale one. The socket is for the owner only.
+    bool start(const std::string& path, size_t ringBytes, size_t maxSubs) {
+        if (started || path.empty()) return false;
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(addr.sun_path)) return false;
+        strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool live = probe != -1 && connect(probe, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+        if (probe != -1) close(probe);
+        if (live) return false;
+        unlink(path.c_str());
+
+        size_t size = 64 * 1024;
+        while (size < ringBytes) size <<= 1;
+        ring.assign(size, '\0');
+        mask = size - 1;
+
+        listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+        wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        // umask() would change the mode of whatever other threads create meanwhile,
+        // so the socket is narrowed after bind(), before it accepts anyone.
+        bool bound = listenFd != -1 && bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+        if (!bound || wakeFd == -1 || chmod(path.c_str(), 0600) != 0 || ::listen(listenFd, 64) != 0) {
+            if (bound) unlink(path.c_str());
+            if (listenFd != -1) close(listenFd);
+            if (wakeFd != -1) close(wakeFd);
+            listenFd = wakeFd = -1;
+            return false;
+        }
+        socketPath = path;
+        maxSubscribers = maxSubs ? maxSubs : 1;
+        running.store(true, std::memory_order_release);
+
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setstacksize(&attr, 64 * 1024);
+        started = pthread_create(&thread, &attr, threadFunc, this) == 0;
+        pthread_attr_destroy(&attr);
+        if (!started) {
+            running.store(false, std::memory_order_release);
+            close(listenFd);
+            close(wakeFd);
+            listenFd = wakeFd = -1;
+            unlink(path.c_str());
+        }
+        return started;
+    }
+
+    inline bool active() const { return started; }
+
+    // Drain thread only. Copies the batch into the ring and never blocks; the
+    // server is woken only if it is idle with a subscriber waiting for more.
+    void publish(const iovec* iov, int count) {
+        uint64_t pos = head.load(std::memory_order_relaxed);
+        size_t len = 0;
+        for (int i = 0; i < count; i++) len += iov[i].iov_len;
+        if (!len) return;
+
+        reserved.store(pos + len, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        // Only the last capacity bytes of the batch survive anyway.
+        uint64_t keepFrom = len > capacity() ? pos + len - capacity() : pos;
+        uint64_t at = pos;
+        for (int i = 0; i < count; i++) {
+            const char* src = static_cast<const char*>(iov[i].iov_base);
+            size_t n = iov[i].iov_len;
+            if (at + n <= keepFrom) {
+                at += n;
+                continue;
+            }
+            if (at < keepFrom) {
+                src += keepFrom - at;
+                n -= keepFrom - at;
+                at = keepFrom;
+            }
+            size_t off = at & mask;
+            size_t first = capacity() - off < n ? capacity() - off : n;
+            memcpy(&ring[off], src, first);
+            memcpy(&ring[0], src + first, n - first);
+            at += n;
+        }
+        head.store(pos + len);
+
+        if (sleeping.load() && sleeping.exchange(false)) {
+            uint64_t one = 1;
+            ssize_t ignored = write(wakeFd, &one, sizeof(one));
+            (void)ignored;
+        }
+    }
+
+    // After the drain thread is done: subscribers get a moment to take the
+    // rest, then the socket goes away.
+    void stop() {
+        if (!started) return;
+        running.store(false, std::memory_order_release);
+        uint64_t one = 1;
+        ssize_t ignored = write(wakeFd, &one, sizeof(one));
+        (void)ignored;
+        pthread_join(thread, nullptr);
+        started = false;
+        close(listenFd);
+        close(wakeFd);
+        listenFd = wakeFd = -1;
+        unlink(socketPath.c_str());
+    }
+
+    // Bytes published so far; the offset a "from" request resumes at.
+    inline uint64_t position() const { return head.load(std::memory_order_acquire); }
+
+    CosLiveStats stats() const {
+        return CosLiveStats{subscriberCount.load(std::memory_order_relaxed),
+                            accepted.load(std::memory_order_relaxed),
+                            dropped.load(std::memory_order_relaxed),
+                            bytesSent.load(std::memory_order_relaxed)};
+    }
+
+    CosLiveServer(const CosLiveServer&) = delete;
+    CosLiveServer& operator=(const CosLiveServer&) = delete;
+};
+
+// Client side, as used by cos-tail: connects, sends the request and strips
+// the reply header. offset() is where the next byte read sits, so a dropped
+// subscription resumes with "from offset()".
+class CosLiveSubscription {
+private:
+    int sock;
+    uint64_t asked;
+    uint64_t started;
+    uint64_t at;
+    bool headerDone;
+    std::string header;
+
+public:
+    CosLiveSubscription() : sock(-1), asked(0), started(0), at(0), headerDone(false) {}
+    ~CosLiveSubscription() { close(); }
+
+    // request is "live", "from OFFSET" or "last BYTES".
+    bool open(const std::string& path, const std::string& request) {
+        close();
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+        sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (sock == -1) return false;
+        std::string line = request + "\n";
+        if (connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+            ::send(sock, line.data(), line.size(), MSG_NOSIGNAL) != (ssize_t)line.size()) {
+            close();
+            return false;
+        }
+        if (sscanf(request.c_str(), "from %" SCNu64, &asked) != 1) asked = 0;
+        headerDone = false;
+        header.clear();
+        return true;
+    }
+
+    // Output bytes into buf; 0 once the server hangs up or drops us, -1 on error.
+    ssize_t read(char* buf, size_t len) {
+        while (sock != -1) {
+            ssize_t n = recv(sock, buf, len, 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                close();
+                return n;
+            }
+            if (headerDone) {
+                at += (uint64_t)n;
+                return n;
+            }
+            const char* nl = static_cast<const char*>(memchr(buf, '\n', n));
+            header.append(buf, nl ? nl - buf : n);
+            if (!nl) continue;
+            if (sscanf(header.c_str(), "#COS-LIVE %" SCNu64, &started) != 1) {
+                close();
+                return -1;
+            }
+            headerDone = true;
+            at = started;
+            size_t rest = (size_t)(buf + n - (nl + 1));
+            if (!rest) continue;
+            memmove(buf, nl + 1, rest);
+            at += rest;
+            return (ssize_t)rest;
+        }
+        return 0;
+    }
+
+    // Bytes between a "from" request and where the server could start.
+    inline uint64_t gap() const { return headerDone && started > asked && asked ? started - asked : 0; }
+    inline uint64_t offset() const { return at; }
+
+    void close() {
+        if (sock != -1) ::close(sock);
+        sock = -1;
+    }
+};
+
+#endif // __linux__
+
+#endif // COS_LIVE_H
@@ -0,0 +1,361 @@
+#ifndef COS_LOG_H
+#define COS_LOG_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+enum class CosLevel : uint8_t { Debug, Info, Warning, Error, Fatal };
+
+struct CosLogSite {
+    CosLevel level;
+    const char* format;
+    const char* file;
+    int line;
+};
+
+// Deferred-formatting logger. A call only copies its arguments, tagged by type,
+// into a per-thread ring together with the address of its static call site;
+// the COS drain thread turns records into text later. Nothing on the calling
+// side locks or makes a syscall, and a full ring drops the record instead of
+// waiting.
+class CosLog {
+public:
+    static constexpr size_t RING_BYTES = 1024 * 1024;
+
+    // -1 when the format has a stray brace; only bare "{}" placeholders exist.
+    static constexpr int placeholders(const char* f) {
+        int n = 0;
+        for (; *f; f++) {
+            if (*f == '{') {
+                if (f[1] == '{') { f++; continue; }
+                if (f[1] != '}') return -1;
+                n++;
+                f++;
+            } else if (*f == '}') {
+                if (f[1] != '}') return -1;
+                f++;
+            }
+        }
+        return n;
+    }
+
+    static inline void setLevel(CosLevel level) {
+        threshold().store((int)level, std::memory_order_relaxed);
+    }
+
+    static inline bool enabled(CosLevel level) {
+        return (int)level >= threshold().load(std::memory_order_relaxed);
+    }
+
+    template <int N, typename... Args>
+    static inline void write(const CosLogSite* site, const Args&... args) {
+        static_assert(N >= 0, "COS_LOG: stray '{' or '}' in format string (escape as {{ or }})");
+        static_assert(N == (int)sizeof...(Args), "COS_LOG: placeholder count does not match arguments");
+
+        size_t total = align(sizeof(Record) + (size_t(0) + ... + encodedSize(args)));
+        Ring* ring = localRing();
+        if (!ring) return;
+
+        char* p = ring->reserve(total);
+        if (!p) {
+            ring->dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        Record* rec = reinterpret_cast<Record*>(p);
+        rec->size = (uint32_t)total;
+        rec->filler = 0;
+        rec->site = site;
+        rec->ticks = ticks();
+        [[maybe_unused]] char* out = p + sizeof(Record);
+        (encode(out, args), ...);
+        ring->commit(total);
+    }
+
+    static inline bool active() { return registry().active.load(std::memory_order_acquire); }
+
+    // Raw timestamps, also used by the flight recorder; map to time against an epoch.
+    static inline uint64_t monotonicNs() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    }
+
+    static inline uint64_t ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return monotonicNs();
+#endif
+    }
+
+    static inline unsigned long long dropped() {
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> guard(reg.lock);
+        unsigned long long n = reg.retiredDrops;
+        for (Ring* r : reg.rings) n += r->dropped.load(std::memory_order_relaxed);
+        return n;
+    }
+
+    // Formats pending records, oldest ring position first per thread, until
+    // out would grow past maxBytes. Only the drain thread calls this.
+    static size_t drainTo(std::string& out, size_t maxBytes) {
+        Registry& reg = registry();
+        std::vector<Ring*> rings;
+        {
+            std::lock_guard<std::mutex> guard(reg.lock);
+            rings = reg.rings;
+        }
+
+        size_t start = out.size();
+        std::string line;
+        for (Ring* r : rings) {
+            while (const Record* rec = r->peek()) {
+                line.clear();
+                format(*rec, line);
+                if (out.size() - start + line.size() > maxBytes) {
+                    if (out.size() != start) return out.size() - start;
+                    // Cut, but still one line: the next record and the index count on it.
+                    line.resize(maxBytes > 1 ? maxBytes - 1 : 0);
+                    line += '\n';
+                }
+                out += line;
+                r->pop(rec->size);
+            }
+        }
+
+        std::lock_guard<std::mutex> guard(reg.lock);
+        for (size_t i = reg.rings.size(); i-- > 0;) {
+            Ring* r = reg.rings[i];
+            if (!r->retired.load(std::memory_order_acquire) || r->peek()) continue;
+            reg.retiredDrops += r->dropped.load(std::memory_order_relaxed);
+            reg.rings.erase(reg.rings.begin() + i);
+            delete r;
+        }
+        return out.size() - start;
+    }
+
+private:
+    enum : uint8_t { TAG_I64, TAG_U64, TAG_F64, TAG_BOOL, TAG_CHAR, TAG_STR, TAG_PTR };
+
+    struct Record {
+        uint32_t size;
+        uint32_t filler;
+        const CosLogSite* site;
+        uint64_t ticks;
+    };
+
+    // Single producer (the owning thread), single consumer (the drain thread).
+    // A record never wraps; the unused tail of the buffer is skipped through a
+    // filler header, of which only the first 8 bytes are ever touched.
+    struct Ring {
+        std::vector<char> data;
+        alignas(64) std::atomic<uint64_t> head{0};
+        uint64_t cachedTail = 0;
+        alignas(64) std::atomic<uint64_t> tail{0};
+        std::atomic<unsigned long long> dropped{0};
+        std::atomic<bool> retired{false};
+
+        Ring() : data(RING_BYTES) {}
+
+        inline char* reserve(size_t total) {
+            uint64_t h = head.load(std::memory_order_relaxed);
+            size_t off = h & (RING_BYTES - 1);
+            size_t skip = RING_BYTES - off < total ? RING_BYTES - off : 0;
+
+            if (h + skip + total - cachedTail > RING_BYTES) {
+                cachedTail = tail.load(std::memory_order_acquire);
+                if (h + skip + total - cachedTail > RING_BYTES) return nullptr;
+            }
+            if (skip) {
+                Record* filler = reinterpret_cast<Record*>(&data[off]);
+                filler->size = (uint32_t)skip;
+                filler->filler = 1;
+                head.store(h + skip, std::memory_order_release);
+                return &data[0];
+            }
+            return &data[off];
+        }
+
+        inline void commit(size_t total) {
+            head.store(head.load(std::memory_order_relaxed) + total, std::memory_order_release);
+        }
+
+        const Record* peek() {
+            for (;;) {
+                uint64_t t = tail.load(std::memory_order_relaxed);
+                if (t == head.load(std::memory_order_acquire)) return nullptr;
+                const Record* rec = reinterpret_cast<const Record*>(&data[t & (RING_BYTES - 1)]);
+                if (!rec->filler) return rec;
+                tail.store(t + rec->size, std::memory_order_release);
+            }
+        }
+
+        inline void pop(size_t size) {
+            tail.store(tail.load(std::memory_order_relaxed) + size, std::memory_order_release);
+        }
+    };
+
+    struct Registry {
+        std::mutex lock;
+        std::vector<Ring*> rings;
+        unsigned long long retiredDrops = 0;
+        std::atomic<bool> active{false};
+        uint64_t epochTicks = 0;
+        uint64_t epochNs = 0;
+    };
+
+    // Hands the ring to the drain thread once its thread exits.
+    struct Owner {
+        Ring* ring = nullptr;
+        ~Owner() {
+            if (ring) ring->retired.store(true, std::memory_order_release);
+        }
+    };
+
+    static inline Registry& registry() {
+        static Registry reg;
+        return reg;
+    }
+
+    static inline std::atomic<int>& threshold() {
+        static std::atomic<int> level{(int)CosLevel::Debug};
+        return level;
+    }
+
+    static Ring* localRing() {
+        static thread_local Owner owner;
+        if (owner.ring) return owner.ring;
+
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> guard(reg.lock);
+        if (!reg.active.load(std::memory_order_relaxed)) {
+            reg.epochTicks = ticks();
+            reg.epochNs = monotonicNs();
+        }
+        owner.ring = new Ring();
+        reg.rings.push_back(owner.ring);
+        reg.active.store(true, std::memory_order_release);
+        return owner.ring;
+    }
+
+    static constexpr size_t align(size_t n) { return (n + 7) & ~size_t(7); }
+
+    template <typename T>
+    static constexpr size_t encodedSize(const T&) {
+        using D = std::decay_t<T>;
+        if constexpr (std::is_same_v<D, bool> || std::is_same_v<D, char>) return 2;
+        else if constexpr (std::is_arithmetic_v<D> || std::is_pointer_v<D>) return 9;
+        else return 0;
+    }
+    static inline size_t encodedSize(const char* s) { return 5 + (s ? strlen(s) : 0); }
+    static inline size_t encodedSize(char* s) { return encodedSize((const char*)s); }
+    static inline size_t encodedSize(const std::string& s) { return 5 + s.size(); }
+    static inline size_t encodedSize(std::string_view s) { return 5 + s.size(); }
+
+    static inline void put(char*& out, uint8_t tag, const void* value, size_t len) {
+        *out++ = (char)tag;
+        memcpy(out, value, len);
+        out += len;
+    }
+
+    static inline void putStr(char*& out, const char* s, uint32_t len) {
+        *out++ = (char)TAG_STR;
+        memcpy(out, &len, 4);
+        memcpy(out + 4, s, len);
+        out += 4 + len;
+    }
+
+    template <typename T>
+    static inline void encode(char*& out, const T& v) {
+        using D = std::decay_t<T>;
+        static_assert(std::is_arithmetic_v<D> || std::is_pointer_v<D>,
+                      "COS_LOG: argument type has no binary encoding");
+        if constexpr (std::is_same_v<D, bool>) {
+            put(out, TAG_BOOL, &v, 1);
+        } else if constexpr (std::is_same_v<D, char>) {
+            put(out, TAG_CHAR, &v, 1);
+        } else if constexpr (std::is_floating_point_v<D>) {
+            double d = v;
+            put(out, TAG_F64, &d, 8);
+        } else if constexpr (std::is_pointer_v<D>) {
+            uint64_t p = (uint64_t)(uintptr_t)v;
+            put(out, TAG_PTR, &p, 8);
+        } else if constexpr (std::is_signed_v<D>) {
+            int64_t i = v;
+            put(out, TAG_I64, &i, 8);
+        } else {
+            uint64_t u = v;
+            put(out, TAG_U64, &u, 8);
+        }
+    }
+    static inline void encode(char*& out, const char* s) {
+        putStr(out, s ? s : "", s ? (uint32_t)strlen(s) : 0);
+    }
+    static inline void encode(char*& out, char* s) { encode(out, (const char*)s); }
+    static inline void encode(char*& out, const std::string& s) { putStr(out, s.data(), (uint32_t)s.size()); }
+    static inline void encode(char*& out, std::string_view s) { putStr(out, s.data(), (uint32_t)s.size()); }
+
+    static void appendArg(const char*& in, std::string& out) {
+        char buf[32];
+        uint8_t tag = (uint8_t)*in++;
+        switch (tag) {
+        case TAG_I64: { int64_t v; memcpy(&v, in, 8); in += 8; snprintf(buf, sizeof(buf), "%lld", (long long)v); out += buf; break; }
+        case TAG_U64: { uint64_t v; memcpy(&v, in, 8); in += 8; snprintf(buf, sizeof(buf), "%llu", (unsigned long long)v); out += buf; break; }
+        case TAG_F64: { double v; memcpy(&v, in, 8); in += 8; snprintf(buf, sizeof(buf), "%g", v); out += buf; break; }
+        case TAG_PTR: { uint64_t v; memcpy(&v, in, 8); in += 8; snprintf(buf, sizeof(buf), "0x%llx", (unsigned long long)v); out += buf; break; }
+        case TAG_BOOL: out += *in++ ? "true" : "false"; break;
+        case TAG_CHAR: out += *in++; break;
+        case TAG_STR: { uint32_t len; memcpy(&len, in, 4); out.append(in + 4, len); in += 4 + len; break; }
+        }
+    }
+
+    static void format(const Record& rec, std::string& out) {
+        static const char* names[] = { "DEBUG", "INFO", "WARN", "ERROR", "FATAL" };
+        Registry& reg = registry();
+
+        // Ticks map to time through a rate measured against the epoch at format time.
+        uint64_t nowTicks = ticks(), nowNs = monotonicNs();
+        double rate = nowTicks > reg.epochTicks
+                          ? (double)(nowNs - reg.epochNs) / (double)(nowTicks - reg.epochTicks) : 1.0;
+        double seconds = rec.ticks > reg.epochTicks ? (rec.ticks - reg.epochTicks) * rate / 1e9 : 0.0;
+
+        char prefix[48];
+        snprintf(prefix, sizeof(prefix), "[%s +%.6f] ", names[(int)rec.site->level], seconds);
+        out += prefix;
+
+        const char* in = reinterpret_cast<const char*>(&rec) + sizeof(Record);
+        for (const char* f = rec.site->format; *f; f++) {
+            if ((f[0] == '{' && f[1] == '{') || (f[0] == '}' && f[1] == '}')) {
+                out += *f++;
+            } else if (f[0] == '{') {
+                appendArg(in, out);
+                f++;
+            } else {
+                out += *f;
+            }
+        }
+        out += '\n';
+    }
+};
+
+// COS_LOG(CosLevel::Info, "loaded {} entries in {} ms", count, ms);
+#define COS_LOG(level, fmt, ...)                                                         \
+    do {                                                                                 \
+        static constexpr CosLogSite cosLogSite_ = { level, fmt, __FILE__, __LINE__ };    \
+        if (CosLog::enabled(level))                                                      \
+            CosLog::write<CosLog::placeholders(fmt)>(&cosLogSite_, ##__VA_ARGS__);       \
+    } while (0)
+
+#endif // COS_LOG_H
@@ -0,0 +1,158 @@
+#ifndef COS_MEMLOG_H
+#define COS_MEMLOG_H
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <atomic>
+#include <mutex>
+#include <string>
+
+struct CosMemfdStats {
+    unsigned long long bytes;           // in the memfd
+    unsigned long long spilledBytes;    // copied to the file so far
+    unsigned long long spills;
+    unsigned long long errors;
+};
+
+// The session log kept in a memfd instead of a file on disk. COS writes to a
+// dup of fd() exactly as it would to the file; whoever wants to read it maps
+// the same pages (COSEC in-process, a helper through /proc/<pid>/fd/<fd> or
+// SCM_RIGHTS). A thread copies what is new to the file on disk with
+// sendfile(), every spillMs or only at the end. With sealing the memfd cannot
+// shrink under a mapper's feet, and is sealed read-only once the session is over.
+class CosMemfdLog {
+private:
+    int memFd;
+    int diskFd;
+    bool sealed;
+    std::mutex spillLock;
+    uint64_t spilled;
+    unsigned intervalMs;
+    std::atomic<bool> running;
+    std::atomic<bool> urgent;
+    pthread_t thread;
+    bool started;
+
+    std::atomic<unsigned long long> spilledOut;
+    std::atomic<unsigned long long> spills;
+    std::atomic<unsigned long long> errors;
+
+    static inline unsigned long long nowUs() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (unsigned long long)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+    }
+
+    // Copies what is new, straight from the memfd's pages to the file.
+    bool copyOut() {
+        struct stat st;
+        if (fstat(memFd, &st) != 0) return false;
+        while (spilled < (uint64_t)st.st_size) {
+            off_t off = (off_t)spilled;
+            ssize_t n = sendfile(diskFd, memFd, &off, (size_t)(st.st_size - spilled));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            spilled += (uint64_t)n;
+        }
+        return true;
+    }
+
+    void run() {
+        unsigned long long next = nowUs() + intervalMs * 1000ULL;
+        while (running.load(std::memory_order_acquire)) {
+            usleep(intervalMs || urgent.load(std::memory_order_relaxed) ? 20 * 1000 : 100 * 1000);
+            bool due = intervalMs && nowUs() >= next;
+            if (!due && !urgent.load(std::memory_order_relaxed)) continue;
+            spill();
+            next = nowUs() + intervalMs * 1000ULL;
+        }
+    }
+
+    static void* threadFunc(void* arg) {
+        static_cast<CosMemfdLog*>(arg)->run();
+        return nullptr;
+    }
+
+public:
+    CosMemfdLog() : memFd(-1), diskFd(-1), sealed(false), spilled(0), intervalMs(0), running(false), urgent(false),
+        started(false), spilledOut(0), spills(0), errors(0) {}
+
+    ~CosMemfdLog() { finish(false); }
+
+    // The file at diskPath is truncated now and filled by spills. Returns a
+    // descriptor of the memfd for the caller to write to and close, or -1.
+    int open(const std::string& name, const std::string& diskPath, unsigned spillMs, bool seal) {
+        if (memFd != -1) return -1;
+        memFd = memfd_create(name.c_str(), MFD_CLOEXEC | (seal ? MFD_ALLOW_SEALING : 0));
+        if (memFd == -1) return -1;
+        if (seal) fcntl(memFd, F_ADD_SEALS, F_SEAL_SHRINK);
+        sealed = seal;
+        diskFd = ::open(diskPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        intervalMs = spillMs;
+
+        running.store(true, std::memory_order_release);
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setstacksize(&attr, 64 * 1024);
+        started = diskFd != -1 && pthread_create(&thread, &attr, threadFunc, this) == 0;
+        pthread_attr_destroy(&attr);
+        return fcntl(memFd, F_DUPFD_CLOEXEC, 3);
+    }
+
+    inline bool active() const { return memFd != -1; }
+    inline int fd() const { return memFd; }
+
+    bool spill() {
+        std::lock_guard<std::mutex> guard(spillLock);
+        if (memFd == -1 || diskFd == -1) return false;
+        bool ok = copyOut();
+        spills.fetch_add(1, std::memory_order_relaxed);
+        if (!ok) errors.fetch_add(1, std::memory_order_relaxed);
+        spilledOut.store(spilled, std::memory_order_relaxed);
+        return ok;
+    }
+
+    // After a crash: spill every tick, so what the drain still writes while
+    // the report is up reaches the disk. Does not wait; safe in the handler.
+    inline void spillOften() { urgent.store(true, std::memory_order_relaxed); }
+
+    // Last spill, once nothing writes any more. Sealing then makes the memfd
+    // read-only for anyone still holding it.
+    void finish(bool seal) {
+        if (memFd == -1) return;
+        if (started) {
+            running.store(false, std::memory_order_release);
+            pthread_join(thread, nullptr);
+            started = false;
+        }
+        spill();
+        std::lock_guard<std::mutex> guard(spillLock);
+        if (seal && sealed) fcntl(memFd, F_ADD_SEALS, F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+        if (diskFd != -1) close(diskFd);
+        close(memFd);
+        diskFd = memFd = -1;
+    }
+
+    CosMemfdStats stats() const {
+        struct stat st;
+        unsigned long long bytes = memFd != -1 && fstat(memFd, &st) == 0 ? (unsigned long long)st.st_size : 0;
+        return CosMemfdStats{bytes, spilledOut.load(std::memory_order_relaxed),
+                             spills.load(std::memory_order_relaxed), errors.load(std::memory_order_relaxed)};
+    }
+
+    CosMemfdLog(const CosMemfdLog&) = delete;
+    CosMemfdLog& operator=(const CosMemfdLog&) = delete;
+};
+
+#endif // __linux__
+
+#endif // COS_MEMLOG_H
@@ -0,0 +1,246 @@
+#ifndef COS_MEMORY_H
+#define COS_MEMORY_H
+
+// One point of the memory timeline; sizes in KiB, pressure in hundredths of a percent.
+struct CosMemorySample {
+    unsigned msSinceStart;
+    unsigned rssKb;
+    unsigned pssKb;
+    unsigned heapKb;
+    unsigned cgroupKb;
+    unsigned short psiSome10;
+    unsigned short psiFull10;
+};
+
+#ifdef __linux__
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <unistd.h>
+
+// Low-frequency sampler of RSS, PSS, malloc heap and memory pressure into a
+// fixed ring. One thread writes; the crash handler and the GUI read.
+class CosMemorySampler {
+public:
+    using PressureCallback = std::function<void(const CosMemorySample&)>;
+
+private:
+    std::vector<CosMemorySample> ring;
+    std::atomic<unsigned long long> head;
+    std::atomic<bool> running;
+    pthread_t thread;
+    unsigned intervalMs;
+    double pressureThreshold;
+    std::mutex callbackLock;            // onPressure can be replaced while the thread runs
+    PressureCallback onPressure;
+    unsigned long long startedAtMs;
+
+    std::string pressurePath;
+    std::string usagePath;
+    std::string limitPath;
+    unsigned long long limitKb;
+    std::atomic<unsigned> peakRssKb;
+
+    static inline unsigned long long nowMs() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (unsigned long long)ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+    }
+
+    // Small procfs/sysfs files fit one read; a fresh fd per read keeps values current.
+    static std::string readSmall(const std::string& path) {
+        char buffer[4096];
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) return std::string();
+        ssize_t n = read(fd, buffer, sizeof(buffer) - 1);
+        close(fd);
+        return n > 0 ? std::string(buffer, n) : std::string();
+    }
+
+    static unsigned long long fieldAfter(const std::string& text, const char* key) {
+        size_t pos = text.find(key);
+        return pos == std::string::npos ? 0 : strtoull(text.c_str() + pos + strlen(key), nullptr, 10);
+    }
+
+    static unsigned short psiAvg10(const std::string& text, const char* line) {
+        size_t pos = text.find(line);
+        if (pos == std::string::npos) return 0;
+        pos = text.find("avg10=", pos);
+        return pos == std::string::npos ? 0 : (unsigned short)(strtod(text.c_str() + pos + 6, nullptr) * 100);
+    }
+
+    std::string summaryOf(const CosMemorySample& last) const {
+        char line[160];
+        snprintf(line, sizeof(line), "Memory: RSS %.1f MB (peak %.1f MB), heap %.1f MB, PSI some %.2f%%",
+                 last.rssKb / 1024.0, peakRss() / 1024.0, last.heapKb / 1024.0, last.psiSome10 / 100.0);
+        std::string out = line;
+        if (limitKb) {
+            snprintf(line, sizeof(line), ", cgroup %.1f of %.1f MB", last.cgroupKb / 1024.0, limitKb / 1024.0);
+            out += line;
+        }
+        return out + "\n";
+    }
+
+    // cgroup v2 first, then the v1 memory controller; system-wide PSI as the last resort.
+    void locateCgroup() {
+        std::string cgroups = readSmall("/proc/self/cgroup");
+        std::string v2, v1;
+        size_t start = 0;
+        while (start < cgroups.size()) {
+            size_t end = cgroups.find('\n', start);
+            if (end == std::string::npos) end = cgroups.size();
+            std::string line = cgroups.substr(start, end - start);
+            if (line.compare(0, 3, "0::") == 0) v2 = line.substr(3);
+            size_t mem = line.find(":memory:");
+            if (mem != std::string::npos) v1 = line.substr(mem + 8);
+            start = end + 1;
+        }
+
+        std::string base = "/sys/fs/cgroup" + v2;
+        if (!v2.empty() && access((base + "/memory.current").c_str(), R_OK) == 0) {
+            usagePath = base + "/memory.current";
+            limitPath = base + "/memory.max";
+            pressurePath = base + "/memory.pressure";
+        } else if (!v1.empty()) {
+            base = "/sys/fs/cgroup/memory" + v1;
+            usagePath = base + "/memory.usage_in_bytes";
+            limitPath = base + "/memory.limit_in_bytes";
+        }
+        if (pressurePath.empty() || access(pressurePath.c_str(), R_OK) != 0) pressurePath = "/proc/pressure/memory";
+
+        // v2 says "max" when unlimited, v1 a number near LLONG_MAX.
+        std::string limit = readSmall(limitPath);
+        unsigned long long bytes = (limit.empty() || limit.compare(0, 3, "max") == 0) ? 0 : strtoull(limit.c_str(), nullptr, 10);
+        limitKb = bytes >= (1ULL << 60) ? 0 : bytes / 1024;
+    }
+
+    CosMemorySample takeSample() const {
+        CosMemorySample s;
+        memset(&s, 0, sizeof(s));
+        s.msSinceStart = (unsigned)(nowMs() - startedAtMs);
+
+        std::string statm = readSmall("/proc/self/statm");
+        unsigned long long pages = 0, resident = 0;
+        if (sscanf(statm.c_str(), "%llu %llu", &pages, &resident) == 2)
+            s.rssKb = (unsigned)(resident * (sysconf(_SC_PAGESIZE) / 1024));
+
+        s.pssKb = (unsigned)fieldAfter(readSmall("/proc/self/smaps_rollup"), "\nPss:");
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+        struct mallinfo2 mi = mallinfo2();
+        s.heapKb = (unsigned)((mi.uordblks + mi.hblkhd) / 1024);
+#endif
+
+        if (!usagePath.empty()) s.cgroupKb = (unsigned)(strtoull(readSmall(usagePath).c_str(), nullptr, 10) / 1024);
+
+        std::string psi = readSmall(pressurePath);
+        s.psiSome10 = psiAvg10(psi, "some");
+        s.psiFull10 = psiAvg10(psi, "full");
+        return s;
+    }
+
+    static void* threadFunc(void* arg) {
+        CosMemorySampler* self = static_cast<CosMemorySampler*>(arg);
+        bool warned = false;
+
+        while (self->running.load(std::memory_order_acquire)) {
+            CosMemorySample s = self->takeSample();
+            unsigned long long h = self->head.load(std::memory_order_relaxed);
+            self->ring[h % self->ring.size()] = s;
+            self->head.store(h + 1, std::memory_order_release);
+            if (s.rssKb > self->peakRssKb.load(std::memory_order_relaxed))
+                self->peakRssKb.store(s.rssKb, std::memory_order_relaxed);
+
+            // Edge-triggered with hysteresis so a plateau does not fire every tick.
+            double some = s.psiSome10 / 100.0;
+            if (!warned && self->pressureThreshold > 0 && some >= self->pressureThreshold) {
+                warned = true;
+                PressureCallback callback;
+                {
+                    std::lock_guard<std::mutex> guard(self->callbackLock);
+                    callback = self->onPressure;
+                }
+                if (callback) callback(s);
+            } else if (warned && some < self->pressureThreshold / 2) {
+                warned = false;
+            }
+
+            for (unsigned slept = 0; slept < self->intervalMs && self->running.load(std::memory_order_acquire); slept += 50)
+                usleep(50 * 1000);
+        }
+        return nullptr;
+    }
+
+public:
+    CosMemorySampler() : head(0), running(false), intervalMs(0), pressureThreshold(0),
+        startedAtMs(nowMs()), limitKb(0), peakRssKb(0) {}
+
+    ~CosMemorySampler() { stop(); }
+
+    bool start(unsigned interval, size_t history, double threshold) {
+        if (running.load(std::memory_order_acquire) || !interval || !history) return false;
+        intervalMs = interval;
+        pressureThreshold = threshold;
+        ring.assign(history, CosMemorySample());
+        locateCgroup();
+
+        running.store(true, std::memory_order_release);
+        if (pthread_create(&thread, nullptr, threadFunc, this) != 0) {
+            running.store(false, std::memory_order_release);
+            return false;
+        }
+        return true;
+    }
+
+    void stop() {
+        if (running.exchange(false, std::memory_order_acq_rel)) pthread_join(thread, nullptr);
+    }
+
+    // Runs on the sampler thread when PSI "some avg10" reaches the threshold percentage.
+    // Safe to call while sampling; a callback already running finishes on the old copy.
+    void setPressureCallback(PressureCallback callback) {
+        std::lock_guard<std::mutex> guard(callbackLock);
+        onPressure = std::move(callback);
+    }
+
+    inline unsigned long long cgroupLimitKb() const { return limitKb; }
+    inline unsigned peakRss() const { return peakRssKb.load(std::memory_order_relaxed); }
+
+    // Oldest first. A sample overwritten while copying is dropped, as is the
+    // one whose slot the sampler is about to fill.
+    std::vector<CosMemorySample> series() const {
+        std::vector<CosMemorySample> out;
+        if (ring.empty()) return out;
+        unsigned long long h = head.load(std::memory_order_acquire);
+        unsigned long long first = h > ring.size() ? h - ring.size() : 0;
+        for (unsigned long long i = first; i < h; i++) out.push_back(ring[i % ring.size()]);
+        unsigned long long after = head.load(std::memory_order_acquire);
+        unsigned long long lapped = after + 1 > ring.size() ? after + 1 - ring.size() : 0;
+        if (lapped > first) out.erase(out.begin(), out.begin() + std::min<size_t>(lapped - first, out.size()));
+        return out;
+    }
+
+    // One line on the latest sample and the peak, or empty before the first sample.
+    std::string summary() const {
+        std::vector<CosMemorySample> s = series();
+        if (s.empty()) return std::string();
+        return summaryOf(s.back());
+    }
+
+    CosMemorySampler(const CosMemorySampler&) = delete;
+    CosMemorySampler& operator=(const CosMemorySampler&) = delete;
+};
+
+#endif // __linux__
+
+#endif // COS_MEMORY_H
@@ -0,0 +1,342 @@
+#ifndef COS_REDACT_H
+#define COS_REDACT_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Masks secrets in captured output with '*', byte for byte, so offsets and
+// line counts stay valid. Three kinds of rule share one case-insensitive
+// Aho-Corasick automaton: key rules ("password", "api_key", ...) mask the
+// value after a following '=' or ':', prefix rules ("Bearer ") the value
+// right after them, and token rules ("AKIA", "ghp_", "eyJ", ...) the token
+// itself. Values and tokens are runs of the rule's character class, masked
+// once they reach its minimum length. While the automaton sits at its root,
+// text is skipped two bytes at a time. A match spans at least four bytes (a
+// three-byte trigger counts the separator or value byte after it), so one
+// starting at i - 1 or i has known bytes at i..i+2, and one probe of a hashed
+// bit table rules both out. A hit is checked against the four bytes a match
+// can start with before the automaton steps in.
+// State carries across calls, so a match split between two reads is still
+// masked; only a token's trigger bytes already passed on stay as they were.
+class CosRedactor {
+public:
+    struct State {
+        uint32_t node = 0;
+        uint8_t mode = SCAN;
+        uint8_t sepSeen = 0;
+        uint16_t rule = 0;
+        uint32_t runLen = 0;
+        bool carried = false;       // the value started in an earlier call
+        bool counted = false;
+    };
+
+private:
+    enum : uint8_t { SCAN, SEPARATOR, VALUE };
+    enum Kind : uint8_t { KEY, PREFIX, TOKEN };
+
+    struct Rule {
+        std::string trigger;
+        Kind kind;
+        uint32_t minLen;
+        uint32_t maxLen;
+        uint64_t cls[4];
+    };
+
+    std::vector<Rule> rules;
+    uint8_t classOf[256];
+    int classes;
+    std::vector<uint32_t> next;     // node * classes + class
+    std::vector<int32_t> output;    // rule of the longest trigger ending at node, or -1
+    std::vector<uint64_t> grams;    // bytes 0-2 and 1-3 of each match, any case, hashed
+    std::vector<uint64_t> heads;    // bytes 0-3 of each match, two hashes
+    bool built;
+
+    static inline unsigned char fold(unsigned char c) { return c >= 'A' && c <= 'Z' ? c + 32 : c; }
+
+    static inline bool inClass(const uint64_t* cls, unsigned char c) { return (cls[c >> 6] >> (c & 63)) & 1; }
+
+    static void setClass(uint64_t* cls, const char* chars) {
+        memset(cls, 0, 4 * sizeof(uint64_t));
+        for (const char* p = chars; *p; p++) {
+            if (p[1] == '-' && p[2]) {
+                for (int c = (unsigned char)p[0]; c <= (unsigned char)p[2]; c++) cls[c >> 6] |= 1ULL << (c & 63);
+                p += 2;
+            } else {
+                cls[(unsigned char)*p >> 6] |= 1ULL << ((unsigned char)*p & 63);
+            }
+        }
+    }
+
+    void add(const std::string& trigger, Kind kind, const char* cls, uint32_t minLen, uint32_t maxLen) {
+        // Shorter triggers would match too much text to skip over.
+        if (trigger.size() < 3) return;
+        Rule r = { trigger, kind, minLen, maxLen, {} };
+        for (char& c : r.trigger) c = (char)fold((unsigned char)c);
+        setClass(r.cls, cls);
+        rules.push_back(r);
+        built = false;
+    }
+
+    // Line breaks stay, so line numbers and the index still add up.
+    static void mask(char* data, size_t from, size_t to) {
+        for (size_t i = from; i < to; i++) {
+            if (data[i] != '\n' && data[i] != '\r') data[i] = '*';
+        }
+    }
+
+    static inline uint32_t load(const unsigned char* p) {
+        uint32_t x;
+        memcpy(&x, p, 4);
+        return x;
+    }
+
+    static inline bool testBit(const uint64_t* table, uint32_t bit) { return (table[bit >> 6] >> (bit & 63)) & 1; }
+    static void setBit(std::vector<uint64_t>& table, uint32_t bit) { table[bit >> 6] |= 1ULL << (bit & 63); }
+
+    static inline uint32_t gramHash(uint32_t x) { return ((x & 0xffffff) * 0x9E3779B1u) >> 16; }
+    static inline uint32_t headHash1(uint32_t x) { return (x * 0x9E3779B1u) >> 16; }
+    static inline uint32_t headHash2(uint32_t x) { return (x * 0x85EBCA77u) >> 16; }
+
+    // Reads four bytes; only the first three count.
+    static inline uint64_t gramAt(const uint64_t* table, const unsigned char* p) {
+        uint32_t h = gramHash(load(p));
+        return (table[h >> 6] >> (h & 63)) & 1;
+    }
+
+    static inline bool headAt(const uint64_t* table, const unsigned char* p) {
+        uint32_t x = load(p);
+        return testBit(table, headHash1(x)) && testBit(table, headHash2(x));
+    }
+
+    // First position in [i, len) where a match may start; p[i - 1] has been
+    // stepped already. Tables are read through locals, since stores through
+    // the caller's data may alias the members.
+    inline size_t skip(const unsigned char* p, size_t i, size_t len) const {
+        const uint64_t* gt = grams.data();
+        const uint64_t* ht = heads.data();
+        size_t from = i;
+        for (;;) {
+            while (i + 10 <= len && !(gramAt(gt, p + i) | gramAt(gt, p + i + 2) |
+                                      gramAt(gt, p + i + 4) | gramAt(gt, p + i + 6)))
+                i += 8;
+            while (i + 4 <= len && !gramAt(gt, p + i)) i += 2;
+            if (i + 4 > len) return i > from ? i - 1 : i;
+            if (i > from && headAt(ht, p + i - 1)) return i - 1;
+            if (headAt(ht, p + i)) return i;
+            i += 2;
+        }
+    }
+
+public:
+    CosRedactor() : classes(0), built(false) { memset(classOf, 0, sizeof(classOf)); }
+
+    // Keys whose values are masked: "password=hunter2", "token: abc", "\"secret\": \"x\"".
+    void addKey(const std::string& key) {
+        add(key, KEY, "0-9A-Za-z\x80-\xff!#$%()*+./:<=>?@[]^_`{|}~-", 1, 4096);
+    }
+
+    // At least minLen bytes of cls (ranges like "A-Z0-9") right after prefix.
+    void addPrefix(const std::string& prefix, const char* cls, uint32_t minLen, uint32_t maxLen = 4096) {
+        add(prefix, PREFIX, cls, minLen, maxLen);
+    }
+
+    // A token starting with trigger, then at least minLen bytes of cls; the
+    // trigger is masked with the rest.
+    void addToken(const std::string& trigger, const char* cls, uint32_t minLen, uint32_t maxLen = 4096) {
+        add(trigger, TOKEN, cls, minLen, maxLen);
+    }
+
+    void addDefaults() {
+        static const char* const keys[] = {
+            "password", "passwd", "pwd", "secret", "token", "api_key", "apikey", "api-key",
+            "access_key", "secret_key", "private_key", "client_secret", "auth_token",
+            "session_id", "sessionid", "cookie",
+        };
+        for (const char* k : keys) addKey(k);
+        addPrefix("bearer ", "A-Za-z0-9._~+/=-", 8);
+        addPrefix("basic ", "A-Za-z0-9+/=", 8);
+        addToken("akia", "A-Z0-9", 16, 16);
+        addToken("asia", "A-Z0-9", 16, 16);
+        addToken("aiza", "A-Za-z0-9_-", 35, 35);
+        addToken("ghp_", "A-Za-z0-9", 30);
+        addToken("gho_", "A-Za-z0-9", 30);
+        addToken("ghs_", "A-Za-z0-9", 30);
+        addToken("github_pat_", "A-Za-z0-9_", 40);
+        addToken("glpat-", "A-Za-z0-9_-", 20);
+        addToken("xoxb-", "A-Za-z0-9-", 10);
+        addToken("xoxp-", "A-Za-z0-9-", 10);
+        addToken("sk_live_", "A-Za-z0-9", 16);
+        addToken("rk_live_", "A-Za-z0-9", 16);
+        addToken("eyj", "A-Za-z0-9_.-", 20);
+        addPrefix("private key-----", "A-Za-z0-9+/=\r\n", 16, 1 << 20);
+    }
+
+    inline bool active() const { return built && !rules.empty(); }
+    inline size_t ruleCount() const { return rules.size(); }
+
+    // Compiles the rules into the automaton; call once before apply().
+    void build() {
+        memset(classOf, 0, sizeof(classOf));
+        classes = 1;
+        for (const Rule& r : rules) {
+            for (unsigned char c : r.trigger) {
+                if (!classOf[c]) classOf[c] = (uint8_t)classes++;
+            }
+        }
+        for (int c = 'A'; c <= 'Z'; c++) classOf[c] = classOf[c + 32];
+
+        // Trie over classes, then breadth-first failure links folded into next.
+        next.assign(classes, 0);
+        output.assign(1, -1);
+        std::vector<uint32_t> depth(1, 0);
+        for (size_t i = 0; i < rules.size(); i++) {
+            uint32_t node = 0;
+            for (unsigned char c : rules[i].trigger) {
+                uint32_t& to = next[node * classes + classOf[c]];
+                if (!to) {
+                    to = (uint32_t)output.size();
+                    output.push_back(-1);
+                    depth.push_back(depth[node] + 1);
+                    next.resize(next.size() + classes, 0);
+                }
+                node = next[node * classes + classOf[c]];
+            }
+            output[node] = (int32_t)i;
+        }
+
+        std::vector<uint32_t> fail(output.size(), 0), queue;
+        for (int c = 1; c < classes; c++) {
+            if (next[c]) queue.push_back(next[c]);
+        }
+        for (size_t q = 0; q < queue.size(); q++) {
+            uint32_t node = queue[q];
+            if (output[node] < 0) output[node] = output[fail[node]];
+            for (int c = 1; c < classes; c++) {
+                uint32_t& to = next[node * classes + c];
+                uint32_t via = next[fail[node] * classes + c];
+                if (to) {
+                    fail[to] = via;
+                    queue.push_back(to);
+                } else {
+                    to = via;
+                }
+            }
+        }
+
+        grams.assign(65536 / 64, 0);
+        heads.assign(65536 / 64, 0);
+        for (const Rule& r : rules) {
+            // A three-byte trigger is followed by a separator or its value.
+            std::string after;
+            if (r.trigger.size() > 3) {
+                after = { r.trigger[3], (char)(r.trigger[3] >= 'a' && r.trigger[3] <= 'z' ? r.trigger[3] - 32 : r.trigger[3]) };
+            } else if (r.kind == KEY) {
+                after = " \t\"'=:";
+            } else {
+                for (int c = 1; c < 256; c++) {
+                    if (inClass(r.cls, (unsigned char)c)) after += (char)c;
+                }
+            }
+            for (int variant = 0; variant < 8; variant++) {
+                unsigned char head[4];
+                for (int k = 0; k < 3; k++) {
+                    unsigned char c = (unsigned char)r.trigger[k];
+                    head[k] = (variant >> k) & 1 && c >= 'a' && c <= 'z' ? c - 32 : c;
+                }
+                for (char c : after) {
+                    head[3] = (unsigned char)c;
+                    uint32_t x = load(head);
+                    setBit(heads, headHash1(x));
+                    setBit(heads, headHash2(x));
+                    setBit(grams, gramHash(x));
+                    setBit(grams, gramHash(x >> 8));
+                }
+            }
+        }
+        built = true;
+    }
+
+    // Masks secrets in data[0, len) in place; returns how many were masked.
+    size_t apply(State& s, char* data, size_t len) {
+        if (!active()) return 0;
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+        size_t found = 0;
+        size_t runStart = 0;
+        size_t i = 0;
+
+        while (i < len) {
+            if (s.mode == SCAN) {
+                if (!s.node) {
+                    i = skip(p, i, len);
+                    if (i >= len) break;
+                }
+                s.node = next[s.node * classes + classOf[p[i]]];
+                i++;
+                int32_t r = output[s.node];
+                if (r < 0) continue;
+
+                const Rule& rule = rules[r];
+                s.node = 0;
+                s.rule = (uint16_t)r;
+                s.runLen = 0;
+                s.counted = false;
+                if (rule.kind == KEY) {
+                    s.mode = SEPARATOR;
+                    s.sepSeen = 0;
+                } else if (rule.kind == PREFIX) {
+                    s.mode = VALUE;
+                    s.carried = false;
+                    runStart = i;
+                } else {
+                    s.mode = VALUE;
+                    s.carried = i < rule.trigger.size();
+                    runStart = s.carried ? 0 : i - rule.trigger.size();
+                }
+                continue;
+            }
+
+            const Rule& rule = rules[s.rule];
+            unsigned char c = p[i];
+            if (s.mode == SEPARATOR) {
+                // key["'] *[=:] *["']value
+                if (c == ' ' || c == '\t' || c == '"' || c == '\'') {
+                    i++;
+                } else if (!s.sepSeen && (c == '=' || c == ':')) {
+                    s.sepSeen = 1;
+                    i++;
+                } else if (s.sepSeen && inClass(rule.cls, c)) {
+                    s.mode = VALUE;
+                    s.carried = false;
+                    runStart = i;
+                } else {
+                    s.mode = SCAN;
+                }
+                continue;
+            }
+
+            size_t run = i;
+            while (run < len && run - i < rule.maxLen - s.runLen && inClass(rule.cls, p[run])) run++;
+            s.runLen += (uint32_t)(run - i);
+            i = run;
+            if (i == len) break;
+            if (s.runLen >= rule.minLen || (s.carried && s.runLen)) {
+                mask(data, runStart, i);
+                found += !s.counted;
+            }
+            s.mode = SCAN;
+        }
+
+        // A value still open at the end is masked now; the next call finishes it.
+        if (s.mode == VALUE && (s.runLen || s.carried)) {
+            mask(data, runStart, len);
+            found += !s.counted;
+            s.counted = true;
+            s.carried = true;
+        }
+        return found;
+    }
+};
+
+#endif // COS_REDACT_H
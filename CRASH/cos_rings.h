@@ -0,0 +1,123 @@
+#ifndef COS_RINGS_H
+#define COS_RINGS_H
+
+#include "cos_log.h"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Per-thread rings of Entry for the always-on recorders (CosFlight, CosTrace).
+// Each thread appends to its own ring with no lock and overwrites the oldest;
+// readers take lock, with try_lock from a crash handler, and copy. One
+// registry per Entry type, created on first use, which also sets the epoch
+// that raw ticks are converted from.
+template <typename Entry, size_t N>
+class CosThreadRings {
+public:
+    static_assert(N && !(N & (N - 1)), "ring size must be a power of two");
+
+    struct Ring {
+        std::atomic<uint64_t> head{0};
+        std::atomic<bool> retired{false};
+        int tid = 0;
+        Entry entries[N];
+    };
+
+    // Rings outlive their threads: what a finished worker did last still
+    // belongs in a dump. Past KEEP_RETIRED of them, a new thread takes over
+    // the oldest.
+    static constexpr size_t KEEP_RETIRED = 32;
+
+    std::mutex lock;
+    std::vector<Ring*> rings;
+    std::atomic<bool> active{false};
+    uint64_t epochTicks = CosLog::ticks();
+    uint64_t epochNs = CosLog::monotonicNs();
+
+    static inline CosThreadRings& instance() {
+        static CosThreadRings reg;
+        return reg;
+    }
+
+    // The plain pointer needs no TLS init guard; Owner only exists to retire the ring.
+    static inline Ring* local() {
+        static thread_local Ring* cached = nullptr;
+        return cached ? cached : (cached = instance().registerThread());
+    }
+
+    static inline int threadId() {
+#ifdef __linux__
+        return (int)syscall(SYS_gettid);
+#else
+        return 0;
+#endif
+    }
+
+    // Nanoseconds per tick over everything since the epoch.
+    inline double nsPerTick() const {
+        uint64_t nowTicks = CosLog::ticks(), nowNs = CosLog::monotonicNs();
+        return nowTicks > epochTicks ? (double)(nowNs - epochNs) / (double)(nowTicks - epochTicks) : 1.0;
+    }
+
+    // Appends convert(entry) for r's entries, oldest first. Entries the owner
+    // lapped while they were being copied are torn and dropped again, as is
+    // entry after - N: with head at after, its slot is the one being written.
+    template <typename Out, typename Convert>
+    static void copy(const Ring* r, std::vector<Out>& out, Convert convert) {
+        uint64_t head = r->head.load(std::memory_order_acquire);
+        uint64_t first = head > N ? head - N : 0;
+        size_t base = out.size();
+        for (uint64_t i = first; i < head; i++) out.push_back(convert(r->entries[i & (N - 1)]));
+
+        uint64_t after = r->head.load(std::memory_order_acquire);
+        uint64_t lapped = after + 1 > N ? after + 1 - N : 0;
+        if (lapped > first)
+            out.erase(out.begin() + base, out.begin() + base + std::min<size_t>(lapped - first, out.size() - base));
+    }
+
+private:
+    struct Owner {
+        Ring* ring = nullptr;
+        ~Owner() {
+            if (ring) ring->retired.store(true, std::memory_order_release);
+        }
+    };
+
+    CosThreadRings() = default;
+
+    Ring* registerThread() {
+        static thread_local Owner owner;
+
+        std::lock_guard<std::mutex> guard(lock);
+        size_t retired = 0;
+        Ring* reuse = nullptr;
+        for (Ring* r : rings) {
+            if (!r->retired.load(std::memory_order_acquire)) continue;
+            if (!reuse) reuse = r;
+            retired++;
+        }
+        Ring* ring = reuse && retired >= KEEP_RETIRED ? reuse : new Ring();
+        if (ring == reuse) {
+            rings.erase(std::find(rings.begin(), rings.end(), ring));
+            ring->head.store(0, std::memory_order_relaxed);
+            ring->retired.store(false, std::memory_order_relaxed);
+        }
+        ring->tid = threadId();
+        rings.push_back(ring);
+        owner.ring = ring;
+        active.store(true, std::memory_order_release);
+        return ring;
+    }
+
+    CosThreadRings(const CosThreadRings&) = delete;
+    CosThreadRings& operator=(const CosThreadRings&) = delete;
+};
+
+#endif // COS_RINGS_H
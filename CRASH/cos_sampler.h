@@ -0,0 +1,336 @@
+#ifndef COS_SAMPLER_H
+#define COS_SAMPLER_H
+
+#ifdef __linux__
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "cos_unwind.h"
+#include <cxxabi.h>
+#include <execinfo.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+struct CosSamplerStats {
+    unsigned long long samples;
+    unsigned long long dropped;
+    unsigned long long avgCostNs;
+    unsigned threads;
+};
+
+// SIGPROF CPU sampler. ITIMER_PROF delivers the signal to whichever thread is
+// burning CPU; the handler unwinds that thread into its own ring, so the hot
+// path never shares a cache line between threads. Rings are one lazily touched
+// mapping: a thread slot costs memory only once the thread has been sampled.
+class CosSampler {
+public:
+    static const int MAX_DEPTH = 40;
+
+private:
+    struct Sample {
+        unsigned long long timeNs;
+        void* pc;
+        int depth;
+        void* frames[MAX_DEPTH];
+    };
+
+    struct ThreadRing {
+        std::atomic<bool> used{false};
+        std::atomic<unsigned long long> head{0};
+        std::atomic<pid_t> tid{0};          // 0 while a slot is being claimed
+        Sample* samples = nullptr;
+    };
+
+    ThreadRing* rings;
+    int ringCount;
+    size_t capacity;
+    void* mapping;
+    size_t mappingSize;
+    std::atomic<bool> running;
+    std::atomic<unsigned long long> samples;
+    std::atomic<unsigned long long> dropped;
+    std::atomic<unsigned long long> costNs;
+    unsigned generation;
+
+    static inline std::atomic<CosSampler*>& active() {
+        static std::atomic<CosSampler*> current{nullptr};
+        return current;
+    }
+
+    static inline unsigned& nextGeneration() {
+        static unsigned value = 0;
+        return value;
+    }
+
+    // Static TLS: safe to touch from a signal handler, unlike dynamic TLS.
+    static inline ThreadRing*& threadRing() {
+        static __thread ThreadRing* ring __attribute__((tls_model("initial-exec"))) = nullptr;
+        return ring;
+    }
+
+    static inline unsigned& threadGeneration() {
+        static __thread unsigned gen __attribute__((tls_model("initial-exec"))) = 0;
+        return gen;
+    }
+
+    static inline unsigned long long nowNs() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    }
+
+    inline ThreadRing* claim(ThreadRing& ring) {
+        threadRing() = &ring;
+        threadGeneration() = generation;
+        return &ring;
+    }
+
+    // Runs in the signal handler, so there is no thread-exit hook to free a
+    // slot. Once all are taken, a slot whose thread is gone (or whose tid the
+    // kernel handed to us) is taken over; its samples age out as ours arrive.
+    ThreadRing* ringForThread() {
+        if (threadGeneration() == generation && threadRing()) return threadRing();
+        pid_t self = (pid_t)syscall(SYS_gettid);
+        for (int i = 0; i < ringCount; i++) {
+            bool expected = false;
+            if (rings[i].used.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) {
+                rings[i].tid.store(self, std::memory_order_relaxed);
+                return claim(rings[i]);
+            }
+        }
+
+        pid_t pid = getpid();
+        for (int i = 0; i < ringCount; i++) {
+            pid_t owner = rings[i].tid.load(std::memory_order_relaxed);
+            if (!owner) continue;
+            if (owner != self && !(syscall(SYS_tgkill, pid, owner, 0) != 0 && errno == ESRCH)) continue;
+            if (rings[i].tid.compare_exchange_strong(owner, self, std::memory_order_acq_rel)) return claim(rings[i]);
+        }
+        return nullptr;
+    }
+
+    static inline void* contextPc(void* context) {
+        ucontext_t* uc = static_cast<ucontext_t*>(context);
+#if defined(__x86_64__)
+        return reinterpret_cast<void*>(uc->uc_mcontext.gregs[REG_RIP]);
+#elif defined(__aarch64__)
+        return reinterpret_cast<void*>(uc->uc_mcontext.pc);
+#else
+        (void)uc;
+        return nullptr;
+#endif
+    }
+
+    static void profSignalHandler(int, siginfo_t*, void* context) {
+        int savedErrno = errno;
+        CosSampler* sampler = active().load(std::memory_order_acquire);
+        if (sampler && sampler->running.load(std::memory_order_relaxed)) {
+            unsigned long long start = nowNs();
+            ThreadRing* ring = sampler->ringForThread();
+            if (ring) {
+                unsigned long long h = ring->head.load(std::memory_order_relaxed);
+                Sample& s = ring->samples[h % sampler->capacity];
+                s.timeNs = start;
+                s.pc = contextPc(context);
+                s.depth = CosUnwind::fromContext(context, s.frames, MAX_DEPTH);
+                ring->head.store(h + 1, std::memory_order_release);
+                sampler->samples.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                sampler->dropped.fetch_add(1, std::memory_order_relaxed);
+            }
+            sampler->costNs.fetch_add(nowNs() - start, std::memory_order_relaxed);
+        }
+        errno = savedErrno;
+    }
+
+    // Frames above the interrupted pc belong to the handler and the signal trampoline.
+    static std::vector<void*> userFrames(const Sample& s) {
+        std::vector<void*> out;
+        int first = -1;
+        for (int i = 0; i < s.depth; i++) {
+            if (s.frames[i] == s.pc) { first = i; break; }
+        }
+        if (first < 0) first = s.depth < 2 ? s.depth : 2;
+        for (int i = first; i < s.depth; i++) out.push_back(s.frames[i]);
+        return out;
+    }
+
+public:
+    // "module(symbol+off) [addr]" from backtrace_symbols() to a demangled name, or "[module]".
+    static std::string symbolName(const char* symbol) {
+        const char* open = strchr(symbol, '(');
+        const char* plus = open ? strchr(open, '+') : nullptr;
+        const char* close = open ? strchr(open, ')') : nullptr;
+        if (open && plus && (!close || plus < close) && plus > open + 1) {
+            std::string mangled(open + 1, plus);
+            int status = 0;
+            char* demangled = abi::__cxa_demangle(mangled.c_str(), nullptr, nullptr, &status);
+            if (demangled) {
+                std::string name = status == 0 ? std::string(demangled) : mangled;
+                free(demangled);
+                return name;
+            }
+            return mangled;
+        }
+        std::string module = open ? std::string(symbol, open) : std::string(symbol);
+        size_t slash = module.rfind('/');
+        if (slash != std::string::npos) module = module.substr(slash + 1);
+        return "[" + module + "]";
+    }
+
+    CosSampler() : rings(nullptr), ringCount(0), capacity(0), mapping(nullptr), mappingSize(0),
+        running(false), samples(0), dropped(0), costNs(0), generation(0) {}
+
+    ~CosSampler() {
+        stop();
+        if (mapping) munmap(mapping, mappingSize);
+        delete[] rings;
+    }
+
+    // Keeps the last windowSec seconds of samples for up to maxThreads threads.
+    bool start(unsigned rateHz, unsigned windowSec, int maxThreads) {
+        if (running.load(std::memory_order_acquire) || !rateHz || maxThreads <= 0) return false;
+
+        ringCount = maxThreads;
+        capacity = (size_t)rateHz * (windowSec ? windowSec : 1);
+        mappingSize = (size_t)ringCount * capacity * sizeof(Sample);
+        mapping = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (mapping == MAP_FAILED) {
+            mapping = nullptr;
+            return false;
+        }
+
+        rings = new ThreadRing[ringCount];
+        for (int i = 0; i < ringCount; i++) rings[i].samples = static_cast<Sample*>(mapping) + i * capacity;
+        generation = ++nextGeneration();
+
+        CosUnwind::init();
+
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_sigaction = profSignalHandler;
+        sa.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGPROF, &sa, nullptr);
+
+        active().store(this, std::memory_order_release);
+        running.store(true, std::memory_order_release);
+
+        struct itimerval timer;
+        timer.it_interval.tv_sec = 0;
+        timer.it_interval.tv_usec = rateHz >= 1000000 ? 1 : 1000000 / rateHz;
+        timer.it_value = timer.it_interval;
+        if (setitimer(ITIMER_PROF, &timer, nullptr) != 0) {
+            running.store(false, std::memory_order_release);
+            return false;
+        }
+        return true;
+    }
+
+    // Async-signal-safe: only disarms the timer, the rings stay readable.
+    void stop() {
+        if (!running.exchange(false, std::memory_order_acq_rel)) return;
+        struct itimerval timer;
+        memset(&timer, 0, sizeof(timer));
+        setitimer(ITIMER_PROF, &timer, nullptr);
+    }
+
+    inline bool isRunning() const { return running.load(std::memory_order_acquire); }
+
+    CosSamplerStats stats() const {
+        CosSamplerStats s;
+        s.samples = samples.load(std::memory_order_relaxed);
+        s.dropped = dropped.load(std::memory_order_relaxed);
+        unsigned long long total = s.samples + s.dropped;
+        s.avgCostNs = total ? costNs.load(std::memory_order_relaxed) / total : 0;
+        s.threads = 0;
+        for (int i = 0; i < ringCount; i++) s.threads += rings[i].used.load(std::memory_order_relaxed);
+        return s;
+    }
+
+    // Collapsed stacks, root first, one "frame;frame;frame count" line per stack,
+    // heaviest first. lastSeconds 0 means the whole window; maxStacks 0 means all.
+    std::string collapsed(unsigned lastSeconds = 0, size_t maxStacks = 0) const {
+        if (!rings) return std::string();
+        unsigned long long since = lastSeconds ? nowNs() - lastSeconds * 1000000000ULL : 0;
+
+        std::map<std::vector<void*>, unsigned long long> stacks;
+        std::vector<Sample> copy;
+        for (int r = 0; r < ringCount; r++) {
+            const ThreadRing& ring = rings[r];
+            if (!ring.used.load(std::memory_order_acquire)) continue;
+
+            unsigned long long head = ring.head.load(std::memory_order_acquire);
+            unsigned long long first = head > capacity ? head - capacity : 0;
+            copy.clear();
+            for (unsigned long long i = first; i < head; i++) copy.push_back(ring.samples[i % capacity]);
+
+            // Entries the owner lapped while we were copying are torn, and so
+            // may be entry after - capacity: its slot is the one being written next.
+            unsigned long long after = ring.head.load(std::memory_order_acquire);
+            unsigned long long valid = after + 1 > capacity ? after + 1 - capacity : 0;
+            for (unsigned long long i = first; i < head; i++) {
+                const Sample& s = copy[i - first];
+                if (i < valid || s.timeNs < since || s.depth <= 0 || s.depth > MAX_DEPTH) continue;
+                stacks[userFrames(s)]++;
+            }
+        }
+
+        std::vector<void*> addrs;
+        for (const auto& entry : stacks) {
+            for (size_t i = 0; i < entry.first.size(); i++) {
+                char* a = static_cast<char*>(entry.first[i]);
+                addrs.push_back(i ? a - 1 : a);
+            }
+        }
+        std::unordered_map<void*, std::string> names;
+        if (!addrs.empty()) {
+            char** symbols = backtrace_symbols(addrs.data(), (int)addrs.size());
+            if (symbols) {
+                for (size_t i = 0; i < addrs.size(); i++) names.emplace(addrs[i], symbolName(symbols[i]));
+                free(symbols);
+            }
+        }
+
+        // Different pcs inside the same functions fold into one line.
+        std::unordered_map<std::string, unsigned long long> folded;
+        for (const auto& entry : stacks) {
+            std::string line;
+            for (size_t i = entry.first.size(); i-- > 0;) {
+                char* a = static_cast<char*>(entry.first[i]);
+                auto it = names.find(i ? a - 1 : a);
+                if (!line.empty()) line += ";";
+                line += it != names.end() ? it->second : std::string("?");
+            }
+            folded[line] += entry.second;
+        }
+
+        std::vector<std::pair<unsigned long long, std::string>> lines;
+        for (const auto& entry : folded) lines.emplace_back(entry.second, entry.first);
+        std::sort(lines.begin(), lines.end(),
+                  [](const auto& a, const auto& b) { return a.first > b.first; });
+        if (maxStacks && lines.size() > maxStacks) lines.resize(maxStacks);
+
+        std::string out;
+        for (const auto& l : lines) out += l.second + " " + std::to_string(l.first) + "\n";
+        return out;
+    }
+
+    CosSampler(const CosSampler&) = delete;
+    CosSampler& operator=(const CosSampler&) = delete;
+};
+
+#endif // __linux__
+
+#endif // COS_SAMPLER_H
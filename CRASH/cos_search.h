@@ -0,0 +1,515 @@
+#ifndef COS_SEARCH_H
+#define COS_SEARCH_H
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "cos_index.h"
+
+// Sidecar filter of a COS log ("<log>.blm"): the log is cut into segments of
+// about segmentBytes, ending on a line break, and each gets two Bloom filters,
+// one of its case-folded byte trigrams and one of its words (runs of letters,
+// digits and '_' of 3 bytes or more). A fixed string whose trigrams, or whose
+// whole words, are not all in a segment's filters cannot occur there.
+struct CosFilterHeader {
+    static const uint32_t VERSION = 1;
+
+    char magic[8];          // "COSBLM\0\0"
+    uint32_t version;
+    uint32_t segmentBytes;
+    uint64_t indexedBytes;
+    uint64_t headHash;      // first 4 KiB of the log, to notice a rewritten file
+};
+
+// Followed by the trigram filter, then the word filter, in 64-bit words.
+struct CosFilterRecord {
+    uint64_t offset;
+    uint64_t bytes;
+    uint64_t firstLine;
+    uint32_t gramWords;
+    uint32_t wordWords;
+};
+
+static_assert(sizeof(CosFilterHeader) == 32 && sizeof(CosFilterRecord) == 32, "filter layout is on disk");
+
+class CosLogFilter {
+public:
+    static const uint32_t SEGMENT_BYTES = 1024 * 1024;
+    static const int HASHES = 3;
+
+    struct Segment {
+        uint64_t offset;
+        uint64_t bytes;
+        uint64_t firstLine;
+        std::vector<uint64_t> grams;
+        std::vector<uint64_t> words;
+    };
+
+    // What a query needs present: its trigrams, and the hashes of the words
+    // it holds whole.
+    struct Query {
+        std::vector<uint64_t> grams;
+        std::vector<uint64_t> words;
+    };
+
+private:
+    static const size_t TABLE = 1 << 19;
+
+    std::string logPath;
+    CosFilterHeader header;
+    std::vector<Segment> segments;
+
+    // Distinct trigrams and words of the segment being built. seen has one bit
+    // per possible trigram and table is open addressing over word hashes; only
+    // the entries a segment set are cleared after it.
+    std::vector<uint64_t> seen;
+    std::vector<uint32_t> grams;
+    std::vector<uint64_t> table;
+    std::vector<uint32_t> used;
+    std::vector<uint64_t> words;
+
+    // Trigram and word in progress, carried across reads within a segment.
+    uint32_t partial;
+    unsigned gramLen;
+    uint64_t word;
+    unsigned wordLen;
+
+    static inline unsigned char fold(unsigned char c) { return c >= 'A' && c <= 'Z' ? c + 32 : c; }
+
+    static inline uint64_t mix(uint64_t h) {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    static inline uint64_t gramHash(uint32_t gram) { return mix((uint64_t)(gram + 1) * 0x9E3779B97F4A7C15ULL); }
+
+    // Bit i of the filter for h, by double hashing scaled onto its size.
+    static inline uint64_t bitOf(uint64_t h, int i, uint64_t bits) {
+        uint32_t x = (uint32_t)h + (uint32_t)i * ((uint32_t)(h >> 32) | 1);
+        return ((uint64_t)x * bits) >> 32;
+    }
+
+    static void insert(std::vector<uint64_t>& filter, uint64_t h) {
+        for (int i = 0; i < HASHES; i++) {
+            uint64_t b = bitOf(h, i, filter.size() * 64);
+            filter[b >> 6] |= 1ULL << (b & 63);
+        }
+    }
+
+    static bool contains(const std::vector<uint64_t>& filter, uint64_t h) {
+        if (filter.empty()) return false;
+        for (int i = 0; i < HASHES; i++) {
+            uint64_t b = bitOf(h, i, filter.size() * 64);
+            if (!(filter[b >> 6] & (1ULL << (b & 63)))) return false;
+        }
+        return true;
+    }
+
+    static uint64_t headHashOf(int fd) {
+        char buffer[4096];
+        ssize_t got = pread(fd, buffer, sizeof(buffer), 0);
+        uint64_t h = 1469598103934665603ULL;
+        for (ssize_t i = 0; i < got; i++) h = (h ^ (unsigned char)buffer[i]) * 1099511628211ULL;
+        return h;
+    }
+
+    void addWord(uint64_t h) {
+        if (words.size() >= TABLE / 2) {
+            words.push_back(h);         // counted twice at worst; the filter is only larger
+            return;
+        }
+        uint64_t key = h | 1;
+        for (uint32_t slot = (uint32_t)(h >> 45);; slot = (slot + 1) & (TABLE - 1)) {
+            if (table[slot] == key) return;
+            if (!table[slot]) {
+                table[slot] = key;
+                used.push_back(slot);
+                words.push_back(h);
+                return;
+            }
+        }
+    }
+
+    inline void endWord() {
+        if (wordLen >= 3) addWord(mix(word));
+        wordLen = 0;
+    }
+
+    void add(const char* p, size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            unsigned char c = fold((unsigned char)p[i]);
+            if (isWord(c)) {
+                if (!wordLen) word = 1469598103934665603ULL;
+                word = (word ^ c) * 1099511628211ULL;
+                wordLen++;
+            } else if (wordLen) {
+                endWord();
+            }
+            if (c == '\n') {
+                gramLen = 0;
+                continue;
+            }
+            partial = ((partial << 8) | c) & 0xFFFFFF;
+            if (++gramLen < 3) continue;
+            uint64_t& bits = seen[partial >> 6];
+            uint64_t bit = 1ULL << (partial & 63);
+            if (bits & bit) continue;
+            bits |= bit;
+            grams.push_back(partial);
+        }
+    }
+
+    // 8 bits per distinct trigram and 10 per word: false positive rates of
+    // about 3% and 2% per item, and far less for a query made of several.
+    Segment finishSegment(uint64_t offset, uint64_t bytes, uint64_t firstLine) {
+        endWord();
+        gramLen = 0;
+        Segment s = { offset, bytes, firstLine, {}, {} };
+        s.grams.assign(grams.size() / 8 + 1, 0);
+        for (uint32_t gram : grams) {
+            insert(s.grams, gramHash(gram));
+            seen[gram >> 6] = 0;
+        }
+        s.words.assign(words.size() * 10 / 64 + 1, 0);
+        for (uint64_t h : words) insert(s.words, h);
+        for (uint32_t slot : used) table[slot] = 0;
+        grams.clear();
+        used.clear();
+        words.clear();
+        return s;
+    }
+
+    // Indexes the log from offset to end; segments are only cut where the
+    // buffer holds a line break past segmentBytes.
+    bool indexFrom(int fd, uint64_t offset, uint64_t line, uint64_t end, uint32_t segmentBytes) {
+        if (seen.empty()) seen.assign((1 << 24) / 64, 0);
+        if (table.empty()) table.assign(TABLE, 0);
+        std::vector<char> buffer(1024 * 1024);
+        uint64_t segStart = offset, segLine = line;
+        while (offset < end) {
+            size_t want = end - offset < buffer.size() ? (size_t)(end - offset) : buffer.size();
+            ssize_t got = pread(fd, buffer.data(), want, offset);
+            if (got <= 0) return false;
+
+            const char* p = buffer.data();
+            const char* stop = p + got;
+            while (p < stop) {
+                uint64_t at = offset + (p - buffer.data());
+                size_t room = at - segStart < segmentBytes ? (size_t)(segmentBytes - (at - segStart)) : 0;
+                const char* cut = nullptr;
+                if ((size_t)(stop - p) > room) cut = static_cast<const char*>(memchr(p + room, '\n', stop - p - room));
+                const char* upto = cut ? cut + 1 : stop;
+                add(p, upto - p);
+                for (const char* q = p; (q = static_cast<const char*>(memchr(q, '\n', upto - q))); q++) line++;
+                p = upto;
+                if (cut) {
+                    uint64_t segEnd = offset + (p - buffer.data());
+                    segments.push_back(finishSegment(segStart, segEnd - segStart, segLine));
+                    segStart = segEnd;
+                    segLine = line;
+                }
+            }
+            offset += (uint64_t)got;
+        }
+        if (offset > segStart) segments.push_back(finishSegment(segStart, offset - segStart, segLine));
+        header.indexedBytes = offset;
+        return true;
+    }
+
+public:
+    CosLogFilter() : header(), partial(0), gramLen(0), word(0), wordLen(0) {}
+
+    static inline bool isWord(unsigned char c) {
+        return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c >= 0x80;
+    }
+
+    static std::string pathFor(const std::string& log) {
+        std::string path = log;
+        if (path.size() > 4 && path.compare(path.size() - 4, 4, ".log") == 0) path.resize(path.size() - 4);
+        return path + ".blm";
+    }
+
+    // A word of the query is only known to be whole in the log when something
+    // other than a word character, or the edge of a whole-word query, bounds it
+    // on both sides. Shorter than 3 bytes, a query filters nothing.
+    static Query queryFor(const std::string& text, bool wholeWord) {
+        Query q;
+        for (size_t i = 0; i + 3 <= text.size(); i++) {
+            uint32_t gram = ((uint32_t)fold(text[i]) << 16) | ((uint32_t)fold(text[i + 1]) << 8) | fold(text[i + 2]);
+            q.grams.push_back(gramHash(gram));
+        }
+        for (size_t i = 0; i < text.size();) {
+            if (!isWord(text[i])) {
+                i++;
+                continue;
+            }
+            size_t start = i;
+            uint64_t word = 1469598103934665603ULL;
+            for (; i < text.size() && isWord(text[i]); i++) word = (word ^ fold(text[i])) * 1099511628211ULL;
+            bool bounded = (start > 0 || wholeWord) && (i < text.size() || wholeWord);
+            if (bounded && i - start >= 3) q.words.push_back(mix(word));
+        }
+        return q;
+    }
+
+    static bool mayContain(const Segment& s, const Query& q) {
+        for (uint64_t h : q.grams) {
+            if (!contains(s.grams, h)) return false;
+        }
+        for (uint64_t h : q.words) {
+            if (!contains(s.words, h)) return false;
+        }
+        return true;
+    }
+
+    inline const std::vector<Segment>& all() const { return segments; }
+    inline uint64_t indexedBytes() const { return header.indexedBytes; }
+
+    // Reads the sidecar; false if it is missing or no longer matches the log.
+    bool load(const std::string& log) {
+        logPath = log;
+        segments.clear();
+        header = CosFilterHeader();
+
+        int logFd = ::open(log.c_str(), O_RDONLY | O_CLOEXEC);
+        if (logFd == -1) return false;
+        struct stat st;
+        bool ok = fstat(logFd, &st) == 0;
+        uint64_t head = headHashOf(logFd);
+        ::close(logFd);
+
+        FILE* f = ok ? fopen(pathFor(log).c_str(), "rb") : nullptr;
+        if (!f) return false;
+        ok = fread(&header, sizeof(header), 1, f) == 1 && memcmp(header.magic, "COSBLM\0\0", 8) == 0 &&
+             header.version == CosFilterHeader::VERSION && header.headHash == head &&
+             header.indexedBytes <= (uint64_t)st.st_size;
+        uint64_t covered = 0;
+        CosFilterRecord r;
+        while (ok && covered < header.indexedBytes && fread(&r, sizeof(r), 1, f) == 1) {
+            if (r.offset != covered || !r.gramWords || !r.wordWords) {
+                ok = false;
+                break;
+            }
+            Segment s = { r.offset, r.bytes, r.firstLine, std::vector<uint64_t>(r.gramWords),
+                          std::vector<uint64_t>(r.wordWords) };
+            if (fread(s.grams.data(), 8, s.grams.size(), f) != s.grams.size() ||
+                fread(s.words.data(), 8, s.words.size(), f) != s.words.size()) {
+                ok = false;
+                break;
+            }
+            covered += r.bytes;
+            segments.push_back(std::move(s));
+        }
+        fclose(f);
+        if (!ok || covered != header.indexedBytes) {
+            segments.clear();
+            header = CosFilterHeader();
+            return false;
+        }
+        return true;
+    }
+
+    // Brings the filter up to the log's current size; a log still being written
+    // only has its last segment and whatever followed re-read. save writes the
+    // sidecar back if it can (through a rename, so a reader never sees half of it).
+    bool update(const std::string& log, uint32_t segmentBytes, bool save) {
+        bool loaded = load(log);
+        int fd = ::open(log.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            return false;
+        }
+        if (loaded && header.indexedBytes == (uint64_t)st.st_size) {
+            ::close(fd);
+            return true;
+        }
+
+        uint64_t offset = 0, line = 0;
+        if (loaded && header.segmentBytes == segmentBytes && !segments.empty()) {
+            offset = segments.back().offset;
+            line = segments.back().firstLine;
+            segments.pop_back();
+        } else {
+            segments.clear();
+        }
+        memcpy(header.magic, "COSBLM\0\0", 8);
+        header.version = CosFilterHeader::VERSION;
+        header.segmentBytes = segmentBytes;
+        header.headHash = headHashOf(fd);
+        bool ok = indexFrom(fd, offset, line, (uint64_t)st.st_size, segmentBytes);
+        ::close(fd);
+        if (ok && save) write(pathFor(log));
+        return ok;
+    }
+
+    bool write(const std::string& path) const {
+        std::string tmp = path + ".tmp";
+        FILE* f = fopen(tmp.c_str(), "wb");
+        if (!f) return false;
+        bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+        for (const Segment& s : segments) {
+            if (!ok) break;
+            CosFilterRecord r = { s.offset, s.bytes, s.firstLine, (uint32_t)s.grams.size(), (uint32_t)s.words.size() };
+            ok = fwrite(&r, sizeof(r), 1, f) == 1 && fwrite(s.grams.data(), 8, s.grams.size(), f) == s.grams.size() &&
+                 fwrite(s.words.data(), 8, s.words.size(), f) == s.words.size();
+        }
+        ok = fclose(f) == 0 && ok;
+        if (ok) ok = rename(tmp.c_str(), path.c_str()) == 0;
+        if (!ok) unlink(tmp.c_str());
+        return ok;
+    }
+};
+
+struct CosSearchStats {
+    unsigned long long files = 0;
+    unsigned long long segments = 0;
+    unsigned long long skipped = 0;        // ruled out by their filter
+    unsigned long long falseHits = 0;      // read, but held no match
+    unsigned long long bytes = 0;
+    unsigned long long bytesRead = 0;
+    unsigned long long matches = 0;
+};
+
+// Fixed-string search over COS logs, reading only the segments whose filters
+// allow a match. Without a filter (short query, unreadable log) the whole log
+// is read. wholeWord matches like grep -w, and lets a single-word query use
+// the word filter, which is what rules out segments for random ids.
+class CosLogSearch {
+public:
+    // file, 1-based line number, the line without its newline
+    typedef bool (*MatchFn)(void* context, const std::string& file, uint64_t line, const char* text, size_t len);
+
+private:
+    std::string pattern;
+    std::string folded;
+    bool ignoreCase;
+    bool wholeWord;
+    CosLogFilter::Query query;
+    uint32_t segmentBytes;
+    std::vector<char> buffer;
+    std::vector<char> foldedBuffer;
+
+    static inline char foldChar(char c) { return c >= 'A' && c <= 'Z' ? (char)(c + 32) : c; }
+
+    // Calls fn for each line starting in [from, to) that holds the pattern,
+    // reading [offset, offset + bytes) a few MiB at a time; line is the line
+    // number at offset.
+    bool scan(int fd, const std::string& file, uint64_t offset, uint64_t bytes, uint64_t line,
+              uint64_t from, uint64_t to, MatchFn fn, void* context, CosSearchStats& stats, bool& matched) {
+        const size_t PIECE = 4 * 1024 * 1024;
+        while (bytes) {
+            size_t want = bytes < PIECE ? (size_t)bytes : PIECE;
+            buffer.resize(want);
+            ssize_t got = pread(fd, buffer.data(), want, offset);
+            if (got <= 0) return true;
+            stats.bytesRead += (uint64_t)got;
+
+            // Whole lines only, unless one line fills the piece.
+            size_t len = (size_t)got;
+            if ((uint64_t)got < bytes) {
+                const char* last = static_cast<const char*>(memrchr(buffer.data(), '\n', len));
+                if (last) len = (size_t)(last + 1 - buffer.data());
+            }
+
+            const char* text = buffer.data();
+            const char* hay = text;
+            const std::string& needle = ignoreCase ? folded : pattern;
+            if (ignoreCase) {
+                foldedBuffer.resize(len);
+                for (size_t i = 0; i < len; i++) foldedBuffer[i] = foldChar(text[i]);
+                hay = foldedBuffer.data();
+            }
+
+            const char* end = hay + len;
+            const char* counted = hay;
+            const char* at = hay;
+            while (at < end && (at = static_cast<const char*>(memmem(at, end - at, needle.data(), needle.size())))) {
+                if (wholeWord && ((at > hay && CosLogFilter::isWord(at[-1])) ||
+                                  (at + needle.size() < end && CosLogFilter::isWord(at[needle.size()])))) {
+                    at++;
+                    continue;
+                }
+                const char* start = at;
+                while (start > hay && start[-1] != '\n') start--;
+                const char* stop = static_cast<const char*>(memchr(at, '\n', end - at));
+                if (!stop) stop = end;
+                for (const char* q = counted; (q = static_cast<const char*>(memchr(q, '\n', start - q))); q++) line++;
+                counted = start;
+                at = stop + 1;
+
+                uint64_t lineOffset = offset + (uint64_t)(start - hay);
+                if (lineOffset < from) continue;
+                if (lineOffset >= to) return true;
+                matched = true;
+                stats.matches++;
+                if (!fn(context, file, line + 1, text + (start - hay), stop - start)) return false;
+            }
+            for (const char* q = counted; (q = static_cast<const char*>(memchr(q, '\n', end - q))); q++) line++;
+            offset += len;
+            bytes -= len;
+        }
+        return true;
+    }
+
+public:
+    CosLogSearch(const std::string& text, bool caseless, bool words = false,
+                 uint32_t segment = CosLogFilter::SEGMENT_BYTES)
+        : pattern(text), ignoreCase(caseless), wholeWord(words), segmentBytes(segment) {
+        for (char c : pattern) folded += foldChar(c);
+        query = CosLogFilter::queryFor(pattern, wholeWord);
+    }
+
+    // Searches [from, to) of one log, updating its sidecar filter on the way.
+    // Returns false once fn asks to stop.
+    bool searchFile(const std::string& file, uint64_t from, uint64_t to, MatchFn fn, void* context,
+                    CosSearchStats& stats) {
+        CosLogFilter filter;
+        bool filtered = !query.grams.empty() && filter.update(file, segmentBytes, true);
+        int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) return true;
+        struct stat st;
+        uint64_t size = fstat(fd, &st) == 0 ? (uint64_t)st.st_size : 0;
+        if (to > size) to = size;
+        stats.files++;
+
+        std::vector<CosLogFilter::Segment> whole;
+        if (!filtered) {
+            CosLogIndex index;
+            CosLogPosition start = { 0, 0 };
+            if (from && index.open(file) && !index.seekOffset(from, start)) start = { 0, 0 };
+            whole.push_back(CosLogFilter::Segment{ start.offset, size - start.offset, start.line, {}, {} });
+        }
+        const std::vector<CosLogFilter::Segment>& segments = filtered ? filter.all() : whole;
+
+        bool more = true;
+        for (const CosLogFilter::Segment& s : segments) {
+            if (s.offset + s.bytes <= from || s.offset >= to) continue;
+            stats.segments++;
+            stats.bytes += s.bytes;
+            if (filtered && !CosLogFilter::mayContain(s, query)) {
+                stats.skipped++;
+                continue;
+            }
+            bool matched = false;
+            more = scan(fd, file, s.offset, s.bytes, s.firstLine, from, to, fn, context, stats, matched);
+            if (filtered && !matched) stats.falseHits++;
+            if (!more) break;
+        }
+        ::close(fd);
+        return more;
+    }
+};
+
+#endif // _WIN32
+
+#endif // COS_SEARCH_H
@@ -0,0 +1,583 @@
+#ifndef COS_SINK_H
+#define COS_SINK_H
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <ctime>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+// A close-on-exec local socket that never raises SIGPIPE. Where SOCK_CLOEXEC
+// and MSG_NOSIGNAL are missing (macOS) both are set on the socket instead.
+static inline int cosLocalSocket(int type) {
+#ifdef SOCK_CLOEXEC
+    return socket(AF_UNIX, type | SOCK_CLOEXEC, 0);
+#else
+    int fd = socket(AF_UNIX, type, 0);
+    if (fd == -1) return -1;
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+#ifdef SO_NOSIGPIPE
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+    return fd;
+#endif
+}
+
+// A destination for captured output. write() gets a whole batch at once and
+// is only ever called from the sink's own queue thread, so it may block.
+// Returning false counts an error and makes the queue back off; the batch is
+// not retried.
+class CosSink {
+public:
+    virtual ~CosSink() {}
+    virtual bool write(const iovec* iov, int count) = 0;
+    virtual const char* name() const = 0;
+};
+
+// Any fd; the console sink is this over a dup of the terminal.
+class CosFdSink : public CosSink {
+protected:
+    int fd;
+    std::string label;
+
+public:
+    CosFdSink(int target, const std::string& sinkName = "fd") : fd(target), label(sinkName) {}
+    ~CosFdSink() override {
+        if (fd != -1) close(fd);
+    }
+
+    bool write(const iovec* iov, int count) override {
+        if (fd == -1) return false;
+        iovec local[IOV_MAX];
+        while (count > 0) {
+            int batch = count > IOV_MAX ? IOV_MAX : count;
+            memcpy(local, iov, batch * sizeof(iovec));
+            iovec* cur = local;
+            int left = batch;
+            while (left > 0) {
+                ssize_t result = writev(fd, cur, left);
+                if (result < 0) {
+                    if (errno == EINTR) continue;
+                    return false;
+                }
+                size_t done = (size_t)result;
+                while (left > 0 && done >= cur->iov_len) {
+                    done -= cur->iov_len;
+                    cur++;
+                    left--;
+                }
+                if (left > 0) {
+                    cur->iov_base = static_cast<char*>(cur->iov_base) + done;
+                    cur->iov_len -= done;
+                }
+            }
+            iov += batch;
+            count -= batch;
+        }
+        return true;
+    }
+
+    const char* name() const override { return label.c_str(); }
+    inline int descriptor() const { return fd; }
+};
+
+// Mirrors output to a terminal fd. The fd is duplicated, so pass the real
+// terminal (COS::consoleFd()), not fd 1, which COS has redirected into its pipe.
+class CosConsoleSink : public CosFdSink {
+public:
+    explicit CosConsoleSink(int terminalFd) : CosFdSink(fcntl(terminalFd, F_DUPFD_CLOEXEC, 3), "console") {}
+};
+
+class CosFileSink : public CosFdSink {
+public:
+    explicit CosFileSink(const std::string& path, bool append = true)
+        : CosFdSink(open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC), 0644),
+                    "file:" + path) {}
+};
+
+#ifdef __linux__
+// Anonymous in-memory file; hand descriptor() to another process or read it
+// back through /proc/self/fd. Grows without bound, like a file on tmpfs.
+class CosMemfdSink : public CosFdSink {
+public:
+    explicit CosMemfdSink(const char* memfdName = "cos-log")
+        : CosFdSink(memfd_create(memfdName, MFD_CLOEXEC), std::string("memfd:") + memfdName) {}
+};
+#endif
+
+// Unix socket peer: a stream socket gets the bytes as they are, a datagram
+// socket (syslog) one message per line. A lost peer is reconnected on the next
+// batch after the queue's back-off.
+class CosSocketSink : public CosSink {
+public:
+    enum class Mode { Stream, Syslog };
+    static const size_t MAX_LINE = 16 * 1024;
+
+private:
+    std::string path;
+    std::string label;
+    Mode mode;
+    std::string prefix;
+    int sock;
+    std::string pending;
+
+    bool connectPeer() {
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+        sock = cosLocalSocket(mode == Mode::Stream ? SOCK_STREAM : SOCK_DGRAM);
+        if (sock == -1) return false;
+        if (connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) return true;
+        close(sock);
+        sock = -1;
+        return false;
+    }
+
+    void disconnect() {
+        if (sock != -1) close(sock);
+        sock = -1;
+    }
+
+    bool sendStream(const iovec* iov, int count) {
+        for (int i = 0; i < count; i++) {
+            const char* p = static_cast<const char*>(iov[i].iov_base);
+            size_t left = iov[i].iov_len;
+            while (left > 0) {
+                ssize_t n = send(sock, p, left, MSG_NOSIGNAL);
+                if (n < 0) {
+                    if (errno == EINTR) continue;
+                    return false;
+                }
+                p += n;
+                left -= (size_t)n;
+            }
+        }
+        return true;
+    }
+
+    // A line split across batches is held back until its newline arrives.
+    bool sendLines(const iovec* iov, int count) {
+        for (int i = 0; i < count; i++) pending.append(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+
+        size_t start = 0, nl;
+        std::string message;
+        while ((nl = pending.find('\n', start)) != std::string::npos) {
+            if (nl > start) {
+                message.assign(prefix);
+                message.append(pending, start, nl - start);
+                while (send(sock, message.data(), message.size(), MSG_NOSIGNAL) < 0) {
+                    if (errno == EINTR) continue;
+                    pending.erase(0, start);
+                    return false;
+                }
+            }
+            start = nl + 1;
+        }
+        pending.erase(0, start);
+        if (pending.size() > MAX_LINE) {
+            message.assign(prefix).append(pending);
+            pending.clear();
+            return send(sock, message.data(), message.size(), MSG_NOSIGNAL) >= 0;
+        }
+        return true;
+    }
+
+public:
+    // Syslog messages are "<priority>tag[pid]: line"; priority 14 is user.info.
+    CosSocketSink(const std::string& socketPath, Mode socketMode = Mode::Stream, const std::string& tag = "cos", int priority = 14)
+        : path(socketPath), label((socketMode == Mode::Stream ? "unix:" : "syslog:") + socketPath), mode(socketMode), sock(-1) {
+        if (mode == Mode::Syslog) prefix = "<" + std::to_string(priority) + ">" + tag + "[" + std::to_string(getpid()) + "]: ";
+    }
+    ~CosSocketSink() override { disconnect(); }
+
+    bool write(const iovec* iov, int count) override {
+        if (sock == -1 && !connectPeer()) return false;
+        bool ok = mode == Mode::Stream ? sendStream(iov, count) : sendLines(iov, count);
+        if (!ok) disconnect();
+        return ok;
+    }
+
+    const char* name() const override { return label.c_str(); }
+};
+
+class CosSyslogSink : public CosSocketSink {
+public:
+    explicit CosSyslogSink(const std::string& tag, int priority = 14, const std::string& socketPath = "/dev/log")
+        : CosSocketSink(socketPath, Mode::Syslog, tag, priority) {}
+};
+
+// Keeps the newest capacity bytes in memory.
+class CosRingSink : public CosSink {
+private:
+    mutable std::mutex lock;
+    std::vector<char> data;
+    uint64_t written;
+
+public:
+    explicit CosRingSink(size_t capacity = 256 * 1024) : data(capacity ? capacity : 1), written(0) {}
+
+    bool write(const iovec* iov, int count) override {
+        std::lock_guard<std::mutex> guard(lock);
+        for (int i = 0; i < count; i++) {
+            const char* p = static_cast<const char*>(iov[i].iov_base);
+            size_t len = iov[i].iov_len;
+            if (len > data.size()) {
+                written += len - data.size();
+                p += len - data.size();
+                len = data.size();
+            }
+            size_t off = written % data.size();
+            size_t first = data.size() - off < len ? data.size() - off : len;
+            memcpy(data.data() + off, p, first);
+            memcpy(data.data(), p + first, len - first);
+            written += len;
+        }
+        return true;
+    }
+
+    std::string contents() const {
+        std::lock_guard<std::mutex> guard(lock);
+        size_t len = written < data.size() ? (size_t)written : data.size();
+        size_t off = (size_t)((written - len) % data.size());
+        size_t first = data.size() - off < len ? data.size() - off : len;
+        std::string out(data.data() + off, first);
+        out.append(data.data(), len - first);
+        return out;
+    }
+
+    const char* name() const override { return "ring"; }
+};
+
+struct CosSinkStats {
+    std::string name;
+    unsigned long long bytes;
+    unsigned long long writes;
+    unsigned long long errors;
+    unsigned long long droppedBytes;
+    unsigned long long skippedLines;
+    size_t queuedBytes;
+};
+
+// One sink behind its own byte queue and thread. The drain thread is the only
+// producer and never waits: a batch that does not fit is dropped and counted.
+// A failing sink backs off (10 ms doubling to 1 s) without touching the others.
+class CosSinkQueue {
+public:
+    // Drop loses whole pieces. SkipLines drops whole lines instead and, once
+    // there is room again, queues "… N lines skipped" where they were.
+    enum class Overflow { Drop, SkipLines };
+
+private:
+    std::shared_ptr<CosSink> sink;
+    Overflow overflow;
+    std::vector<char> buffer;
+    size_t mask;
+    alignas(64) std::atomic<uint64_t> head;
+    alignas(64) std::atomic<uint64_t> tail;
+    std::atomic<bool> sleeping;
+    std::atomic<bool> running;
+    std::mutex lock;
+    std::condition_variable wake;
+    pthread_t thread;
+    bool started;
+
+    std::atomic<unsigned long long> bytes;
+    std::atomic<unsigned long long> writes;
+    std::atomic<unsigned long long> errors;
+    std::atomic<unsigned long long> droppedBytes;
+    std::atomic<unsigned long long> skippedLines;
+
+    // Producer side only.
+    bool skipping;
+    bool lineEnded;
+    unsigned long long skippedRun;
+
+    inline void copyIn(uint64_t pos, const char* src, size_t len) {
+        size_t off = pos & mask;
+        size_t first = buffer.size() - off < len ? buffer.size() - off : len;
+        memcpy(buffer.data() + off, src, first);
+        memcpy(buffer.data(), src + first, len - first);
+    }
+
+    void run() {
+        unsigned backoffMs = 0;
+        for (;;) {
+            uint64_t from = tail.load(std::memory_order_relaxed);
+            uint64_t to = head.load(std::memory_order_acquire);
+
+            if (from == to) {
+                if (!running.load(std::memory_order_acquire)) return;
+                std::unique_lock<std::mutex> guard(lock);
+                sleeping.store(true);
+                if (head.load() == from && running.load())
+                    wake.wait_for(guard, std::chrono::milliseconds(100));
+                sleeping.store(false, std::memory_order_relaxed);
+                continue;
+            }
+
+            size_t off = from & mask;
+            size_t len = to - from;
+            size_t first = buffer.size() - off < len ? buffer.size() - off : len;
+            iovec iov[2] = { { buffer.data() + off, first }, { buffer.data(), len - first } };
+
+            bool ok = sink->write(iov, len - first ? 2 : 1);
+            writes.fetch_add(1, std::memory_order_relaxed);
+            if (ok) {
+                bytes.fetch_add(len, std::memory_order_relaxed);
+                backoffMs = 0;
+            } else {
+                errors.fetch_add(1, std::memory_order_relaxed);
+                droppedBytes.fetch_add(len, std::memory_order_relaxed);
+            }
+            tail.store(to, std::memory_order_release);
+
+            if (!ok && running.load(std::memory_order_acquire)) {
+                backoffMs = backoffMs ? (backoffMs * 2 > 1000 ? 1000 : backoffMs * 2) : 10;
+                std::unique_lock<std::mutex> guard(lock);
+                wake.wait_for(guard, std::chrono::milliseconds(backoffMs),
+                              [this] { return !running.load(std::memory_order_acquire); });
+            }
+        }
+    }
+
+    static void* threadFunc(void* arg) {
+        static_cast<CosSinkQueue*>(arg)->run();
+        return nullptr;
+    }
+
+    inline bool fits(size_t len) const {
+        return len <= buffer.size() - (head.load(std::memory_order_relaxed) - tail.load(std::memory_order_acquire));
+    }
+
+    void enqueue(const char* src, size_t len) {
+        uint64_t pos = head.load(std::memory_order_relaxed);
+        copyIn(pos, src, len);
+        head.store(pos + len);
+        lineEnded = src[len - 1] == '\n';
+        if (sleeping.load()) {
+            std::lock_guard<std::mutex> guard(lock);
+            wake.notify_one();
+        }
+    }
+
+    void drop(const char* src, size_t len) {
+        droppedBytes.fetch_add(len, std::memory_order_relaxed);
+        if (overflow != Overflow::SkipLines) return;
+        unsigned long long lines = 0;
+        const char* end = src + len;
+        while ((src = static_cast<const char*>(memchr(src, '\n', end - src)))) {
+            lines++;
+            src++;
+        }
+        skippedRun += lines;
+        skippedLines.fetch_add(lines, std::memory_order_relaxed);
+    }
+
+    std::string skipNote() const {
+        std::string count = std::to_string(skippedRun);
+        for (int i = (int)count.size() - 3; i > 0; i -= 3) count.insert(i, ",");
+        return std::string(lineEnded ? "" : "\n") + "\xe2\x80\xa6 " + count + (skippedRun == 1 ? " line" : " lines") + " skipped\n";
+    }
+
+    // Called with the rest of a piece once a skipped line has ended.
+    bool resume(const char* src, size_t len) {
+        std::string note = skipNote();
+        if (!fits(note.size() + len)) return false;
+        enqueue(note.data(), note.size());
+        skipping = false;
+        skippedRun = 0;
+        if (len) enqueue(src, len);
+        return true;
+    }
+
+public:
+    CosSinkQueue(std::shared_ptr<CosSink> target, size_t queueBytes, Overflow policy = Overflow::Drop)
+        : sink(std::move(target)), overflow(policy), head(0), tail(0), sleeping(false), running(true), started(false),
+          bytes(0), writes(0), errors(0), droppedBytes(0), skippedLines(0),
+          skipping(false), lineEnded(true), skippedRun(0) {
+        size_t size = 4096;
+        while (size < queueBytes) size <<= 1;
+        buffer.resize(size);
+        mask = size - 1;
+    }
+
+    ~CosSinkQueue() { stop(); }
+
+    bool start() {
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setstacksize(&attr, 64 * 1024);
+        started = pthread_create(&thread, &attr, threadFunc, this) == 0;
+        pthread_attr_destroy(&attr);
+        return started;
+    }
+
+    // Drain thread only. Batches go in as pieces of at most a quarter of the
+    // queue, each queued or dropped whole, so a batch larger than the queue
+    // still reaches a sink that keeps up. False if anything was dropped.
+    bool push(const iovec* iov, int count) {
+        size_t piece = buffer.size() / 4;
+        bool complete = true;
+
+        for (int i = 0; i < count; i++) {
+            const char* src = static_cast<const char*>(iov[i].iov_base);
+            for (size_t off = 0; off < iov[i].iov_len; off += piece) {
+                const char* p = src + off;
+                size_t len = iov[i].iov_len - off < piece ? iov[i].iov_len - off : piece;
+
+                if (skipping) {
+                    complete = false;
+                    const char* nl = static_cast<const char*>(memchr(p, '\n', len));
+                    size_t cut = nl ? (size_t)(nl + 1 - p) : len;
+                    drop(p, cut);
+                    if (nl && !resume(p + cut, len - cut)) drop(p + cut, len - cut);
+                    continue;
+                }
+                if (fits(len)) {
+                    enqueue(p, len);
+                    continue;
+                }
+                complete = false;
+                skipping = overflow == Overflow::SkipLines;
+                drop(p, len);
+            }
+        }
+        return complete;
+    }
+
+    // Gives the sink until the deadline to take what is queued. A sink still
+    // stuck in write() after that is abandoned, and this queue with it.
+    bool stop(unsigned timeoutMs = 500) {
+        if (!started) return true;
+        if (skipping) resume(nullptr, 0);
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            running.store(false, std::memory_order_release);
+            wake.notify_one();
+        }
+        started = false;
+#ifdef __GLIBC__
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += timeoutMs / 1000;
+        deadline.tv_nsec += (long)(timeoutMs % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        if (pthread_timedjoin_np(thread, nullptr, &deadline) == 0) return true;
+        pthread_detach(thread);
+        return false;
+#else
+        (void)timeoutMs;
+        pthread_join(thread, nullptr);
+        return true;
+#endif
+    }
+
+    inline CosSink* target() const { return sink.get(); }
+
+    CosSinkStats stats() const {
+        return CosSinkStats{sink->name(),
+                            bytes.load(std::memory_order_relaxed),
+                            writes.load(std::memory_order_relaxed),
+                            errors.load(std::memory_order_relaxed),
+                            droppedBytes.load(std::memory_order_relaxed),
+                            skippedLines.load(std::memory_order_relaxed),
+                            (size_t)(head.load(std::memory_order_relaxed) - tail.load(std::memory_order_relaxed))};
+    }
+};
+
+// Sinks added at runtime. Slots are published once and never reused, so the
+// drain thread reads them without a lock.
+class CosSinks {
+public:
+    static const int MAX_SINKS = 16;
+
+private:
+    std::atomic<CosSinkQueue*> queues[MAX_SINKS];
+    std::atomic<int> count;
+    std::mutex addLock;
+
+public:
+    CosSinks() : count(0) {
+        for (auto& q : queues) q.store(nullptr, std::memory_order_relaxed);
+    }
+
+    ~CosSinks() { stopAll(); }
+
+    bool add(std::shared_ptr<CosSink> sink, size_t queueBytes) {
+        if (!sink) return false;
+        std::lock_guard<std::mutex> guard(addLock);
+        int n = count.load(std::memory_order_relaxed);
+        if (n == MAX_SINKS) return false;
+        CosSinkQueue* queue = new CosSinkQueue(std::move(sink), queueBytes);
+        if (!queue->start()) {
+            delete queue;
+            return false;
+        }
+        queues[n].store(queue, std::memory_order_release);
+        count.store(n + 1, std::memory_order_release);
+        return true;
+    }
+
+    inline bool empty() const { return count.load(std::memory_order_acquire) == 0; }
+
+    inline void publish(const iovec* iov, int iovCount) {
+        int n = count.load(std::memory_order_acquire);
+        for (int i = 0; i < n; i++) {
+            CosSinkQueue* queue = queues[i].load(std::memory_order_acquire);
+            if (queue) queue->push(iov, iovCount);
+        }
+    }
+
+    std::vector<CosSinkStats> stats() const {
+        std::vector<CosSinkStats> out;
+        int n = count.load(std::memory_order_acquire);
+        for (int i = 0; i < n; i++) {
+            CosSinkQueue* queue = queues[i].load(std::memory_order_acquire);
+            if (queue) out.push_back(queue->stats());
+        }
+        return out;
+    }
+
+    // After the drain thread is done. Abandoned queues are leaked, not freed
+    // under a thread that is still inside write().
+    void stopAll() {
+        std::lock_guard<std::mutex> guard(addLock);
+        int n = count.exchange(0, std::memory_order_acq_rel);
+        for (int i = 0; i < n; i++) {
+            CosSinkQueue* queue = queues[i].exchange(nullptr, std::memory_order_acq_rel);
+            if (queue->stop()) delete queue;
+        }
+    }
+};
+
+#endif // _WIN32
+
+#endif // COS_SINK_H
@@ -0,0 +1,317 @@
+#ifndef COS_STREAM_H
+#define COS_STREAM_H
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <sched.h>
+#include <errno.h>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <iostream>
+#include <mutex>
+#include <streambuf>
+#include <string>
+
+// Per-thread line buffering for std::cout, std::cerr and std::clog. Each
+// thread collects its partial line locally and hands over whole lines with a
+// single CAS on a shared ring, so no stream or FILE lock is taken and a line
+// is never split by another thread's output. The COS drain thread empties the
+// ring into the console, log and sinks like the pipe; ordering against raw
+// write()/printf output is per drain batch. A full ring makes the writer wait,
+// as the pipe would.
+class CosStreams {
+public:
+    static const size_t MAX_LINE = 4096;
+
+private:
+    enum : uint32_t { PENDING, TEXT, FILLER };
+
+    // size covers header and text; a record starts 8-byte aligned and never wraps.
+    struct Header {
+        uint32_t size;
+        std::atomic<uint32_t> state;
+    };
+
+    struct Ring {
+        char* data = nullptr;
+        size_t capacity = 0;
+        int wakeFd = -1;
+        alignas(64) std::atomic<uint64_t> head{0};
+        alignas(64) std::atomic<uint64_t> tail{0};
+        std::atomic<bool> draining{false};
+        std::atomic<bool> sleeping{false};
+        std::atomic<bool> signaled{false};
+        std::atomic<unsigned long long> stalls{0};
+    };
+
+    class LineBuf : public std::streambuf {
+    public:
+        int slot = 0;
+
+    protected:
+        int_type overflow(int_type c) override {
+            if (traits_type::eq_int_type(c, traits_type::eof())) return traits_type::not_eof(c);
+            char ch = traits_type::to_char_type(c);
+            put(slot, &ch, 1);
+            return c;
+        }
+
+        std::streamsize xsputn(const char* s, std::streamsize n) override {
+            put(slot, s, (size_t)n);
+            return n;
+        }
+
+        // An explicit flush also hands over the partial line, so prompts show.
+        int sync() override {
+            flushLocal(slot);
+            return 0;
+        }
+    };
+
+    struct State {
+        std::mutex lock;
+        std::atomic<bool> installed{false};
+        bool cerrUnitbuf = false;
+        LineBuf bufs[3];
+        std::streambuf* previous[3] = {};
+    };
+
+    // Partial lines of this thread, one per stream; handed over when it exits.
+    struct Local {
+        std::string line[3];
+        ~Local() {
+            for (std::string& l : line) {
+                if (!l.empty()) emit(l.data(), l.size());
+            }
+        }
+    };
+
+    static inline Ring& ring() {
+        static Ring r;
+        return r;
+    }
+
+    static inline State& state() {
+        static State s;
+        return s;
+    }
+
+    static inline Local& local() {
+        static thread_local Local l;
+        return l;
+    }
+
+    static constexpr size_t align(size_t n) { return (n + 7) & ~size_t(7); }
+
+    static inline Header* at(const Ring& r, uint64_t pos) {
+        return reinterpret_cast<Header*>(r.data + (pos & (r.capacity - 1)));
+    }
+
+    static void wake(Ring& r) {
+        if (r.signaled.exchange(true)) return;
+        uint64_t one = 1;
+        ssize_t n = ::write(r.wakeFd, &one, sizeof(one));
+        (void)n;
+    }
+
+    // One CAS claims the space; the drain sees the record once its state is set.
+    static bool append(Ring& r, const char* text, size_t len) {
+        size_t total = align(sizeof(Header) + len);
+        uint64_t h = r.head.load(std::memory_order_relaxed);
+        size_t skip;
+        for (unsigned spins = 0;;) {
+            size_t off = h & (r.capacity - 1);
+            skip = r.capacity - off < total ? r.capacity - off : 0;
+            if (h + skip + total - r.tail.load(std::memory_order_acquire) > r.capacity) {
+                if (!r.draining.load(std::memory_order_acquire)) return false;
+                if (!spins) r.stalls.fetch_add(1, std::memory_order_relaxed);
+                wake(r);
+                if (++spins < 64) sched_yield();
+                else usleep(50);
+                h = r.head.load(std::memory_order_relaxed);
+                continue;
+            }
+            if (r.head.compare_exchange_weak(h, h + skip + total, std::memory_order_seq_cst,
+                                             std::memory_order_relaxed))
+                break;
+        }
+
+        if (skip) {
+            Header* filler = at(r, h);
+            filler->size = (uint32_t)skip;
+            filler->state.store(FILLER, std::memory_order_release);
+            h += skip;
+        }
+        Header* rec = at(r, h);
+        rec->size = (uint32_t)(sizeof(Header) + len);
+        memcpy(reinterpret_cast<char*>(rec) + sizeof(Header), text, len);
+        rec->state.store(TEXT, std::memory_order_release);
+
+        if (r.sleeping.load()) wake(r);
+        return true;
+    }
+
+    // Without a drain thread the text goes straight to fd 1.
+    static void emit(const char* text, size_t len) {
+        Ring& r = ring();
+        size_t piece = r.capacity / 4;
+        while (len) {
+            size_t n = !r.data || len < piece ? len : piece;
+            if (!r.data || !append(r, text, n)) {
+                size_t done = 0;
+                while (done < n) {
+                    ssize_t w = ::write(STDOUT_FILENO, text + done, n - done);
+                    if (w < 0 && errno == EINTR) continue;
+                    if (w <= 0) break;
+                    done += (size_t)w;
+                }
+            }
+            text += n;
+            len -= n;
+        }
+    }
+
+    static void put(int slot, const char* s, size_t n) {
+        std::string& line = local().line[slot];
+        const char* nl = static_cast<const char*>(memrchr(s, '\n', n));
+        if (!nl) {
+            line.append(s, n);
+            if (line.size() >= MAX_LINE) {
+                emit(line.data(), line.size());
+                line.clear();
+            }
+            return;
+        }
+
+        size_t upto = (size_t)(nl + 1 - s);
+        if (line.empty()) {
+            emit(s, upto);
+        } else {
+            line.append(s, upto);
+            emit(line.data(), line.size());
+            line.clear();
+        }
+        line.append(nl + 1, n - upto);
+    }
+
+    static void flushLocal(int slot) {
+        std::string& line = local().line[slot];
+        if (line.empty()) return;
+        emit(line.data(), line.size());
+        line.clear();
+    }
+
+public:
+    // Points std::cout, std::cerr and std::clog at the line buffers. The ring
+    // is sized on the first call and kept for the life of the process.
+    static bool install(size_t ringBytes) {
+        State& s = state();
+        std::lock_guard<std::mutex> guard(s.lock);
+        if (s.installed) return false;
+
+        Ring& r = ring();
+        if (!r.data) {
+            size_t capacity = 64 * 1024;
+            while (capacity < ringBytes) capacity <<= 1;
+            char* data = static_cast<char*>(calloc(1, capacity));
+            r.wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+            if (!data || r.wakeFd == -1) {
+                free(data);
+                if (r.wakeFd != -1) close(r.wakeFd);
+                r.wakeFd = -1;
+                return false;
+            }
+            r.capacity = capacity;
+            r.data = data;
+        }
+
+        std::ostream* streams[3] = { &std::cout, &std::cerr, &std::clog };
+        for (int i = 0; i < 3; i++) {
+            streams[i]->flush();
+            s.bufs[i].slot = i;
+            s.previous[i] = streams[i]->rdbuf(&s.bufs[i]);
+        }
+        // Every << on a unitbuf stream would flush, splitting lines again.
+        s.cerrUnitbuf = (std::cerr.flags() & std::ios::unitbuf) != 0;
+        std::cerr.unsetf(std::ios::unitbuf);
+        s.installed = true;
+        return true;
+    }
+
+    // Hands over the calling thread's partial lines and restores the streams.
+    // Other threads' partial lines follow when they exit.
+    static void uninstall() {
+        State& s = state();
+        std::lock_guard<std::mutex> guard(s.lock);
+        if (!s.installed) return;
+
+        std::ostream* streams[3] = { &std::cout, &std::cerr, &std::clog };
+        for (int i = 0; i < 3; i++) {
+            flushLocal(i);
+            streams[i]->rdbuf(s.previous[i]);
+        }
+        if (s.cerrUnitbuf) std::cerr.setf(std::ios::unitbuf);
+        s.installed = false;
+    }
+
+    static inline bool installed() { return state().installed.load(std::memory_order_acquire); }
+
+    static inline bool pending() {
+        const Ring& r = ring();
+        return r.tail.load(std::memory_order_relaxed) != r.head.load();
+    }
+
+    // Producers wait for space only while a drain thread is attached.
+    static inline void attachDrain() { ring().draining.store(true, std::memory_order_release); }
+    static inline void detachDrain() { ring().draining.store(false, std::memory_order_release); }
+
+    // Readable when lines arrived while the drain was idle; -1 before install().
+    static inline int wakeFd() { return ring().wakeFd; }
+
+    // Brackets the drain thread's idle wait, so producers only signal then.
+    static inline void idle(bool waiting) {
+        Ring& r = ring();
+        r.sleeping.store(waiting);
+        if (!waiting && r.signaled.exchange(false)) {
+            uint64_t count;
+            ssize_t n = ::read(r.wakeFd, &count, sizeof(count));
+            (void)n;
+        }
+    }
+
+    static inline unsigned long long stalls() { return ring().stalls.load(std::memory_order_relaxed); }
+
+    // Appends committed lines, oldest first, until out would grow past maxBytes
+    // or a reserved record is still being copied. Only the drain thread calls this.
+    static size_t drainTo(std::string& out, size_t maxBytes) {
+        Ring& r = ring();
+        if (!r.data) return 0;
+
+        size_t start = out.size();
+        uint64_t t = r.tail.load(std::memory_order_relaxed);
+        while (t != r.head.load(std::memory_order_acquire)) {
+            Header* rec = at(r, t);
+            uint32_t state = rec->state.load(std::memory_order_acquire);
+            if (state == PENDING) break;
+
+            size_t total = state == FILLER ? rec->size : align(rec->size);
+            if (state == TEXT) {
+                size_t len = rec->size - sizeof(Header);
+                if (out.size() != start && out.size() - start + len > maxBytes) break;
+                out.append(reinterpret_cast<const char*>(rec + 1), len);
+            }
+            // Old text must never read as a header when the space comes round again.
+            memset(static_cast<void*>(rec), 0, total);
+            t += total;
+            r.tail.store(t, std::memory_order_release);
+        }
+        return out.size() - start;
+    }
+};
+
+#endif // __linux__
+
+#endif // COS_STREAM_H
@@ -0,0 +1,131 @@
+#ifndef COS_TRACE_H
+#define COS_TRACE_H
+
+#include "cos_rings.h"
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+// Span tracing. COS_SPAN records one complete span per scope into a per-thread
+// ring (newest kept) using raw ticks; phases are a short fixed list of
+// process-level intervals (startup) that never get overwritten. Both export
+// as Chrome trace JSON, which chrome://tracing and ui.perfetto.dev open.
+class CosTrace {
+public:
+    static constexpr size_t RING_SPANS = 8192;
+    static constexpr size_t MAX_PHASES = 64;
+
+    static inline void record(const char* name, uint64_t startTicks, uint64_t endTicks) {
+        Rings::Ring* ring = Rings::local();
+        uint64_t h = ring->head.load(std::memory_order_relaxed);
+        Span& s = ring->entries[h & (RING_SPANS - 1)];
+        s.start = startTicks;
+        s.end = endTicks;
+        s.name = name;
+        ring->head.store(h + 1, std::memory_order_release);
+    }
+
+    // Times in CLOCK_MONOTONIC nanoseconds; for intervals measured before any span existed.
+    static void phase(const char* name, uint64_t startNs, uint64_t endNs) {
+        Phases& ph = phases();
+        std::lock_guard<std::mutex> guard(Rings::instance().lock);
+        if (ph.count < MAX_PHASES) ph.list[ph.count++] = Phase{name, startNs, endNs, Rings::threadId()};
+    }
+
+    static inline bool active() { return Rings::instance().active.load(std::memory_order_acquire); }
+
+    // Chrome trace "X" events, timestamps in microseconds from the earliest
+    // one. Only try-locks, so a crash handler never blocks on it.
+    static std::string chromeJson() {
+        Rings& reg = Rings::instance();
+        std::unique_lock<std::mutex> guard(reg.lock, std::try_to_lock);
+        if (!guard.owns_lock()) return std::string();
+
+        struct Out { const char* name; uint64_t startNs; uint64_t endNs; int tid; };
+        std::vector<Out> events;
+        const Phases& ph = phases();
+        for (size_t i = 0; i < ph.count; i++)
+            events.push_back(Out{ph.list[i].name, ph.list[i].startNs, ph.list[i].endNs, ph.list[i].tid});
+
+        double rate = reg.nsPerTick();
+        auto toNs = [&](uint64_t t) {
+            return t >= reg.epochTicks ? reg.epochNs + (uint64_t)((t - reg.epochTicks) * rate)
+                                       : reg.epochNs - (uint64_t)((reg.epochTicks - t) * rate);
+        };
+
+        for (Rings::Ring* r : reg.rings)
+            Rings::copy(r, events, [&](const Span& s) { return Out{s.name, toNs(s.start), toNs(s.end), r->tid}; });
+        if (events.empty()) return std::string();
+
+        uint64_t origin = events[0].startNs;
+        for (const Out& e : events) origin = std::min(origin, e.startNs);
+
+        std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        char line[96];
+        int pid = (int)getpid();
+        for (size_t i = 0; i < events.size(); i++) {
+            const Out& e = events[i];
+            out += i ? ",\n{\"name\":\"" : "{\"name\":\"";
+            for (const char* c = e.name ? e.name : "?"; *c; c++) {
+                if (*c == '"' || *c == '\\') out += '\\';
+                if ((unsigned char)*c >= 0x20) out += *c;
+            }
+            snprintf(line, sizeof(line), "\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d}",
+                     (e.startNs - origin) / 1000.0, e.endNs > e.startNs ? (e.endNs - e.startNs) / 1000.0 : 0.0,
+                     pid, e.tid);
+            out += line;
+        }
+        out += "\n]}\n";
+        return out;
+    }
+
+private:
+    struct Span {
+        uint64_t start;
+        uint64_t end;
+        const char* name;
+    };
+
+    struct Phase {
+        const char* name;
+        uint64_t startNs;
+        uint64_t endNs;
+        int tid;
+    };
+
+    typedef CosThreadRings<Span, RING_SPANS> Rings;
+
+    // Guarded by the rings' lock, so chromeJson() takes a single try_lock.
+    struct Phases {
+        Phase list[MAX_PHASES];
+        size_t count = 0;
+    };
+
+    static inline Phases& phases() {
+        static Phases ph;
+        return ph;
+    }
+};
+
+class CosSpan {
+private:
+    const char* name;
+    uint64_t start;
+
+public:
+    inline explicit CosSpan(const char* spanName) : name(spanName), start(CosLog::ticks()) {}
+    inline ~CosSpan() { CosTrace::record(name, start, CosLog::ticks()); }
+
+    CosSpan(const CosSpan&) = delete;
+    CosSpan& operator=(const CosSpan&) = delete;
+};
+
+#define COS_SPAN_JOIN2(a, b) a##b
+#define COS_SPAN_JOIN(a, b) COS_SPAN_JOIN2(a, b)
+// Times the rest of the enclosing scope; name must be a string literal.
+#define COS_SPAN(name) CosSpan COS_SPAN_JOIN(cosSpan_, __COUNTER__)("" name)
+
+#endif // COS_TRACE_H
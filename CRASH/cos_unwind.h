@@ -0,0 +1,663 @@
+#ifndef COS_UNWIND_H
+#define COS_UNWIND_H
+
+#ifdef __linux__
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <fcntl.h>
+#include <link.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+// Async-signal-safe stack walker for the hot capture paths: the sampler, the
+// heap profiler, throw sites and the hang watchdog. init() indexes every
+// loaded module's .eh_frame_hdr once. Modules built with frame pointers are
+// walked through them; on x86-64 the others, and any interrupted pc, are
+// stepped with their DWARF CFA rules. Stack reads stay inside pages already
+// known to belong to the walk's stack, and an unknown page is probed with a
+// write() to a private pipe, which fails with EFAULT instead of faulting.
+// Nothing here locks or allocates.
+class CosUnwind {
+public:
+    static const int MAX_MODULES = 256;
+    static const int RULE_CACHE = 4096;
+
+private:
+    struct Module {
+        uintptr_t textStart;
+        uintptr_t textEnd;
+        const uint8_t* hdr;
+        const int32_t* table;
+        size_t count;
+        bool framePointers;
+    };
+
+    struct Table {
+        Module modules[MAX_MODULES];
+        int count;
+    };
+
+    // Only the CFA and the two registers a walk needs are tracked.
+    struct Rules {
+        uintptr_t cfaReg;
+        intptr_t cfaOff;
+        intptr_t fpOff;
+        intptr_t raOff;
+        bool fpSaved;
+        bool raSaved;
+    };
+
+    // Per-entry seqlock: readers never wait, and a writer that finds the
+    // cache busy (another thread, or the walk it interrupted) skips caching.
+    struct CachedRules {
+        std::atomic<unsigned> seq{0};
+        uintptr_t target = 0;
+        bool valid = false;
+        Rules rules;
+    };
+
+    // Refreshes fill the spare table and publish it, so a walk never sees one half-built.
+    struct State {
+        std::mutex lock;
+        Table tables[2];
+        std::atomic<Table*> current{nullptr};
+        int probe[2] = { -1, -1 };
+        std::atomic_flag cacheBusy = ATOMIC_FLAG_INIT;
+        CachedRules cache[RULE_CACHE];
+    };
+
+    struct Regs {
+        uintptr_t pc;
+        uintptr_t sp;
+        uintptr_t fp;
+    };
+
+    // Contiguous run of pages known to be mapped, starting at a walk's own stack.
+    struct Range {
+        uintptr_t low;
+        uintptr_t high;
+    };
+
+    struct Cie {
+        const uint8_t* insns;
+        const uint8_t* end;
+        uintptr_t codeAlign;
+        intptr_t dataAlign;
+        uintptr_t raReg;
+        uint8_t fdeEnc;
+        bool augmented;
+    };
+
+    static const uintptr_t PAGE = 4096;
+#if defined(__x86_64__)
+    static const uintptr_t FP_REG = 6;
+    static const uintptr_t SP_REG = 7;
+#endif
+
+    static inline State& state() {
+        static State s;
+        return s;
+    }
+
+    // Kept per thread between walks; a walk works on a copy, so one that
+    // interrupts another on the same thread cannot corrupt it.
+    static inline Range& knownRange() {
+        static __thread Range value __attribute__((tls_model("initial-exec"))) = { 0, 0 };
+        return value;
+    }
+
+    static bool probe(uintptr_t page) {
+        const int* fds = state().probe;
+        if (fds[1] < 0) return false;
+        int savedErrno = errno;
+        ssize_t n;
+        do {
+            n = write(fds[1], reinterpret_cast<const void*>(page), 1);
+        } while (n < 0 && errno == EINTR);
+        if (n == 1) {
+            char byte;
+            while (read(fds[0], &byte, 1) < 0 && errno == EINTR) {}
+        }
+        errno = savedErrno;
+        return n == 1;
+    }
+
+    // Grows the run page by page, so frames larger than a page leave no gap.
+    __attribute__((noinline)) static bool readable(Range& known, uintptr_t addr) {
+        uintptr_t page = addr & ~(PAGE - 1);
+        if (page >= known.high && page - known.high < 64 * PAGE) {
+            while (known.high <= page && probe(known.high)) known.high += PAGE;
+        }
+        return (addr >= known.low && addr + sizeof(uintptr_t) <= known.high) || probe(page);
+    }
+
+    static inline bool load(Range& known, uintptr_t addr, uintptr_t& out) {
+        if (addr & (sizeof(uintptr_t) - 1)) return false;
+        if (__builtin_expect(addr < known.low || addr + sizeof(uintptr_t) > known.high, 0) && !readable(known, addr))
+            return false;
+        out = *reinterpret_cast<const uintptr_t*>(addr);
+        return true;
+    }
+
+    static uintptr_t uleb(const uint8_t*& p) {
+        uintptr_t value = 0;
+        unsigned shift = 0;
+        uint8_t byte;
+        do {
+            byte = *p++;
+            if (shift < 64) value |= (uintptr_t)(byte & 0x7f) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+        return value;
+    }
+
+    static intptr_t sleb(const uint8_t*& p) {
+        intptr_t value = 0;
+        unsigned shift = 0;
+        uint8_t byte;
+        do {
+            byte = *p++;
+            if (shift < 64) value |= (intptr_t)(byte & 0x7f) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+        if (shift < 64 && (byte & 0x40)) value |= -((intptr_t)1 << shift);
+        return value;
+    }
+
+    // DW_EH_PE pointer encodings; indirect values are never needed, so never followed.
+    static bool encoded(const uint8_t*& p, uint8_t enc, uintptr_t dataBase, uintptr_t& out) {
+        if (enc == 0xff) return false;
+        const uint8_t* field = p;
+        uintptr_t value;
+        switch (enc & 0x0f) {
+        case 0x00: memcpy(&value, p, sizeof(value)); p += sizeof(value); break;
+        case 0x01: value = uleb(p); break;
+        case 0x02: { uint16_t v; memcpy(&v, p, 2); p += 2; value = v; break; }
+        case 0x03: { uint32_t v; memcpy(&v, p, 4); p += 4; value = v; break; }
+        case 0x04: { uint64_t v; memcpy(&v, p, 8); p += 8; value = (uintptr_t)v; break; }
+        case 0x09: value = (uintptr_t)sleb(p); break;
+        case 0x0a: { int16_t v; memcpy(&v, p, 2); p += 2; value = (uintptr_t)(intptr_t)v; break; }
+        case 0x0b: { int32_t v; memcpy(&v, p, 4); p += 4; value = (uintptr_t)(intptr_t)v; break; }
+        case 0x0c: { int64_t v; memcpy(&v, p, 8); p += 8; value = (uintptr_t)v; break; }
+        default: return false;
+        }
+        switch (enc & 0x70) {
+        case 0x00: break;
+        case 0x10: value += reinterpret_cast<uintptr_t>(field); break;
+        case 0x30: value += dataBase; break;
+        default: return false;
+        }
+        out = value;
+        return true;
+    }
+
+    static bool parseCie(const uint8_t* cie, Cie& c) {
+        uint32_t length, id;
+        memcpy(&length, cie, 4);
+        if (!length || length == 0xffffffff) return false;
+        const uint8_t* p = cie + 4;
+        c.end = p + length;
+        memcpy(&id, p, 4);
+        p += 4;
+        if (id) return false;
+
+        uint8_t version = *p++;
+        const char* augmentation = reinterpret_cast<const char*>(p);
+        while (*p) p++;
+        p++;
+        if (augmentation[0] && augmentation[0] != 'z') return false;
+
+        c.codeAlign = uleb(p);
+        c.dataAlign = sleb(p);
+        c.raReg = version == 1 ? *p++ : uleb(p);
+        c.fdeEnc = 0;
+        c.augmented = augmentation[0] == 'z';
+        if (c.augmented) {
+            uintptr_t augLength = uleb(p);
+            const uint8_t* augEnd = p + augLength;
+            for (const char* a = augmentation + 1; *a; a++) {
+                if (*a == 'R') {
+                    c.fdeEnc = *p++;
+                } else if (*a == 'P') {
+                    uint8_t enc = *p++;
+                    uintptr_t personality;
+                    if (!encoded(p, enc & 0x7f, 0, personality)) return false;
+                } else if (*a == 'L') {
+                    p++;
+                } else if (*a != 'S') {
+                    break;
+                }
+            }
+            p = augEnd;
+        }
+        c.insns = p;
+        return true;
+    }
+
+    static bool parseFde(const uint8_t* fde, Cie& cie, uintptr_t& begin, uintptr_t& range,
+                         const uint8_t*& insns, const uint8_t*& end) {
+        uint32_t length;
+        int32_t cieOffset;
+        memcpy(&length, fde, 4);
+        if (!length || length == 0xffffffff) return false;
+        const uint8_t* p = fde + 4;
+        end = p + length;
+        memcpy(&cieOffset, p, 4);
+        if (!cieOffset || !parseCie(p - cieOffset, cie)) return false;
+        p += 4;
+        if (!encoded(p, cie.fdeEnc, 0, begin) || !encoded(p, cie.fdeEnc & 0x0f, 0, range)) return false;
+        if (cie.augmented) {
+            uintptr_t augLength = uleb(p);
+            p += augLength;
+        }
+        insns = p;
+        return true;
+    }
+
+#if defined(__x86_64__)
+    static inline void setOffset(Rules& r, const Cie& cie, uintptr_t reg, intptr_t offset) {
+        if (reg == FP_REG) {
+            r.fpSaved = true;
+            r.fpOff = offset;
+        } else if (reg == cie.raReg) {
+            r.raSaved = true;
+            r.raOff = offset;
+        }
+    }
+
+    static inline void restore(Rules& r, const Rules& initial, const Cie& cie, uintptr_t reg) {
+        if (reg == FP_REG) {
+            r.fpSaved = initial.fpSaved;
+            r.fpOff = initial.fpOff;
+        } else if (reg == cie.raReg) {
+            r.raSaved = initial.raSaved;
+            r.raOff = initial.raOff;
+        }
+    }
+
+    // Runs CFA instructions for the row covering target. usesFp reports
+    // whether the CFA was ever based on the frame pointer.
+    static bool execute(const uint8_t* p, const uint8_t* end, const Cie& cie, uintptr_t loc, uintptr_t target,
+                        Rules& r, const Rules& initial, bool* usesFp) {
+        Rules remembered[4];
+        int depth = 0;
+        while (p < end) {
+            uint8_t op = *p++;
+            uint8_t operand = op & 0x3f;
+            switch (op & 0xc0) {
+            case 0x40:
+                loc += operand * cie.codeAlign;
+                if (loc > target) return true;
+                continue;
+            case 0x80:
+                setOffset(r, cie, operand, (intptr_t)uleb(p) * cie.dataAlign);
+                continue;
+            case 0xc0:
+                restore(r, initial, cie, operand);
+                continue;
+            }
+
+            uintptr_t reg;
+            switch (op) {
+            case 0x00:
+                break;
+            case 0x01:
+                if (!encoded(p, cie.fdeEnc, 0, loc)) return false;
+                if (loc > target) return true;
+                break;
+            case 0x02:
+                loc += *p++ * cie.codeAlign;
+                if (loc > target) return true;
+                break;
+            case 0x03: {
+                uint16_t delta;
+                memcpy(&delta, p, 2);
+                p += 2;
+                loc += delta * cie.codeAlign;
+                if (loc > target) return true;
+                break;
+            }
+            case 0x04: {
+                uint32_t delta;
+                memcpy(&delta, p, 4);
+                p += 4;
+                loc += delta * cie.codeAlign;
+                if (loc > target) return true;
+                break;
+            }
+            case 0x05:
+                reg = uleb(p);
+                setOffset(r, cie, reg, (intptr_t)uleb(p) * cie.dataAlign);
+                break;
+            case 0x06:
+                restore(r, initial, cie, uleb(p));
+                break;
+            case 0x07:
+            case 0x08:
+                reg = uleb(p);
+                if (reg == FP_REG) r.fpSaved = false;
+                else if (reg == cie.raReg) r.raSaved = false;
+                break;
+            case 0x09:
+                reg = uleb(p);
+                uleb(p);
+                if (reg == FP_REG || reg == cie.raReg) return false;
+                break;
+            case 0x0a:
+                if (depth == 4) return false;
+                remembered[depth++] = r;
+                break;
+            case 0x0b:
+                if (!depth) return false;
+                r = remembered[--depth];
+                break;
+            case 0x0c:
+                r.cfaReg = uleb(p);
+                r.cfaOff = (intptr_t)uleb(p);
+                if (usesFp && r.cfaReg == FP_REG) *usesFp = true;
+                break;
+            case 0x0d:
+                r.cfaReg = uleb(p);
+                if (usesFp && r.cfaReg == FP_REG) *usesFp = true;
+                break;
+            case 0x0e:
+                r.cfaOff = (intptr_t)uleb(p);
+                break;
+            case 0x10:
+            case 0x16: {
+                reg = uleb(p);
+                uintptr_t length = uleb(p);
+                p += length;
+                if (reg == FP_REG || reg == cie.raReg) return false;
+                break;
+            }
+            case 0x11:
+                reg = uleb(p);
+                setOffset(r, cie, reg, sleb(p) * cie.dataAlign);
+                break;
+            case 0x12:
+                r.cfaReg = uleb(p);
+                r.cfaOff = sleb(p) * cie.dataAlign;
+                if (usesFp && r.cfaReg == FP_REG) *usesFp = true;
+                break;
+            case 0x13:
+                r.cfaOff = sleb(p) * cie.dataAlign;
+                break;
+            case 0x14:
+                reg = uleb(p);
+                uleb(p);
+                if (reg == FP_REG || reg == cie.raReg) return false;
+                break;
+            case 0x15:
+                reg = uleb(p);
+                sleb(p);
+                if (reg == FP_REG || reg == cie.raReg) return false;
+                break;
+            case 0x2e:
+                uleb(p);
+                break;
+            case 0x2f:
+                reg = uleb(p);
+                setOffset(r, cie, reg, -(intptr_t)uleb(p) * cie.dataAlign);
+                break;
+            default:
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static const uint8_t* findFde(const Module& m, uintptr_t target) {
+        size_t low = 0, high = m.count;
+        while (low < high) {
+            size_t mid = (low + high) / 2;
+            if (reinterpret_cast<uintptr_t>(m.hdr) + (intptr_t)m.table[2 * mid] <= target) low = mid + 1;
+            else high = mid;
+        }
+        return low ? m.hdr + m.table[2 * (low - 1) + 1] : nullptr;
+    }
+
+    static bool rulesFor(const Module& m, uintptr_t target, Rules& rules) {
+        const uint8_t* fde = findFde(m, target);
+        if (!fde) return false;
+        Cie cie;
+        uintptr_t begin, range;
+        const uint8_t *insns, *end;
+        if (!parseFde(fde, cie, begin, range, insns, end) || target < begin || target - begin >= range) return false;
+
+        Rules initial = { 0, 0, 0, 0, false, false };
+        if (!execute(cie.insns, cie.end, cie, begin, UINTPTR_MAX, initial, initial, nullptr)) return false;
+        rules = initial;
+        return execute(insns, end, cie, begin, target, rules, initial, nullptr);
+    }
+
+    static bool cachedRulesFor(const Module& m, uintptr_t target, Rules& rules) {
+        State& s = state();
+        CachedRules& entry = s.cache[(target * 0x9E3779B97F4A7C15ULL >> 52) & (RULE_CACHE - 1)];
+        unsigned seq = entry.seq.load(std::memory_order_acquire);
+        if (!(seq & 1) && entry.target == target) {
+            bool valid = entry.valid;
+            Rules copy = entry.rules;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (entry.seq.load(std::memory_order_relaxed) == seq) {
+                rules = copy;
+                return valid;
+            }
+        }
+
+        bool valid = rulesFor(m, target, rules);
+        if (!s.cacheBusy.test_and_set(std::memory_order_acquire)) {
+            seq = entry.seq.load(std::memory_order_relaxed);
+            entry.seq.store(seq + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            entry.target = target;
+            entry.valid = valid;
+            entry.rules = rules;
+            entry.seq.store(seq + 2, std::memory_order_release);
+            s.cacheBusy.clear(std::memory_order_release);
+        }
+        return valid;
+    }
+
+    static bool cfiStep(Range& known, const Module& m, uintptr_t target, const Regs& r, Regs& next) {
+        Rules rules;
+        if (!cachedRulesFor(m, target, rules) || !rules.raSaved) return false;
+        uintptr_t cfa;
+        if (rules.cfaReg == SP_REG) cfa = r.sp + rules.cfaOff;
+        else if (rules.cfaReg == FP_REG) cfa = r.fp + rules.cfaOff;
+        else return false;
+
+        next.sp = cfa;
+        next.fp = r.fp;
+        if (!load(known, cfa + rules.raOff, next.pc)) return false;
+        return !rules.fpSaved || load(known, cfa + rules.fpOff, next.fp);
+    }
+
+    // mov $15, %rax; syscall -- the rt_sigreturn trampoline, whose sp is the ucontext.
+    static bool signalStep(Range& known, const Regs& r, Regs& next) {
+        static const uint8_t sigreturn[] = { 0x48, 0xc7, 0xc0, 0x0f, 0x00, 0x00, 0x00, 0x0f, 0x05 };
+        if (*reinterpret_cast<const uint8_t*>(r.pc) != sigreturn[0] || memcmp(reinterpret_cast<const void*>(r.pc), sigreturn, sizeof(sigreturn)) != 0) return false;
+        uintptr_t gregs = r.sp + offsetof(ucontext_t, uc_mcontext.gregs);
+        return load(known, gregs + REG_RIP * sizeof(greg_t), next.pc) &&
+               load(known, gregs + REG_RSP * sizeof(greg_t), next.sp) &&
+               load(known, gregs + REG_RBP * sizeof(greg_t), next.fp);
+    }
+#endif
+
+    static inline bool fpStep(Range& known, const Regs& r, Regs& next) {
+        if (r.fp < r.sp || !load(known, r.fp, next.fp) || !load(known, r.fp + sizeof(uintptr_t), next.pc)) return false;
+        next.sp = r.fp + 2 * sizeof(uintptr_t);
+        return true;
+    }
+
+    static const Module* findModule(const Table* t, uintptr_t pc) {
+        int low = 0, high = t->count;
+        while (low < high) {
+            int mid = (low + high) / 2;
+            if (t->modules[mid].textStart <= pc) low = mid + 1;
+            else high = mid;
+        }
+        return low && pc < t->modules[low - 1].textEnd ? &t->modules[low - 1] : nullptr;
+    }
+
+    // exact: r.pc is an interrupted instruction rather than a return address.
+    static int walk(Regs r, bool exact, void** out, int max, int skip) {
+        const Table* t = state().current.load(std::memory_order_acquire);
+        Range known = knownRange();
+        if (r.sp < known.low || r.sp >= known.high) known.low = known.high = r.sp & ~(PAGE - 1);
+
+        const Module* m = nullptr;
+        int n = 0;
+        while (n < max && r.pc) {
+            // Consecutive frames are mostly in the same module.
+            if (!m || r.pc < m->textStart || r.pc >= m->textEnd) m = t ? findModule(t, r.pc) : nullptr;
+            if (t && !m && !exact) break;
+            if (skip) skip--;
+            else out[n++] = reinterpret_cast<void*>(r.pc);
+
+            Regs next;
+            bool stepped = false, signal = false;
+#if defined(__x86_64__)
+            if (m && !exact && (signal = signalStep(known, r, next))) stepped = true;
+            if (!stepped && m && m->framePointers && !exact) stepped = fpStep(known, r, next);
+            if (!stepped && m && m->hdr) stepped = cfiStep(known, *m, exact ? r.pc : r.pc - 1, r, next);
+            if (!stepped && !(m && m->hdr)) stepped = fpStep(known, r, next);
+#else
+            stepped = fpStep(known, r, next);
+#endif
+            if (!stepped || (!signal && next.sp <= r.sp)) break;
+            exact = signal;
+            r = next;
+        }
+        knownRange() = known;
+        return n;
+    }
+
+#if defined(__x86_64__)
+    // Modules whose functions mostly base the CFA on %rbp were built with frame pointers.
+    static bool usesFramePointers(const Module& m) {
+        size_t step = m.count > 64 ? m.count / 64 : 1;
+        int sampled = 0, withFp = 0;
+        for (size_t i = 0; i < m.count; i += step) {
+            Cie cie;
+            uintptr_t begin, range;
+            const uint8_t *insns, *end;
+            if (!parseFde(m.hdr + m.table[2 * i + 1], cie, begin, range, insns, end)) continue;
+            Rules initial = { 0, 0, 0, 0, false, false };
+            Rules rules = initial;
+            bool usesFp = false;
+            if (!execute(cie.insns, cie.end, cie, begin, UINTPTR_MAX, initial, initial, &usesFp)) continue;
+            if (!execute(insns, end, cie, begin, UINTPTR_MAX, rules, initial, &usesFp)) continue;
+            sampled++;
+            withFp += usesFp;
+        }
+        return sampled && withFp * 2 > sampled;
+    }
+#endif
+
+    static int addModule(struct dl_phdr_info* info, size_t, void* data) {
+        Table* t = static_cast<Table*>(data);
+        if (t->count == MAX_MODULES) return 1;
+
+        Module m;
+        memset(&m, 0, sizeof(m));
+        m.textStart = UINTPTR_MAX;
+        const uint8_t* hdr = nullptr;
+        for (int i = 0; i < info->dlpi_phnum; i++) {
+            const ElfW(Phdr)& ph = info->dlpi_phdr[i];
+            uintptr_t start = info->dlpi_addr + ph.p_vaddr;
+            if (ph.p_type == PT_LOAD && (ph.p_flags & PF_X)) {
+                if (start < m.textStart) m.textStart = start;
+                if (start + ph.p_memsz > m.textEnd) m.textEnd = start + ph.p_memsz;
+            } else if (ph.p_type == PT_GNU_EH_FRAME) {
+                hdr = reinterpret_cast<const uint8_t*>(start);
+            }
+        }
+        if (m.textStart == UINTPTR_MAX) return 0;
+
+        // Only the usual binary-search table of sdata4 offsets from the header.
+        m.framePointers = true;
+#if defined(__x86_64__)
+        uintptr_t ehFrame, count;
+        const uint8_t* p = hdr ? hdr + 4 : nullptr;
+        if (hdr && hdr[0] == 1 && hdr[3] == 0x3b && encoded(p, hdr[1], reinterpret_cast<uintptr_t>(hdr), ehFrame) &&
+            encoded(p, hdr[2], reinterpret_cast<uintptr_t>(hdr), count) && count) {
+            m.hdr = hdr;
+            m.table = reinterpret_cast<const int32_t*>(p);
+            m.count = count;
+            m.framePointers = usesFramePointers(m);
+        }
+#endif
+        int i = t->count++;
+        for (; i > 0 && t->modules[i - 1].textStart > m.textStart; i--) t->modules[i] = t->modules[i - 1];
+        t->modules[i] = m;
+        return 0;
+    }
+
+public:
+    // Not signal safe. Call again after dlopen() or dlclose() so new code is
+    // found and unloaded tables are never read.
+    static void refresh() {
+        State& s = state();
+        std::lock_guard<std::mutex> guard(s.lock);
+        if (s.probe[1] < 0 && pipe2(s.probe, O_CLOEXEC | O_NONBLOCK) != 0) s.probe[0] = s.probe[1] = -1;
+        Table* spare = s.current.load(std::memory_order_relaxed) == &s.tables[0] ? &s.tables[1] : &s.tables[0];
+        spare->count = 0;
+        dl_iterate_phdr(addModule, spare);
+        s.current.store(spare, std::memory_order_release);
+
+        // Addresses of an unloaded module may come back as different code.
+        while (s.cacheBusy.test_and_set(std::memory_order_acquire)) {}
+        for (CachedRules& entry : s.cache) {
+            unsigned seq = entry.seq.load(std::memory_order_relaxed);
+            entry.seq.store(seq + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            entry.target = 0;
+            entry.seq.store(seq + 2, std::memory_order_release);
+        }
+        s.cacheBusy.clear(std::memory_order_release);
+    }
+
+    static inline void init() {
+        if (!state().current.load(std::memory_order_acquire)) refresh();
+    }
+
+    static inline bool ready() { return state().current.load(std::memory_order_acquire) != nullptr; }
+
+    // For a signal handler: the interrupted pc first, then its callers.
+    static int fromContext(const void* context, void** out, int max) {
+        const ucontext_t* uc = static_cast<const ucontext_t*>(context);
+        Regs r;
+#if defined(__x86_64__)
+        r.pc = (uintptr_t)uc->uc_mcontext.gregs[REG_RIP];
+        r.sp = (uintptr_t)uc->uc_mcontext.gregs[REG_RSP];
+        r.fp = (uintptr_t)uc->uc_mcontext.gregs[REG_RBP];
+#elif defined(__aarch64__)
+        r.pc = (uintptr_t)uc->uc_mcontext.pc;
+        r.sp = (uintptr_t)uc->uc_mcontext.sp;
+        r.fp = (uintptr_t)uc->uc_mcontext.regs[29];
+#else
+        (void)uc;
+        return 0;
+#endif
+        return walk(r, true, out, max, 0);
+    }
+
+    // Return addresses of the callers of this function, innermost first,
+    // after dropping the first `skip` of them. Walks through signal frames.
+    __attribute__((noinline)) static int stack(void** out, int max, int skip = 0) {
+        const uintptr_t* frame = static_cast<const uintptr_t*>(__builtin_frame_address(0));
+        Regs r;
+        r.pc = reinterpret_cast<uintptr_t>(__builtin_return_address(0));
+        r.sp = reinterpret_cast<uintptr_t>(frame) + 2 * sizeof(uintptr_t);
+        r.fp = frame[0];
+        return walk(r, false, out, max, skip);
+    }
+};
+
+#endif // __linux__
+
+#endif // COS_UNWIND_H
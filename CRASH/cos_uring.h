@@ -0,0 +1,177 @@
+#ifndef COS_URING_H
+#define COS_URING_H
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+#include <cstdint>
+
+// Bare io_uring ring for the COS drain thread, no liburing needed.
+// One thread owns it, so only the kernel side of the rings needs atomics.
+class CosUring {
+private:
+    int ringFd;
+    unsigned entries;
+    unsigned features;
+    unsigned toSubmit;
+
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned* sqMask;
+    unsigned* sqArray;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+    io_uring_sqe* sqes;
+    io_uring_cqe* cqes;
+
+    void* sqRing;
+    void* cqRing;
+    size_t sqRingLen;
+    size_t cqRingLen;
+    size_t sqesLen;
+
+    inline void unmapAll() {
+        if (sqes) munmap(sqes, sqesLen);
+        if (cqRing && cqRing != sqRing) munmap(cqRing, cqRingLen);
+        if (sqRing) munmap(sqRing, sqRingLen);
+        sqes = nullptr;
+        sqRing = cqRing = nullptr;
+    }
+
+public:
+    CosUring() : ringFd(-1), entries(0), features(0), toSubmit(0),
+        sqHead(nullptr), sqTail(nullptr), sqMask(nullptr), sqArray(nullptr),
+        cqHead(nullptr), cqTail(nullptr), cqMask(nullptr),
+        sqes(nullptr), cqes(nullptr), sqRing(nullptr), cqRing(nullptr),
+        sqRingLen(0), cqRingLen(0), sqesLen(0) {}
+
+    ~CosUring() {
+        unmapAll();
+        if (ringFd != -1) close(ringFd);
+    }
+
+    // False on kernels without io_uring (ENOSYS) or where it is locked down (EPERM).
+    bool init(unsigned depth) {
+        io_uring_params p;
+        memset(&p, 0, sizeof(p));
+
+        int fd = (int)syscall(__NR_io_uring_setup, depth, &p);
+        if (fd < 0) return false;
+        ringFd = fd;
+        entries = p.sq_entries;
+        features = p.features;
+
+        sqRingLen = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cqRingLen = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single && cqRingLen > sqRingLen) sqRingLen = cqRingLen;
+
+        sqRing = mmap(nullptr, sqRingLen, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+        if (sqRing == MAP_FAILED) { sqRing = nullptr; return false; }
+
+        if (single) {
+            cqRing = sqRing;
+        } else {
+            cqRing = mmap(nullptr, cqRingLen, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+            if (cqRing == MAP_FAILED) { cqRing = nullptr; return false; }
+        }
+
+        sqesLen = p.sq_entries * sizeof(io_uring_sqe);
+        void* s = mmap(nullptr, sqesLen, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+        if (s == MAP_FAILED) return false;
+        sqes = static_cast<io_uring_sqe*>(s);
+
+        char* sq = static_cast<char*>(sqRing);
+        char* cq = static_cast<char*>(cqRing);
+        sqHead = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+        sqTail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+        sqMask = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+        cqHead = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+        cqMask = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+        return true;
+    }
+
+    inline bool registerBuffers(const iovec* iov, unsigned count) {
+        return syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_BUFFERS, iov, count) == 0;
+    }
+
+    inline unsigned capacity() const { return entries; }
+
+    // Null when the submission ring is full; caller submits and retries.
+    io_uring_sqe* getSqe() {
+        unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+        unsigned tail = *sqTail + toSubmit;
+        if (tail - head >= entries) return nullptr;
+
+        unsigned idx = tail & *sqMask;
+        io_uring_sqe* sqe = &sqes[idx];
+        memset(sqe, 0, sizeof(*sqe));
+        sqArray[idx] = idx;
+        toSubmit++;
+        return sqe;
+    }
+
+    // Offset -1 means "at the file position, and advance it" (Linux 5.6).
+    inline bool followsFilePosition() const {
+#ifdef IORING_FEAT_RW_CUR_POS
+        return (features & IORING_FEAT_RW_CUR_POS) != 0;
+#else
+        return false;
+#endif
+    }
+
+    inline void prepFixed(io_uring_sqe* sqe, unsigned char op, int fd, void* addr,
+                          unsigned len, unsigned long long off, unsigned short bufIndex,
+                          unsigned long long tag) {
+        sqe->opcode = op;
+        sqe->fd = fd;
+        sqe->addr = (unsigned long long)(uintptr_t)addr;
+        sqe->len = len;
+        sqe->off = off;
+        sqe->buf_index = bufIndex;
+        sqe->user_data = tag;
+    }
+
+    // Publishes queued SQEs and blocks until at least waitNr completions exist.
+    int submitAndWait(unsigned waitNr) {
+        if (toSubmit) {
+            __atomic_store_n(sqTail, *sqTail + toSubmit, __ATOMIC_RELEASE);
+            toSubmit = 0;
+        }
+        unsigned flags = waitNr ? IORING_ENTER_GETEVENTS : 0;
+        for (;;) {
+            // Re-derived each pass so an EINTR after a partial submit does not lose SQEs.
+            unsigned n = *sqTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+            int ret = (int)syscall(__NR_io_uring_enter, ringFd, n, waitNr, flags, nullptr, 0);
+            if (ret >= 0) return ret;
+            if (errno != EINTR) return -errno;
+        }
+    }
+
+    bool popCqe(io_uring_cqe& out) {
+        unsigned head = *cqHead;
+        if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) return false;
+        out = cqes[head & *cqMask];
+        __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    CosUring(const CosUring&) = delete;
+    CosUring& operator=(const CosUring&) = delete;
+};
+
+#endif // __linux__
+
+#endif // COS_URING_H
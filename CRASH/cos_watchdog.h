@@ -0,0 +1,164 @@
+#ifndef COS_WATCHDOG_H
+#define COS_WATCHDOG_H
+
+#ifdef __linux__
+#include <atomic>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <string>
+#include "cos_unwind.h"
+#include <execinfo.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Watches one thread (the GUI thread) through a heartbeat counter. When the
+// counter stops moving for longer than the threshold, the watched thread is
+// sent a directed signal whose handler records its own stack, and the report
+// callback runs on the watchdog thread with the symbolized trace.
+class CosWatchdog {
+public:
+    using HangCallback = std::function<void(unsigned long long stalledMs, const std::string& trace)>;
+    using RecoverCallback = std::function<void(unsigned long long stalledMs)>;
+
+private:
+    static const int MAX_FRAMES = 64;
+
+    std::atomic<unsigned long long> beats;
+    std::atomic<bool> running;
+    std::atomic<bool> paused;
+    pthread_t thread;
+    pid_t watchedTid;
+    int stackSignal;
+    unsigned thresholdMs;
+    HangCallback onHang;
+    RecoverCallback onRecover;
+
+    void* frames[MAX_FRAMES];
+    std::atomic<int> frameCount;
+
+    static inline std::atomic<CosWatchdog*>& active() {
+        static std::atomic<CosWatchdog*> current{nullptr};
+        return current;
+    }
+
+    static inline unsigned long long nowMs() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (unsigned long long)ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+    }
+
+    // Runs on the stalled thread and starts from the interrupted pc.
+    static void stackSignalHandler(int, siginfo_t*, void* context) {
+        CosWatchdog* dog = active().load(std::memory_order_acquire);
+        if (!dog) return;
+        int n = CosUnwind::fromContext(context, dog->frames, MAX_FRAMES);
+        dog->frameCount.store(n, std::memory_order_release);
+    }
+
+    std::string captureWatchedStack() {
+        frameCount.store(-1, std::memory_order_relaxed);
+        if (syscall(SYS_tgkill, getpid(), watchedTid, stackSignal) != 0) return std::string();
+
+        for (int i = 0; i < 200 && frameCount.load(std::memory_order_acquire) < 0; i++) usleep(1000);
+        int n = frameCount.load(std::memory_order_acquire);
+        if (n <= 0) return std::string();
+
+        std::string result;
+        char** symbols = backtrace_symbols(frames, n);
+        if (symbols) {
+            for (int i = 0; i < n; i++) {
+                result += symbols[i];
+                result += "\n";
+            }
+            free(symbols);
+        }
+        return result;
+    }
+
+    static void* threadFunc(void* arg) {
+        CosWatchdog* dog = static_cast<CosWatchdog*>(arg);
+        unsigned period = dog->thresholdMs / 4 < 10 ? 10 : dog->thresholdMs / 4;
+        unsigned long long seen = dog->beats.load(std::memory_order_relaxed);
+        unsigned long long changedAt = nowMs();
+        bool stalled = false;
+
+        while (dog->running.load(std::memory_order_acquire)) {
+            usleep(period * 1000);
+            unsigned long long now = nowMs();
+            unsigned long long current = dog->beats.load(std::memory_order_relaxed);
+
+            if (current != seen || dog->paused.load(std::memory_order_relaxed)) {
+                if (stalled && dog->onRecover) dog->onRecover(now - changedAt);
+                seen = current;
+                changedAt = now;
+                stalled = false;
+            } else if (!stalled && now - changedAt >= dog->thresholdMs) {
+                stalled = true;
+                std::string trace = dog->captureWatchedStack();
+                if (dog->onHang) dog->onHang(now - changedAt, trace);
+            }
+        }
+        return nullptr;
+    }
+
+public:
+    CosWatchdog() : beats(0), running(false), paused(false), watchedTid(0), stackSignal(0),
+        thresholdMs(0), frameCount(0) {}
+
+    ~CosWatchdog() { disarm(); }
+
+    // Watches the calling thread. False if already armed or the threshold is 0.
+    bool arm(unsigned threshold, HangCallback hang, RecoverCallback recover) {
+        if (running.load(std::memory_order_acquire) || !threshold) return false;
+
+        thresholdMs = threshold;
+        onHang = hang;
+        onRecover = recover;
+        watchedTid = (pid_t)syscall(SYS_gettid);
+        stackSignal = SIGRTMIN + 3;
+
+        CosUnwind::init();
+
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_sigaction = stackSignalHandler;
+        sa.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        sigaction(stackSignal, &sa, nullptr);
+        active().store(this, std::memory_order_release);
+
+        running.store(true, std::memory_order_release);
+        if (pthread_create(&thread, nullptr, threadFunc, this) != 0) {
+            running.store(false, std::memory_order_release);
+            return false;
+        }
+        return true;
+    }
+
+    void disarm() {
+        if (!running.exchange(false, std::memory_order_acq_rel)) return;
+        pthread_join(thread, nullptr);
+        CosWatchdog* self = this;
+        active().compare_exchange_strong(self, nullptr);
+    }
+
+    // One relaxed store on the watched thread; safe to call at any rate.
+    inline void heartbeat() {
+        beats.store(beats.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    inline void pause(bool value) { paused.store(value, std::memory_order_relaxed); }
+    inline bool armed() const { return running.load(std::memory_order_acquire); }
+    inline unsigned threshold() const { return thresholdMs; }
+
+    CosWatchdog(const CosWatchdog&) = delete;
+    CosWatchdog& operator=(const CosWatchdog&) = delete;
+};
+
+#endif // __linux__
+
+#endif // COS_WATCHDOG_H
@@ -2,6 +2,7 @@
 #define COSEC_H
 
 #include "cos.h"
+#include "cos_latency.h"
 #include <QMainWindow>
 #include <QPushButton>
 #include <QLabel>
@@ -18,10 +19,217 @@
 #include <QDir>
 #include <QVBoxLayout>
 #include <QTimer>
+#include <QAbstractEventDispatcher>
+#include <QMetaEnum>
+#include <QPainter>
+#include <QPainterPath>
+#include <QTableWidget>
+#include <QHeaderView>
+#include <QLoggingCategory>
 #include <iostream>
 
 class COSEC;
 
+// Application-wide event filter timing main thread dispatch. A filter only sees
+// when an event starts, so each event is charged until the next one starts or
+// the loop goes idle: nested sendEvent() calls split their parent's time.
+class CosEventProfiler : public QObject {
+private:
+    CosLatencyTable table;
+    unsigned long long openSince;
+    int openType;
+    const char* openClass;
+
+    inline void closeOpen(unsigned long long now) {
+        if (openClass) table.record(openType, openClass, now - openSince);
+        openClass = nullptr;
+    }
+
+protected:
+    bool eventFilter(QObject* watched, QEvent* event) override {
+        unsigned long long now = CosLatencyTable::nowNs();
+        closeOpen(now);
+        openSince = now;
+        openType = event->type();
+        openClass = watched->metaObject()->className();
+        return false;
+    }
+
+public:
+    inline CosEventProfiler() : openSince(0), openType(0), openClass(nullptr) {
+        QCoreApplication::instance()->installEventFilter(this);
+        QAbstractEventDispatcher* dispatcher = QAbstractEventDispatcher::instance();
+        if (dispatcher) {
+            QObject::connect(dispatcher, &QAbstractEventDispatcher::aboutToBlock, this,
+                             [this]() { closeOpen(CosLatencyTable::nowNs()); });
+        }
+    }
+
+    inline void stop() { QCoreApplication::instance()->removeEventFilter(this); }
+
+    static std::string typeName(int type) {
+        const char* key = QMetaEnum::fromType<QEvent::Type>().valueToKey(type);
+        return key ? std::string(key) : std::to_string(type);
+    }
+
+    inline std::string report(size_t top) const { return table.format(top, typeName); }
+};
+
+// RSS, PSS and heap over the session, drawn from CrashInfo::memoryTimeline.
+class CosMemoryChart : public QWidget {
+private:
+    std::vector<CosMemorySample> samples;
+
+protected:
+    void paintEvent(QPaintEvent*) override {
+        QPainter painter(this);
+        painter.setRenderHint(QPainter::Antialiasing);
+        QRectF area = QRectF(rect()).adjusted(60, 10, -10, -25);
+        painter.drawRect(area);
+        if (samples.size() < 2) return;
+
+        unsigned maxKb = 1;
+        for (const CosMemorySample& s : samples) maxKb = std::max({maxKb, s.rssKb, s.pssKb, s.heapKb});
+        double spanMs = std::max(1u, samples.back().msSinceStart - samples.front().msSinceStart);
+
+        auto plot = [&](unsigned CosMemorySample::*field, const QColor& color) {
+            QPainterPath path;
+            for (size_t i = 0; i < samples.size(); i++) {
+                QPointF p(area.left() + area.width() * (samples[i].msSinceStart - samples.front().msSinceStart) / spanMs,
+                          area.bottom() - area.height() * (samples[i].*field) / maxKb);
+                if (i) path.lineTo(p);
+                else path.moveTo(p);
+            }
+            painter.setPen(QPen(color, 2));
+            painter.drawPath(path);
+        };
+        plot(&CosMemorySample::rssKb, QColor("#d9534f"));
+        plot(&CosMemorySample::pssKb, QColor("#5cb85c"));
+        plot(&CosMemorySample::heapKb, QColor("#337ab7"));
+
+        painter.setPen(palette().color(QPalette::WindowText));
+        painter.drawText(QRectF(0, area.top() - 5, 55, 20), Qt::AlignRight, QString::number(maxKb / 1024.0, 'f', 1) + " MB");
+        painter.drawText(QRectF(0, area.bottom() - 15, 55, 20), Qt::AlignRight, "0");
+        painter.drawText(QRectF(area.left(), area.bottom() + 5, area.width(), 20), Qt::AlignRight,
+                         QString::number(spanMs / 1000.0, 'f', 1) + " s");
+        painter.drawText(QRectF(area.left(), area.bottom() + 5, area.width(), 20), Qt::AlignLeft,
+                         "RSS (red)   PSS (green)   heap (blue)");
+    }
+
+public:
+    inline explicit CosMemoryChart(const std::vector<CosMemorySample>& series) : samples(series) {
+        setMinimumHeight(160);
+        setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
+    }
+};
+
+// Qt message handler writing into the COS_LOG rings, so category, severity and
+// source location reach the log without a trip through the stderr pipe. The
+// level also drives a category filter: a disabled qCDebug() never formats its
+// arguments, and a plain qDebug() is dropped before the handler runs.
+class CosQtMessages {
+private:
+    static inline std::atomic<int>& minimum() {
+        static std::atomic<int> level{(int)CosLevel::Debug};
+        return level;
+    }
+
+    static inline QLoggingCategory::CategoryFilter& previousFilter() {
+        static QLoggingCategory::CategoryFilter filter = nullptr;
+        return filter;
+    }
+
+    static inline QtMessageHandler& previousHandler() {
+        static QtMessageHandler handler = nullptr;
+        return handler;
+    }
+
+    static inline bool& installed() {
+        static bool value = false;
+        return value;
+    }
+
+    static inline CosLevel levelOf(QtMsgType type) {
+        switch (type) {
+        case QtDebugMsg: return CosLevel::Debug;
+        case QtInfoMsg: return CosLevel::Info;
+        case QtWarningMsg: return CosLevel::Warning;
+        case QtCriticalMsg: return CosLevel::Error;
+        default: return CosLevel::Fatal;
+        }
+    }
+
+    static void filter(QLoggingCategory* category) {
+        if (previousFilter()) previousFilter()(category);
+        int min = minimum().load(std::memory_order_relaxed);
+        if (min > (int)CosLevel::Debug) category->setEnabled(QtDebugMsg, false);
+        if (min > (int)CosLevel::Info) category->setEnabled(QtInfoMsg, false);
+        if (min > (int)CosLevel::Warning) category->setEnabled(QtWarningMsg, false);
+        if (min > (int)CosLevel::Error) category->setEnabled(QtCriticalMsg, false);
+    }
+
+    static void handler(QtMsgType type, const QMessageLogContext& context, const QString& message) {
+        static constexpr CosLogSite located[] = {
+            { CosLevel::Debug, "{}: {} ({}:{})", __FILE__, __LINE__ },
+            { CosLevel::Info, "{}: {} ({}:{})", __FILE__, __LINE__ },
+            { CosLevel::Warning, "{}: {} ({}:{})", __FILE__, __LINE__ },
+            { CosLevel::Error, "{}: {} ({}:{})", __FILE__, __LINE__ },
+            { CosLevel::Fatal, "{}: {} ({}:{})", __FILE__, __LINE__ },
+        };
+        static constexpr CosLogSite plain[] = {
+            { CosLevel::Debug, "{}: {}", __FILE__, __LINE__ },
+            { CosLevel::Info, "{}: {}", __FILE__, __LINE__ },
+            { CosLevel::Warning, "{}: {}", __FILE__, __LINE__ },
+            { CosLevel::Error, "{}: {}", __FILE__, __LINE__ },
+            { CosLevel::Fatal, "{}: {}", __FILE__, __LINE__ },
+        };
+
+        CosLevel level = levelOf(type);
+        if ((int)level < minimum().load(std::memory_order_relaxed)) return;
+
+        QByteArray text = message.toUtf8();
+        std::string_view body(text.constData(), (size_t)text.size());
+        const char* category = context.category ? context.category : "default";
+
+        // Qt aborts as soon as this returns, before the drain thread could run.
+        if (type == QtFatalMsg) {
+            std::string line = std::string("[FATAL] ") + category + ": " + std::string(body) + "\n";
+            write(STDERR_FILENO, line.data(), line.size());
+            return;
+        }
+
+        // Release builds of Qt leave file and line empty unless QT_MESSAGELOGCONTEXT is set.
+        if (context.file)
+            CosLog::write<4>(&located[(int)level], category, body, context.file, context.line);
+        else
+            CosLog::write<2>(&plain[(int)level], category, body);
+    }
+
+public:
+    static void install(CosLevel level) {
+        minimum().store((int)level, std::memory_order_relaxed);
+        if (installed()) {
+            QLoggingCategory::installFilter(filter);
+            return;
+        }
+        installed() = true;
+        previousHandler() = qInstallMessageHandler(handler);
+        previousFilter() = QLoggingCategory::installFilter(filter);
+    }
+
+    // Installing the filter again re-applies it to every existing category.
+    static inline void setLevel(CosLevel level) {
+        if (installed()) install(level);
+    }
+
+    static void uninstall() {
+        if (!installed()) return;
+        installed() = false;
+        qInstallMessageHandler(previousHandler());
+        QLoggingCategory::installFilter(previousFilter());
+    }
+};
+
 class Crash_Info {
 private:
     COS* logger;
@@ -29,16 +237,21 @@ private:
     QIcon windowIcon;
     QString windowTitle;
     bool crashHandlerActive;
+    CosEventProfiler* profiler;
 
-    inline Crash_Info() : logger(nullptr), mainWindow(nullptr), crashHandlerActive(false) {
+    inline Crash_Info() : logger(nullptr), mainWindow(nullptr), crashHandlerActive(false), profiler(nullptr) {
         logger = new COS();
+        if (logger->getOptions().qtMessageHandler) CosQtMessages::install(logger->getOptions().qtMessageLevel);
 
         logger->setCrashCallback([this](const CrashInfo& info) {
             handleCrash(info);
         });
     }
 
-    inline ~Crash_Info() { delete logger; }
+    inline ~Crash_Info() {
+        CosQtMessages::uninstall();
+        delete logger;
+    }
 
     void handleCrash(const CrashInfo& crashInfo);
 
@@ -50,9 +263,34 @@ public:
 
     inline void registerWindow(QMainWindow* win) {
         if (win) {
+            if (!mainWindow)
+                CosTrace::phase("startup: COS to first window", logger->startedAtUs() * 1000, CosLog::monotonicNs());
             mainWindow = win;
             windowIcon = win->windowIcon();
             windowTitle = win->windowTitle();
+
+            // Parented to the application, not the window, so closing one window
+            // never looks like a hang.
+            if (logger->armWatchdog()) {
+                QTimer* heartbeat = new QTimer(QCoreApplication::instance());
+                QObject::connect(heartbeat, &QTimer::timeout, [this]() { logger->heartbeat(); });
+                heartbeat->start(logger->heartbeatIntervalMs());
+            }
+
+            const CosOptions& opts = logger->getOptions();
+            if (opts.eventProfiling && !profiler) {
+                profiler = new CosEventProfiler();
+                profiler->setParent(QCoreApplication::instance());
+                if (opts.eventSummaryMs) {
+                    QTimer* summary = new QTimer(profiler);
+                    QObject::connect(summary, &QTimer::timeout, [this]() {
+                        std::string text = "\n- EVENT LATENCY ----------------------------------------------\n" +
+                                           profiler->report(10);
+                        write(STDOUT_FILENO, text.data(), text.size());
+                    });
+                    summary->start(opts.eventSummaryMs);
+                }
+            }
         }
     }
 
@@ -98,10 +336,65 @@ private:
         toolBox->addItem(createCrashReporterPage(), QIcon::fromTheme("dialog-warning"), "Crash Report");
         toolBox->addItem(createDetailsPage(), QIcon::fromTheme("dialog-information"), "Details");
         toolBox->addItem(createLogsPage(), QIcon::fromTheme("text-x-generic"), "Logs");
+        if (!crashInfo.exceptionType.empty())
+            toolBox->addItem(createExceptionPage(), QIcon::fromTheme("dialog-error"), "Exception");
+        if (!crashInfo.hangReport.empty())
+            toolBox->addItem(createHangPage(), QIcon::fromTheme("appointment-missed"), "Hang");
+        if (crashInfo.memoryTimeline.size() > 1 || !crashInfo.heapProfile.empty())
+            toolBox->addItem(createMemoryPage(), QIcon::fromTheme("drive-harddisk"), "Memory");
+        if (!crashInfo.flightEvents.empty())
+            toolBox->addItem(createTimelinePage(), QIcon::fromTheme("view-calendar-timeline"), "Timeline");
+        if (!crashInfo.performanceReport.empty() || !crashInfo.cpuProfile.empty())
+            toolBox->addItem(createPerformancePage(), QIcon::fromTheme("utilities-system-monitor"), "Performance");
 
         toolBox->setCurrentIndex(0);
     }
 
+    static const qint64 LOG_PAGE_BYTES = 16 * 1024 * 1024;
+
+    // A large log only shows its last LOG_PAGE_BYTES, starting on a whole line
+    // found through the sidecar index. The log is mapped rather than read; with
+    // memfdLog those are the pages COS wrote, so nothing touches the disk.
+    static QString readLog(const std::string& path, int memfd = -1) {
+        QFile f(QString::fromStdString(path));
+        bool opened = memfd != -1 ? f.open(memfd, QIODevice::ReadOnly, QFileDevice::DontCloseHandle)
+                                  : f.open(QIODevice::ReadOnly);
+        if (!opened) return "[ERROR: Log file not found]";
+        qint64 size = f.size();
+
+        CosLogPosition pos = { 0, 0 };
+        qint64 start = 0;
+        if (size > LOG_PAGE_BYTES) {
+#ifndef _WIN32
+            CosLogIndex index;
+            index.open(path);
+            if (!index.seekOffset((uint64_t)(size - LOG_PAGE_BYTES), pos)) pos = { 0, 0 };
+#endif
+            start = pos.offset ? (qint64)pos.offset : size - LOG_PAGE_BYTES;
+        }
+
+        QString text;
+        if (uchar* data = size > start ? f.map(start, size - start) : nullptr) {
+            const char* p = reinterpret_cast<const char*>(data);
+            const char* end = p + (size - start);
+            if (start && !pos.offset) {
+                const char* nl = static_cast<const char*>(memchr(p, '\n', end - p));
+                p = nl ? nl + 1 : end;
+            }
+            text = QString::fromUtf8(p, end - p);
+            f.unmap(data);
+        } else {
+            f.seek(start);
+            if (start && !pos.offset) f.readLine();
+            text = QString::fromUtf8(f.readAll());
+        }
+        if (!start) return text;
+
+        QString note = pos.offset ? QString("[Showing from line %1; the full log is %2]\n\n").arg(pos.line + 1)
+                                  : QString("[Showing the last %1 MiB; the full log is %2]\n\n").arg(LOG_PAGE_BYTES >> 20);
+        return note.arg(QString::fromStdString(path)) + text;
+    }
+
     inline QWidget* createLogsPage() {
         QWidget* page = new QWidget();
         QVBoxLayout* outerLayout = new QVBoxLayout(page);
@@ -116,7 +409,7 @@ private:
         QTextEdit* logText = new QTextEdit();
         logText->setReadOnly(true);
 
-        logText->setPlainText([](const std::string& p){QFile f(QString::fromStdString(p)); return f.open(QIODevice::ReadOnly|QIODevice::Text)?f.readAll():"[ERROR: Log file not found]";}(crashInfo.logPath));
+        logText->setPlainText(readLog(crashInfo.logPath, crashInfo.logMemfd));
         logText->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
         logText->setFont(QFont("Monospace", 9));
 
@@ -180,6 +473,185 @@ private:
         return page;
     }
 
+    inline QWidget* createExceptionPage() {
+        QWidget* page = new QWidget();
+        QVBoxLayout* mainLayout = new QVBoxLayout(page);
+        mainLayout->setContentsMargins(15, 15, 15, 15);
+        mainLayout->setSpacing(12);
+
+        mainLayout->addWidget(new QLabel("<h3>Uncaught Exception</h3>"));
+
+        QLabel* desc = new QLabel(QString("<b>%1</b>: %2")
+                                      .arg(QString::fromStdString(crashInfo.exceptionType).toHtmlEscaped(),
+                                           QString::fromStdString(crashInfo.exceptionWhat).toHtmlEscaped()));
+        desc->setWordWrap(true);
+        desc->setTextInteractionFlags(Qt::TextSelectableByMouse);
+        mainLayout->addWidget(desc);
+
+        QTextEdit* siteText = new QTextEdit();
+        siteText->setReadOnly(true);
+        siteText->setFont(QFont("Monospace", 9));
+        siteText->setPlainText(crashInfo.throwSite.empty()
+                                   ? QString("Throw site not recorded (libcrash built without TRIG_THROW_CAPTURE).")
+                                   : QString::fromStdString(crashInfo.throwSite));
+        siteText->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
+        mainLayout->addWidget(siteText, 1);
+
+        return page;
+    }
+
+    inline QWidget* createHangPage() {
+        QWidget* page = new QWidget();
+        QVBoxLayout* mainLayout = new QVBoxLayout(page);
+        mainLayout->setContentsMargins(15, 15, 15, 15);
+        mainLayout->setSpacing(12);
+
+        mainLayout->addWidget(new QLabel("<h3>Last Main Thread Hang</h3>"));
+
+        QLabel* desc = new QLabel(
+            "The main thread stopped processing events before the crash. "
+            "Below is where it was stuck.");
+        desc->setWordWrap(true);
+        desc->setStyleSheet("color: #555;");
+        mainLayout->addWidget(desc);
+
+        QTextEdit* hangText = new QTextEdit();
+        hangText->setReadOnly(true);
+        hangText->setFont(QFont("Monospace", 9));
+        hangText->setPlainText(QString::fromStdString(crashInfo.hangReport));
+        hangText->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
+        mainLayout->addWidget(hangText, 1);
+
+        return page;
+    }
+
+    inline QWidget* createMemoryPage() {
+        QWidget* page = new QWidget();
+        QVBoxLayout* mainLayout = new QVBoxLayout(page);
+        mainLayout->setContentsMargins(15, 15, 15, 15);
+        mainLayout->setSpacing(12);
+
+        if (crashInfo.memoryTimeline.size() > 1) {
+            mainLayout->addWidget(new QLabel("<h3>Memory Timeline</h3>"));
+
+            const CosMemorySample& last = crashInfo.memoryTimeline.back();
+            unsigned peak = 0;
+            for (const CosMemorySample& s : crashInfo.memoryTimeline) peak = std::max(peak, s.rssKb);
+            QLabel* desc = new QLabel(QString("RSS at the crash %1 MB (peak %2 MB), heap %3 MB, "
+                                              "memory pressure %4% some / %5% full over the last 10 s.")
+                                          .arg(last.rssKb / 1024.0, 0, 'f', 1)
+                                          .arg(peak / 1024.0, 0, 'f', 1)
+                                          .arg(last.heapKb / 1024.0, 0, 'f', 1)
+                                          .arg(last.psiSome10 / 100.0, 0, 'f', 2)
+                                          .arg(last.psiFull10 / 100.0, 0, 'f', 2));
+            desc->setWordWrap(true);
+            desc->setStyleSheet("color: #555;");
+            mainLayout->addWidget(desc);
+
+            mainLayout->addWidget(new CosMemoryChart(crashInfo.memoryTimeline), 1);
+        }
+
+        if (!crashInfo.heapProfile.empty()) {
+            mainLayout->addWidget(new QLabel("<b>Largest Live Allocation Sites (root;...;allocator estimated bytes):</b>"));
+
+            QTextEdit* heapText = new QTextEdit();
+            heapText->setReadOnly(true);
+            heapText->setLineWrapMode(QTextEdit::NoWrap);
+            heapText->setFont(QFont("Monospace", 9));
+            heapText->setPlainText(QString::fromStdString(crashInfo.heapProfile));
+            heapText->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
+            mainLayout->addWidget(heapText, 1);
+        }
+        return page;
+    }
+
+    inline QWidget* createTimelinePage() {
+        QWidget* page = new QWidget();
+        QVBoxLayout* mainLayout = new QVBoxLayout(page);
+        mainLayout->setContentsMargins(15, 15, 15, 15);
+        mainLayout->setSpacing(12);
+
+        mainLayout->addWidget(new QLabel("<h3>Flight Recorder</h3>"));
+
+        QLabel* desc = new QLabel(
+            "The last events recorded by every thread, merged in time order. "
+            "The crash happened after the bottom row.");
+        desc->setWordWrap(true);
+        desc->setStyleSheet("color: #555;");
+        mainLayout->addWidget(desc);
+
+        const std::vector<CosFlightRecord>& events = crashInfo.flightEvents;
+        QTableWidget* table = new QTableWidget((int)events.size(), 5);
+        table->setHorizontalHeaderLabels({"Time (s)", "Thread", "Event", "Arg 1", "Arg 2"});
+        table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+        table->setSelectionBehavior(QAbstractItemView::SelectRows);
+        table->verticalHeader()->setVisible(false);
+        table->horizontalHeader()->setStretchLastSection(true);
+        table->setFont(QFont("Monospace", 9));
+
+        // One tint per thread so interleaving stays readable.
+        std::vector<int> threads;
+        for (int row = 0; row < (int)events.size(); row++) {
+            const CosFlightRecord& e = events[row];
+            auto it = std::find(threads.begin(), threads.end(), e.tid);
+            int lane = (int)(it - threads.begin());
+            if (it == threads.end()) threads.push_back(e.tid);
+            QColor tint = QColor::fromHsv((lane * 67) % 360, 40, 255);
+
+            QStringList cells = { QString::number(e.seconds, 'f', 6), QString::number(e.tid),
+                                  QString::fromUtf8(e.name ? e.name : "?"),
+                                  QString::number((qulonglong)e.a), QString::number((qulonglong)e.b) };
+            for (int col = 0; col < cells.size(); col++) {
+                QTableWidgetItem* item = new QTableWidgetItem(cells[col]);
+                item->setBackground(tint);
+                table->setItem(row, col, item);
+            }
+        }
+        table->resizeColumnsToContents();
+        table->scrollToBottom();
+        mainLayout->addWidget(table, 1);
+
+        return page;
+    }
+
+    inline QWidget* createPerformancePage() {
+        QWidget* page = new QWidget();
+        QVBoxLayout* mainLayout = new QVBoxLayout(page);
+        mainLayout->setContentsMargins(15, 15, 15, 15);
+        mainLayout->setSpacing(12);
+
+        mainLayout->addWidget(new QLabel("<h3>Slowest Event Handlers</h3>"));
+
+        QLabel* desc = new QLabel(
+            "Main thread event dispatch times recorded before the crash, "
+            "worst single dispatch first.");
+        desc->setWordWrap(true);
+        desc->setStyleSheet("color: #555;");
+        mainLayout->addWidget(desc);
+
+        QTextEdit* perfText = new QTextEdit();
+        perfText->setReadOnly(true);
+        perfText->setLineWrapMode(QTextEdit::NoWrap);
+        perfText->setFont(QFont("Monospace", 9));
+        perfText->setPlainText(QString::fromStdString(crashInfo.performanceReport));
+        perfText->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
+        mainLayout->addWidget(perfText, 1);
+
+        if (!crashInfo.cpuProfile.empty()) {
+            mainLayout->addWidget(new QLabel("<b>Hottest CPU Stacks (root;...;leaf samples):</b>"));
+
+            QTextEdit* cpuText = new QTextEdit();
+            cpuText->setReadOnly(true);
+            cpuText->setLineWrapMode(QTextEdit::NoWrap);
+            cpuText->setFont(QFont("Monospace", 9));
+            cpuText->setPlainText(QString::fromStdString(crashInfo.cpuProfile));
+            cpuText->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
+            mainLayout->addWidget(cpuText, 1);
+        }
+
+        return page;
+    }
+
     inline QWidget* createDetailsPage() {
         QWidget* page = new QWidget();
         QHBoxLayout* mainLayout = new QHBoxLayout(page);
@@ -377,13 +849,19 @@ inline void Crash_Info::handleCrash(const CrashInfo& crashInfo) {
 
     updateWindowInfo();
 
+    CrashInfo report = crashInfo;
+    if (profiler) {
+        profiler->stop();
+        report.performanceReport = profiler->report(25);
+    }
+
     if (mainWindow) {
         mainWindow->hide();
         mainWindow->deleteLater();
         mainWindow = nullptr;
     }
 
-    COSEC* dialog = new COSEC(crashInfo, QCoreApplication::applicationFilePath(), windowIcon, windowTitle);
+    COSEC* dialog = new COSEC(report, QCoreApplication::applicationFilePath(), windowIcon, windowTitle);
 
     QObject::connect(dialog, &QDialog::finished, [](int result) {
         std::cout << "\nCrash dialog closed: " << result << std::endl;
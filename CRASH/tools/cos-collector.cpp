@@ -0,0 +1,39 @@
+#include "../cos_collector.h"
+#include <csignal>
+#include <cstdlib>
+
+static CosCollector* activeCollector = nullptr;
+
+static void stopCollector(int) {
+    if (activeCollector) activeCollector->stop();
+}
+
+int main(int argc, char* argv[]) {
+    std::string socketPath = "/tmp/cos-collector.sock";
+    std::string directory = "/tmp/cos-collector";
+    size_t segmentMb = 64;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--socket") socketPath = argv[i + 1];
+        else if (arg == "--dir") directory = argv[i + 1];
+        else if (arg == "--segment-mb") segmentMb = strtoul(argv[i + 1], nullptr, 10);
+        else {
+            fprintf(stderr, "usage: %s [--socket PATH] [--dir DIR] [--segment-mb N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    CosCollector collector(socketPath, directory, segmentMb * 1024 * 1024);
+    if (!collector.listen()) {
+        fprintf(stderr, "cos-collector: cannot listen on %s (already running?)\n", socketPath.c_str());
+        return 1;
+    }
+
+    activeCollector = &collector;
+    std::signal(SIGTERM, stopCollector);
+    std::signal(SIGINT, stopCollector);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    return collector.run();
+}
@@ -0,0 +1,135 @@
+#include "../cos_search.h"
+#include <dirent.h>
+#include <algorithm>
+#include <cstdlib>
+#include <ctime>
+
+static bool printMatch(void* context, const std::string& file, uint64_t line, const char* text, size_t len) {
+    if (*static_cast<bool*>(context)) {
+        printf("%s\n", file.c_str());
+        return false;
+    }
+    printf("%s:%llu:%.*s\n", file.c_str(), (unsigned long long)line, (int)len, text);
+    return true;
+}
+
+// "YYYY-MM-DD HH:MM[:SS]", or "HH:MM[:SS]" for today, in local time. end
+// gives the end of that minute or second instead of its start.
+static bool parseTime(const char* text, bool end, uint64_t& wallNs) {
+    time_t now = time(nullptr);
+    struct tm today, tm;
+    localtime_r(&now, &today);
+    today.tm_sec = 0;
+    // A failed strptime() may still have filled some fields.
+    tm = today;
+    const char* rest = strptime(text, "%Y-%m-%d %H:%M", &tm);
+    if (!rest) {
+        tm = today;
+        rest = strptime(text, "%H:%M", &tm);
+    }
+    if (!rest) return false;
+    time_t span = 60;
+    if (*rest == ':') {
+        rest = strptime(rest + 1, "%S", &tm);
+        span = 1;
+    }
+    if (!rest || *rest) return false;
+    tm.tm_isdst = -1;
+    wallNs = (uint64_t)(mktime(&tm) + (end ? span : 0)) * 1000000000ULL;
+    return true;
+}
+
+static void addPath(const std::string& path, std::vector<std::string>& files) {
+    DIR* dir = opendir(path.c_str());
+    if (!dir) {
+        files.push_back(path);
+        return;
+    }
+    std::vector<std::string> found;
+    while (dirent* e = readdir(dir)) {
+        std::string name = e->d_name;
+        if (name.size() > 4 && name.compare(name.size() - 4, 4, ".log") == 0)
+            found.push_back(path + (path.back() == '/' ? "" : "/") + name);
+    }
+    closedir(dir);
+    std::sort(found.begin(), found.end());
+    files.insert(files.end(), found.begin(), found.end());
+}
+
+int main(int argc, char* argv[]) {
+    bool ignoreCase = false, wholeWord = false, filesOnly = false, showStats = false, indexOnly = false, usage = false;
+    uint64_t since = 0, until = UINT64_MAX;
+    std::string pattern;
+    std::vector<std::string> paths;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-i") ignoreCase = true;
+        else if (arg == "-w") wholeWord = true;
+        else if (arg == "-l") filesOnly = true;
+        else if (arg == "--stats") showStats = true;
+        else if (arg == "--index") indexOnly = true;
+        else if (arg == "--since" && i + 1 < argc && parseTime(argv[i + 1], false, since)) i++;
+        else if (arg == "--until" && i + 1 < argc && parseTime(argv[i + 1], true, until)) i++;
+        else if (arg[0] != '-' && pattern.empty() && !indexOnly) pattern = arg;
+        else if (arg[0] != '-') paths.push_back(arg);
+        else usage = true;
+    }
+    if (usage || (pattern.empty() && !indexOnly)) {
+        fprintf(stderr, "usage: %s [-i] [-w] [-l] [--since TIME] [--until TIME] [--stats] STRING [FILE|DIR]...\n"
+                        "       %s --index [FILE|DIR]...\n"
+                        "TIME is \"YYYY-MM-DD HH:MM[:SS]\" or \"HH:MM[:SS]\"; DIR means its *.log files, /tmp by default\n",
+                argv[0], argv[0]);
+        return 2;
+    }
+    if (paths.empty()) paths.push_back("/tmp");
+
+    std::vector<std::string> files;
+    for (const std::string& path : paths) addPath(path, files);
+
+    if (indexOnly) {
+        int failed = 0;
+        for (const std::string& file : files) {
+            CosLogFilter filter;
+            if (!filter.update(file, CosLogFilter::SEGMENT_BYTES, false) ||
+                !filter.write(CosLogFilter::pathFor(file))) {
+                fprintf(stderr, "cos-search: cannot index %s\n", file.c_str());
+                failed++;
+            }
+        }
+        return failed ? 1 : 0;
+    }
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    CosLogSearch search(pattern, ignoreCase, wholeWord);
+    CosSearchStats stats;
+    for (const std::string& file : files) {
+        // The time index narrows the byte range; without one the whole log is searched.
+        uint64_t from = 0, to = UINT64_MAX;
+        CosLogIndex index;
+        if ((since || until != UINT64_MAX) && index.open(file)) {
+            CosLogPosition pos;
+            if (since && index.seekTime(since, pos)) from = pos.offset;
+            for (const CosIndexEntry& e : index.all()) {
+                if (e.wallNs > until) {
+                    to = e.offset;
+                    break;
+                }
+            }
+        }
+        search.searchFile(file, from, to, printMatch, &filesOnly, stats);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (showStats) {
+        unsigned long long read = stats.segments - stats.skipped;
+        fprintf(stderr, "%llu files, %llu of %llu segments skipped, %llu read without a match (%.1f%%), "
+                        "%.1f of %.1f MB read, %llu matches, %.3f s\n",
+                stats.files, stats.skipped, stats.segments, stats.falseHits,
+                read ? 100.0 * stats.falseHits / read : 0.0, stats.bytesRead / 1e6, stats.bytes / 1e6,
+                stats.matches, (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9);
+    }
+    return stats.matches ? 0 : 1;
+}
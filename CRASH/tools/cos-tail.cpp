@@ -0,0 +1,52 @@
+#include "../cos_live.h"
+#include <csignal>
+#include <cstdlib>
+
+int main(int argc, char* argv[]) {
+    std::string request = "live";
+    std::string socketPath;
+    bool follow = true, usage = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if ((arg == "--from" || arg == "--last") && i + 1 < argc) request = arg.substr(2) + " " + argv[++i];
+        else if (arg == "--once") follow = false;
+        else if (arg[0] != '-' && socketPath.empty()) socketPath = arg;
+        else usage = true;
+    }
+    if (usage || socketPath.empty()) {
+        fprintf(stderr, "usage: %s [--from OFFSET | --last BYTES] [--once] SOCKET\n"
+                        "Prints a COS process's live output (CosOptions::liveSocket). If it is dropped for\n"
+                        "falling behind it resumes where it was, unless --once; lost bytes are reported.\n",
+                argv[0]);
+        return 2;
+    }
+    std::signal(SIGPIPE, SIG_IGN);
+
+    CosLiveSubscription sub;
+    if (!sub.open(socketPath, request)) {
+        fprintf(stderr, "cos-tail: cannot connect to %s\n", socketPath.c_str());
+        return 1;
+    }
+
+    char buf[64 * 1024];
+    for (;;) {
+        ssize_t n = sub.read(buf, sizeof(buf));
+        if (n > 0) {
+            if (fwrite(buf, 1, n, stdout) != (size_t)n) return 1;
+            fflush(stdout);
+            continue;
+        }
+        if (n < 0 || !follow) return n < 0 ? 1 : 0;
+
+        // The process went away (its socket with it), or we were too slow.
+        uint64_t resumeAt = sub.offset();
+        if (!sub.open(socketPath, "from " + std::to_string(resumeAt))) return 0;
+        n = sub.read(buf, sizeof(buf));
+        if (sub.gap())
+            fprintf(stderr, "cos-tail: fell behind, %llu bytes lost\n", (unsigned long long)sub.gap());
+        if (n > 0 && fwrite(buf, 1, n, stdout) != (size_t)n) return 1;
+        if (n <= 0) return 0;
+        fflush(stdout);
+    }
+}